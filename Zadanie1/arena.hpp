@@ -0,0 +1,94 @@
+#pragma once
+
+#include <memory_resource>
+#include <cstddef>
+
+
+// Passes every request on to another resource and counts them
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+	explicit CountingResource(std::pmr::memory_resource *upstream) :
+		m_upstream{ upstream }
+	{
+		;
+	}
+
+	size_t allocations() const { return m_allocations; }
+	size_t bytes() const { return m_bytes; }
+	// Bytes handed out and not given back yet
+	size_t live() const { return m_live; }
+
+	void reset()
+	{
+		m_allocations = 0;
+		m_bytes = 0;
+		m_live = 0;
+	}
+
+private:
+	void *do_allocate(size_t bytes, size_t alignment) override
+	{
+		m_allocations++;
+		m_bytes += bytes;
+		m_live += bytes;
+		return m_upstream->allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void *p, size_t bytes, size_t alignment) override
+	{
+		m_live -= bytes;
+		m_upstream->deallocate(p, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+	{
+		return this == &other;
+	}
+
+	std::pmr::memory_resource *m_upstream;
+	size_t m_allocations{ 0 };
+	size_t m_bytes{ 0 };
+	size_t m_live{ 0 };
+};
+
+
+// Memory for what a single interpreter keeps (lines, variables and compiled
+// blocks in one arena, arrays in another). Freeing is a no-op, all of it goes
+// back in a few chunks on release() or when the arena is destroyed. Requests
+// are counted before they reach the arena, so a program whose count stops
+// growing has reached a steady state.
+class Arena
+{
+public:
+	Arena() :
+		m_arena{ initial_size },
+		m_counter{ &m_arena }
+	{
+		;
+	}
+
+	Arena(const Arena &) = delete;
+	Arena &operator=(const Arena &) = delete;
+
+	std::pmr::memory_resource *resource() { return &m_counter; }
+
+	// Counted since the last release()
+	size_t allocations() const { return m_counter.allocations(); }
+	size_t bytes() const { return m_counter.bytes(); }
+	// Memory that was freed but the arena still holds
+	size_t stranded() const { return m_counter.bytes() - m_counter.live(); }
+
+	// Everything allocated from resource() must be gone by now
+	void release()
+	{
+		m_arena.release();
+		m_counter.reset();
+	}
+
+private:
+	static const size_t initial_size = 4096;
+
+	std::pmr::monotonic_buffer_resource m_arena;
+	CountingResource m_counter;
+};
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include "arraykernels.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ARRAY_KERNELS_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ARRAY_KERNELS_SSE2
+#endif
+
+
+namespace
+{
+	template <typename T, typename Cmp>
+	void compareLoop(const T *a, const T *b, T *r, size_t n, Cmp cmp)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			r[i] = cmp(a[i], b[i]) ? 1 : 0;
+		}
+	}
+
+	template <typename T>
+	void compareScalar(Lexer::Token op, const T *a, const T *b, T *r, size_t n)
+	{
+		// Dispatch once per array, not once per element
+		switch (op)
+		{
+		case Lexer::Token::LT: compareLoop(a, b, r, n, [](T x, T y) { return x < y; }); break;
+		case Lexer::Token::GT: compareLoop(a, b, r, n, [](T x, T y) { return x > y; }); break;
+		case Lexer::Token::LTE: compareLoop(a, b, r, n, [](T x, T y) { return x <= y; }); break;
+		case Lexer::Token::GTE: compareLoop(a, b, r, n, [](T x, T y) { return x >= y; }); break;
+		case Lexer::Token::EQ: compareLoop(a, b, r, n, [](T x, T y) { return x == y; }); break;
+		default: break;
+		}
+	}
+
+#if defined(ARRAY_KERNELS_AVX2)
+	typedef __m256i vec;
+	const size_t lanes = 8;
+
+	inline vec load(const int32_t *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+	inline void store(int32_t *p, vec v) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v); }
+	inline vec broadcast(int32_t x) { return _mm256_set1_epi32(x); }
+	inline vec add(vec a, vec b) { return _mm256_add_epi32(a, b); }
+	inline vec mul(vec a, vec b) { return _mm256_mullo_epi32(a, b); }
+	inline vec cmpgt(vec a, vec b) { return _mm256_cmpgt_epi32(a, b); }
+	inline vec cmpeq(vec a, vec b) { return _mm256_cmpeq_epi32(a, b); }
+	inline vec and_(vec a, vec b) { return _mm256_and_si256(a, b); }
+	inline vec andnot(vec a, vec b) { return _mm256_andnot_si256(a, b); }
+#elif defined(ARRAY_KERNELS_SSE2)
+	typedef __m128i vec;
+	const size_t lanes = 4;
+
+	inline vec load(const int32_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+	inline void store(int32_t *p, vec v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+	inline vec broadcast(int32_t x) { return _mm_set1_epi32(x); }
+	inline vec add(vec a, vec b) { return _mm_add_epi32(a, b); }
+
+	// SSE2 has no 32-bit low multiply, so multiply even and odd lanes as 64-bit
+	// and put the low halves back together
+	inline vec mul(vec a, vec b)
+	{
+		const vec even = _mm_mul_epu32(a, b);
+		const vec odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+
+	inline vec cmpgt(vec a, vec b) { return _mm_cmpgt_epi32(a, b); }
+	inline vec cmpeq(vec a, vec b) { return _mm_cmpeq_epi32(a, b); }
+	inline vec and_(vec a, vec b) { return _mm_and_si128(a, b); }
+	inline vec andnot(vec a, vec b) { return _mm_andnot_si128(a, b); }
+#endif
+}
+
+
+template <typename V>
+bool ArrayKernels<V>::add(const T *a, const T *b, T *r, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!V::add(a[i], b[i], r[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+template <typename V>
+bool ArrayKernels<V>::mul(const T *a, const T *b, T *r, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!V::mul(a[i], b[i], r[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+template <typename V>
+void ArrayKernels<V>::compare(Lexer::Token op, const T *a, const T *b, T *r, size_t n)
+{
+	compareScalar(op, a, b, r, n);
+}
+
+
+template <typename V>
+bool ArrayKernels<V>::sum(const T *a, size_t n, T &r)
+{
+	T total = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!V::add(total, a[i], total))
+		{
+			return false;
+		}
+	}
+
+	r = total;
+	return true;
+}
+
+
+template <typename V>
+void ArrayKernels<V>::fill(T *r, size_t n, T value)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		r[i] = value;
+	}
+}
+
+
+template <>
+bool ArrayKernels<Int32Value>::add(const int32_t *a, const int32_t *b, int32_t *r, size_t n)
+{
+	size_t i = 0;
+#if defined(ARRAY_KERNELS_AVX2) || defined(ARRAY_KERNELS_SSE2)
+	for (; i + lanes <= n; i += lanes)
+	{
+		store(r + i, ::add(load(a + i), load(b + i)));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		Int32Value::add(a[i], b[i], r[i]);
+	}
+
+	return true;
+}
+
+
+template <>
+bool ArrayKernels<Int32Value>::mul(const int32_t *a, const int32_t *b, int32_t *r, size_t n)
+{
+	size_t i = 0;
+#if defined(ARRAY_KERNELS_AVX2) || defined(ARRAY_KERNELS_SSE2)
+	for (; i + lanes <= n; i += lanes)
+	{
+		store(r + i, ::mul(load(a + i), load(b + i)));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		Int32Value::mul(a[i], b[i], r[i]);
+	}
+
+	return true;
+}
+
+
+template <>
+void ArrayKernels<Int32Value>::compare(Lexer::Token op, const int32_t *a, const int32_t *b, int32_t *r, size_t n)
+{
+	size_t i = 0;
+#if defined(ARRAY_KERNELS_AVX2) || defined(ARRAY_KERNELS_SSE2)
+	// Comparisons give all-ones lanes, masking with 1 turns them into 0/1.
+	// <= and >= are the negations of > and <.
+	const vec one = broadcast(1);
+	for (; i + lanes <= n; i += lanes)
+	{
+		const vec x = load(a + i), y = load(b + i);
+		vec v;
+		switch (op)
+		{
+		case Lexer::Token::LT: v = and_(cmpgt(y, x), one); break;
+		case Lexer::Token::GT: v = and_(cmpgt(x, y), one); break;
+		case Lexer::Token::LTE: v = andnot(cmpgt(x, y), one); break;
+		case Lexer::Token::GTE: v = andnot(cmpgt(y, x), one); break;
+		case Lexer::Token::EQ: v = and_(cmpeq(x, y), one); break;
+		default: return;
+		}
+
+		store(r + i, v);
+	}
+#endif
+
+	compareScalar(op, a + i, b + i, r + i, n - i);
+}
+
+
+template <>
+bool ArrayKernels<Int32Value>::sum(const int32_t *a, size_t n, int32_t &r)
+{
+	int32_t total = 0;
+	size_t i = 0;
+#if defined(ARRAY_KERNELS_AVX2) || defined(ARRAY_KERNELS_SSE2)
+	vec acc = broadcast(0);
+	for (; i + lanes <= n; i += lanes)
+	{
+		acc = ::add(acc, load(a + i));
+	}
+
+	int32_t partial[lanes];
+	store(partial, acc);
+	for (size_t j = 0; j < lanes; j++)
+	{
+		Int32Value::add(total, partial[j], total);
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		Int32Value::add(total, a[i], total);
+	}
+
+	r = total;
+	return true;
+}
+
+
+template <>
+void ArrayKernels<Int32Value>::fill(int32_t *r, size_t n, int32_t value)
+{
+	size_t i = 0;
+#if defined(ARRAY_KERNELS_AVX2) || defined(ARRAY_KERNELS_SSE2)
+	const vec v = broadcast(value);
+	for (; i + lanes <= n; i += lanes)
+	{
+		store(r + i, v);
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		r[i] = value;
+	}
+}
+
+
+template struct ArrayKernels<Int64Value>;
+template struct ArrayKernels<CheckedInt64Value>;
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "lexer.hpp"
+#include "valuetypes.hpp"
+
+#include <cstddef>
+
+
+// Bulk operations over whole arrays. All pointers reference n elements, the
+// result may alias either input. Operations that can overflow return false
+// for the checked value types, the array contents are unspecified then.
+template <typename V>
+struct ArrayKernels
+{
+	typedef typename V::type T;
+
+	static bool add(const T *a, const T *b, T *r, size_t n);
+	static bool mul(const T *a, const T *b, T *r, size_t n);
+
+	// op is one of LT, GT, LTE, GTE, EQ, every result element is 0 or 1
+	static void compare(Lexer::Token op, const T *a, const T *b, T *r, size_t n);
+
+	static bool sum(const T *a, size_t n, T &r);
+	static void fill(T *r, size_t n, T value);
+};
+
+
+// 32-bit wrapping arrays get hand-written SIMD versions, everything else uses
+// the generic loops (which the compiler is free to vectorize on its own)
+template <> bool ArrayKernels<Int32Value>::add(const int32_t *a, const int32_t *b, int32_t *r, size_t n);
+template <> bool ArrayKernels<Int32Value>::mul(const int32_t *a, const int32_t *b, int32_t *r, size_t n);
+template <> void ArrayKernels<Int32Value>::compare(Lexer::Token op, const int32_t *a, const int32_t *b, int32_t *r, size_t n);
+template <> bool ArrayKernels<Int32Value>::sum(const int32_t *a, size_t n, int32_t &r);
+template <> void ArrayKernels<Int32Value>::fill(int32_t *r, size_t n, int32_t value);
@@ -0,0 +1,518 @@
+#ifdef _BENCHMARK
+
+#include "interpreter.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+
+#ifdef _WIN32
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+
+// Benchmark build: runs generated programs of a known shape and the sample
+// programs in tests/ under every executor mode, and prints one JSON document
+// with the results so they can be compared between commits.
+
+namespace
+{
+	typedef std::vector<std::string> Program;
+
+	struct Mode
+	{
+		const char *name;
+		size_t hot_threshold;
+	};
+
+	// Plain interpreter only, the default tiering, and compiling on first entry
+	const Mode MODES[] = {
+		{ "interpreter", 0 },
+		{ "tiered", 50 },
+		{ "eager", 1 }
+	};
+
+	// Programs from files are loaded with loadFile, so load time includes the I/O
+	struct Benchmark
+	{
+		std::string name;
+		Program program;
+		std::string filename;
+	};
+
+	struct Result
+	{
+		size_t steps{ 0 };
+		size_t allocations{ 0 };
+		double load_ms{ 0 };
+		double run_ms{ 0 };
+		InterpreterBase::Status status{ InterpreterBase::Status::OK };
+		// High-water mark of the process that ran it, 0 if it shared one with other runs
+		size_t peak_rss{ 0 };
+	};
+
+
+	size_t peakRss()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+		{
+			return 0;
+		}
+#ifdef __APPLE__
+		return usage.ru_maxrss;
+#else
+		return usage.ru_maxrss * 1024;
+#endif
+#endif
+	}
+
+
+	// for (i = 0; i < n; i++) {}
+	Program countingLoop(size_t n)
+	{
+		return {
+			"=,i,0",
+			"+,i,1,i",
+			"<,i," + std::to_string(n) + ",c",
+			"JUMPT,c,2"
+		};
+	}
+
+	// Every iteration takes a different path than the one before it
+	Program branchHeavy(size_t n)
+	{
+		return {
+			"=,i,0",
+			"=,t,0",
+			"=,s,0",
+			"==,t,0,c",
+			"JUMPT,c,8",
+			"=,t,0",
+			"JUMP,10",
+			"=,t,1",
+			"+,s,1,s",
+			"JUMPF,t,12",
+			"+,s,2,s",
+			"+,i,1,i",
+			"<,i," + std::to_string(n) + ",c",
+			"JUMPT,c,4"
+		};
+	}
+
+	// A chain through `count` distinct variables, repeated `rounds` times
+	Program manyVariables(size_t count, size_t rounds)
+	{
+		Program program{ "=,r,0", "=,v0,1" };
+		for (size_t i = 1; i < count; i++)
+		{
+			program.push_back("+,v" + std::to_string(i - 1) + ",1,v" + std::to_string(i));
+		}
+
+		program.push_back("=,v0,v" + std::to_string(count - 1));
+		program.push_back("+,r,1,r");
+		program.push_back("<,r," + std::to_string(rounds) + ",c");
+		program.push_back("JUMPT,c,3");
+		return program;
+	}
+
+	// for (i = 0; i < n; i++) s += i * 7
+	Program inductionMultiply(size_t n)
+	{
+		return {
+			"=,i,0",
+			"=,s,0",
+			"*,i,7,x",
+			"+,s,x,s",
+			"+,i,1,i",
+			"<,i," + std::to_string(n) + ",c",
+			"JUMPT,c,3"
+		};
+	}
+
+	// for (o = 0; o < n; o++) for (j = 0; j < 4; j++) s += j
+	Program smallLoops(size_t n)
+	{
+		return {
+			"=,o,0",
+			"=,s,0",
+			"=,j,0",
+			"+,s,j,s",
+			"+,j,1,j",
+			"<,j,4,c",
+			"JUMPT,c,4",
+			"+,o,1,o",
+			"<,o," + std::to_string(n) + ",c",
+			"JUMPT,c,3"
+		};
+	}
+
+	// No jumps at all, so tiering never kicks in
+	Program straightLine(size_t length)
+	{
+		Program program{ "=,a,1", "=,b,3" };
+		const char *ops[] = { "+", "-", "*", "<", "==" };
+		for (size_t i = 0; i < length; i++)
+		{
+			program.push_back(std::string(ops[i % 5]) + ",a,b," + (i % 2 ? "a" : "b"));
+		}
+
+		return program;
+	}
+
+	bool readLines(const std::string &filename, Program &program)
+	{
+		std::ifstream in(filename);
+		if (!in.is_open())
+		{
+			return false;
+		}
+
+		std::string line;
+		while (std::getline(in, line))
+		{
+			if (!line.empty())
+			{
+				program.push_back(line);
+			}
+		}
+
+		return true;
+	}
+
+
+	template <typename V>
+	Result runOnce(const Benchmark &benchmark, const Mode &mode, size_t max_steps)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		// READ gets the same big-ish number every time, WRITE output is thrown away
+		std::string values;
+		for (size_t i = 0; i < 1000; i++)
+		{
+			values += "1000\n";
+		}
+		std::istringstream in(values);
+		std::ostringstream out;
+
+		Result result;
+		BasicInterpreter<V> interp;
+		interp.setHotThreshold(mode.hot_threshold);
+		interp.setStepBudget(max_steps);
+		interp.setInput(in);
+		interp.setOutput(out);
+
+		const Clock::time_point load_start = Clock::now();
+		if (!benchmark.filename.empty())
+		{
+			interp.loadFile(benchmark.filename);
+		}
+		else
+		{
+			for (const std::string &line : benchmark.program)
+			{
+				interp.loadLine(line);
+			}
+		}
+
+		const Clock::time_point run_start = Clock::now();
+		result.status = interp.execute();
+		const Clock::time_point end = Clock::now();
+
+		result.steps = interp.getStepCount();
+		result.allocations = interp.getAllocationCount();
+		result.load_ms = std::chrono::duration<double, std::milli>(run_start - load_start).count();
+		result.run_ms = std::chrono::duration<double, std::milli>(end - run_start).count();
+		return result;
+	}
+
+	// Best of `repeat` runs, the minimum is the least noisy estimate
+	template <typename V>
+	Result run(const Benchmark &benchmark, const Mode &mode, size_t repeat, size_t max_steps)
+	{
+		Result best = runOnce<V>(benchmark, mode, max_steps);
+		for (size_t i = 1; i < repeat; i++)
+		{
+			Result r = runOnce<V>(benchmark, mode, max_steps);
+			if (r.run_ms < best.run_ms)
+			{
+				best = r;
+			}
+		}
+
+		return best;
+	}
+
+	// ru_maxrss only ever grows, so every run gets a process of its own (a
+	// fork, which starts from what this one has resident). Without fork the
+	// run happens here and only the process-wide peak at the end means anything.
+	Result isolated(const std::function<Result()> &measure)
+	{
+#ifdef _WIN32
+		return measure();
+#else
+		int fds[2];
+		if (pipe(fds) != 0)
+		{
+			return measure();
+		}
+
+		const pid_t pid = fork();
+		if (pid < 0)
+		{
+			close(fds[0]);
+			close(fds[1]);
+			return measure();
+		}
+
+		if (pid == 0)
+		{
+			close(fds[0]);
+			Result result = measure();
+			result.peak_rss = peakRss();
+			const bool sent = write(fds[1], &result, sizeof(result)) == static_cast<ssize_t>(sizeof(result));
+			// Skips exit handlers and the parent's unflushed std::cout
+			_exit(sent ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+
+		close(fds[1]);
+		Result result;
+		size_t received = 0;
+		while (received < sizeof(result))
+		{
+			const ssize_t n = read(fds[0], reinterpret_cast<char *>(&result) + received, sizeof(result) - received);
+			if (n < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (n <= 0)
+			{
+				break;
+			}
+
+			received += n;
+		}
+		close(fds[0]);
+		waitpid(pid, nullptr, 0);
+
+		// A child that crashed is reported as a failed run
+		if (received < sizeof(result))
+		{
+			result = Result();
+			result.status = InterpreterBase::Status::INTERNAL_ERROR;
+		}
+
+		return result;
+#endif
+	}
+
+	// Runs one of the scanners over every line `rounds` times, returns the milliseconds it took.
+	// checksum sums the tokens, it is printed so the loop can't be thrown away and
+	// both scanners have to agree on it.
+	double lexLines(const std::vector<const Program *> &programs, size_t rounds, bool reference, size_t &tokens, size_t &checksum)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		tokens = 0;
+		checksum = 0;
+		const Clock::time_point start = Clock::now();
+		for (size_t r = 0; r < rounds; r++)
+		{
+			for (const Program *program : programs)
+			{
+				for (const std::string &line : *program)
+				{
+					Lexer p(line);
+					Lexer::Token t;
+					do {
+						t = reference ? p.nextReference() : p.next();
+						checksum += t;
+						tokens++;
+					} while (t != Lexer::Token::EOL);
+				}
+			}
+		}
+		const Clock::time_point end = Clock::now();
+
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	std::string jsonString(const std::string &s)
+	{
+		std::string escaped = "\"";
+		for (char c : s)
+		{
+			if (c == '"' || c == '\\')
+			{
+				escaped += '\\';
+			}
+			escaped += c;
+		}
+
+		return escaped + "\"";
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	size_t repeat = 3;
+	size_t max_steps = 10000000;
+	std::string filter;
+	std::vector<std::string> files{
+		"tests/1.txt", "tests/2.txt", "tests/3.txt", "tests/4.txt", "tests/5.txt", "tests/6.txt",
+		"tests/jump.txt", "tests/jumpf.txt", "tests/jumpt.txt"
+	};
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg(argv[i]);
+		if ((arg == "--repeat" || arg == "--max-steps" || arg == "--filter") && i + 1 < argc)
+		{
+			const std::string value(argv[++i]);
+			if (arg == "--filter")
+			{
+				filter = value;
+			}
+			else
+			{
+				(arg == "--repeat" ? repeat : max_steps) = std::strtoull(value.c_str(), nullptr, 10);
+			}
+		}
+		else if (arg == "--files")
+		{
+			files.assign(argv + i + 1, argv + argc);
+			break;
+		}
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--repeat N] [--max-steps N] [--filter TEXT] [--files FILE...]\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<Benchmark> benchmarks{
+		{ "counting_loop", countingLoop(200000), "" },
+		{ "branch_heavy", branchHeavy(50000), "" },
+		{ "induction_multiply", inductionMultiply(200000), "" },
+		{ "small_loops", smallLoops(50000), "" },
+		{ "many_variables", manyVariables(2000, 20), "" },
+		{ "straight_line", straightLine(50000), "" }
+	};
+
+	for (const std::string &file : files)
+	{
+		Benchmark b{ file, Program(), file };
+		if (!readLines(file, b.program))
+		{
+			std::cerr << "File \"" << file << "\" was not found\n";
+			return EXIT_FAILURE;
+		}
+
+		benchmarks.push_back(b);
+	}
+
+	const char *value_types[] = { "int32", "int64", "checked" };
+
+	std::cout << "{\n\t\"benchmarks\": [";
+	bool first = true;
+	for (const Benchmark &b : benchmarks)
+	{
+		if (b.name.find(filter) == std::string::npos)
+		{
+			continue;
+		}
+
+		for (const Mode &mode : MODES)
+		{
+			for (size_t t = 0; t < 3; t++)
+			{
+				const Result r = isolated([&] {
+					switch (t)
+					{
+					case 0: return run<Int32Value>(b, mode, repeat, max_steps);
+					case 1: return run<Int64Value>(b, mode, repeat, max_steps);
+					default: return run<CheckedInt64Value>(b, mode, repeat, max_steps);
+					}
+				});
+
+				const double seconds = r.run_ms / 1000;
+				std::cout << (first ? "\n" : ",\n") << "\t\t{ "
+					<< "\"program\": " << jsonString(b.name)
+					<< ", \"mode\": \"" << mode.name << "\""
+					<< ", \"value_type\": \"" << value_types[t] << "\""
+					<< ", \"lines\": " << b.program.size()
+					<< ", \"status\": " << static_cast<int>(r.status)
+					<< ", \"instructions\": " << r.steps
+					<< ", \"load_ms\": " << r.load_ms
+					<< ", \"run_ms\": " << r.run_ms
+					<< ", \"instructions_per_sec\": " << (seconds > 0 ? r.steps / seconds : 0)
+					<< ", \"ns_per_instruction\": " << (r.steps ? r.run_ms * 1e6 / r.steps : 0)
+					<< ", \"allocations\": " << r.allocations;
+				if (r.peak_rss)
+				{
+					std::cout << ", \"peak_rss_bytes\": " << r.peak_rss;
+				}
+				std::cout << " }";
+				first = false;
+			}
+		}
+	}
+	std::cout << "\n\t]";
+
+	// Generated lexer against the hand-written one, over the lines of every program above
+	if (std::string("lexer").find(filter) != std::string::npos)
+	{
+		std::vector<const Program *> programs;
+		for (const Benchmark &b : benchmarks)
+		{
+			programs.push_back(&b.program);
+		}
+
+		std::cout << ",\n\t\"lexers\": [";
+		for (int reference = 0; reference < 2; reference++)
+		{
+			size_t tokens = 0;
+			size_t checksum = 0;
+			double best = 0;
+			for (size_t i = 0; i < repeat; i++)
+			{
+				const double ms = lexLines(programs, 10, reference != 0, tokens, checksum);
+				best = i == 0 || ms < best ? ms : best;
+			}
+
+			std::cout << (reference ? ",\n" : "\n") << "\t\t{ "
+				<< "\"lexer\": \"" << (reference ? "hand-written" : "generated") << "\""
+				<< ", \"tokens\": " << tokens
+				<< ", \"checksum\": " << checksum
+				<< ", \"run_ms\": " << best
+				<< ", \"ns_per_token\": " << (tokens ? best * 1e6 / tokens : 0)
+				<< " }";
+		}
+		std::cout << "\n\t]";
+	}
+
+	// This process only, runs done in a child of their own aren't in it
+	std::cout << ",\n\t\"peak_rss_bytes\": " << peakRss();
+	std::cout << "\n}\n";
+
+	return EXIT_SUCCESS;
+}
+
+#endif // _BENCHMARK
\ No newline at end of file
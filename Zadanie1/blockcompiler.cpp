@@ -0,0 +1,304 @@
+#include "blockcompiler.hpp"
+#include "loopoptimizer.hpp"
+#include "valuetypes.hpp"
+
+#include <algorithm>
+
+
+template <typename V>
+BlockCompiler<V>::BlockCompiler(const ProgramLines &lines, Variables<T> &variables, const std::pmr::vector<uint8_t> &unchecked) :
+	m_lines{ lines },
+	m_variables{ variables },
+	m_unchecked{ unchecked }
+{
+	;
+}
+
+
+template <typename V>
+bool BlockCompiler<V>::compile(size_t start, Block &block)
+{
+	block.start = start;
+	block.end = scan(start, m_lines.size(), block);
+	block.before_loop = false;
+
+	// A jump back into the middle of the block closes a loop that starts there.
+	// The block stops short of it, so the loop always runs in a block of its own.
+	if (!block.code.empty())
+	{
+		const Instruction &last = block.code.back();
+		if ((last.op == Lexer::Token::JUMP || last.op == Lexer::Token::JUMPT || last.op == Lexer::Token::JUMPF) &&
+			last.target > start && last.target < block.end)
+		{
+			block.end = scan(start, last.target, block);
+			block.before_loop = true;
+		}
+	}
+
+	if (block.code.empty())
+	{
+		return false;
+	}
+
+	fuse(block);
+
+	// A constant assigned right before a loop tells how many times it runs
+	Instruction init;
+	LoopOptimizer<V>::unroll(block, start > 0 && initializer(start - 1, init) ? &init : nullptr);
+	return true;
+}
+
+
+// Decodes lines from start on, up to limit, into the block's code and returns where it stopped
+template <typename V>
+size_t BlockCompiler<V>::scan(size_t start, size_t limit, Block &block)
+{
+	block.code.clear();
+	block.reads.clear();
+
+	// Slots written earlier in the block are safe to read even if they don't exist yet
+	std::vector<uint8_t> written(m_variables.size(), 0);
+
+	auto readable = [&](const Operand &op) -> bool {
+		return op.kind != Operand::Kind::SLOT || m_variables.defined(op.value) ||
+			(static_cast<size_t>(op.value) < written.size() && written[op.value]);
+	};
+
+	// Reads that rely on the slot having been defined before the block started
+	auto assume = [&](const Operand &op) {
+		if (op.kind != Operand::Kind::SLOT || (static_cast<size_t>(op.value) < written.size() && written[op.value]))
+		{
+			return;
+		}
+
+		const size_t slot = static_cast<size_t>(op.value);
+		if (std::find(block.reads.begin(), block.reads.end(), slot) == block.reads.end())
+		{
+			block.reads.push_back(slot);
+		}
+	};
+
+	size_t index = start;
+	for (; index < limit; index++)
+	{
+		Instruction ins;
+		if (!decode(index, ins))
+		{
+			break;
+		}
+
+		if (!readable(ins.a) || !readable(ins.b))
+		{
+			break;
+		}
+
+		assume(ins.a);
+		assume(ins.b);
+
+		if (ins.dst.kind == Operand::Kind::SLOT)
+		{
+			// Decoding may have allocated new slots
+			written.resize(m_variables.size(), 0);
+			written[ins.dst.value] = 1;
+		}
+
+		block.code.push_back(ins);
+
+		if (ins.op == Lexer::Token::JUMP || ins.op == Lexer::Token::JUMPT || ins.op == Lexer::Token::JUMPF)
+		{
+			index++;
+			break;
+		}
+	}
+
+	return index;
+}
+
+
+template <typename V>
+bool BlockCompiler<V>::decode(size_t index, Instruction &ins)
+{
+	Lexer p(m_lines.at(index));
+
+	ins = Instruction{};
+	ins.line = index;
+	ins.op = p.next();
+
+	switch (ins.op)
+	{
+	// Empty line (after whitespace removal) is executed as NOP
+	case Lexer::Token::EOL: ins.op = Lexer::Token::NOP; return true;
+
+	// 0 operators
+	case Lexer::Token::NOP: return true;
+
+	// 1 operator
+	case Lexer::Token::JUMP: return target(p, ins.target);
+	case Lexer::Token::READ: return variable(p, ins.dst);
+	case Lexer::Token::WRITE: return variable(p, ins.a);
+
+	// 2 operators
+	case Lexer::Token::ASSIGN: return variable(p, ins.dst) && value(p, ins.a);
+	case Lexer::Token::JUMPT:
+	case Lexer::Token::JUMPF: return value(p, ins.a) && target(p, ins.target);
+
+	// 3 operators
+	case Lexer::Token::ADD:
+	case Lexer::Token::SUB:
+	case Lexer::Token::MULTIPLY:
+		ins.unchecked = index < m_unchecked.size() && m_unchecked[index];
+		return value(p, ins.a) && value(p, ins.b) && variable(p, ins.dst);
+
+	case Lexer::Token::LT:
+	case Lexer::Token::GT:
+	case Lexer::Token::LTE:
+	case Lexer::Token::GTE:
+	case Lexer::Token::EQ: return value(p, ins.a) && value(p, ins.b) && variable(p, ins.dst);
+
+	default:
+		return false;
+	}
+}
+
+
+// Only =,variable,literal with a variable that exists, unlike decode this
+// never adds variables for a line that may never run
+template <typename V>
+bool BlockCompiler<V>::initializer(size_t index, Instruction &ins)
+{
+	Lexer p(m_lines.at(index));
+	if (p.next() != Lexer::Token::ASSIGN || p.next() != Lexer::Token::VARIABLE)
+	{
+		return false;
+	}
+
+	size_t slot;
+	if (!m_variables.find(p.str(), slot))
+	{
+		return false;
+	}
+
+	T literal;
+	if (p.next() != Lexer::Token::NUMBER || !V::fromLiteral(p.num(), literal))
+	{
+		return false;
+	}
+
+	ins = Instruction{};
+	ins.op = Lexer::Token::ASSIGN;
+	ins.line = index;
+	ins.dst.kind = Operand::Kind::SLOT;
+	ins.dst.value = static_cast<int64_t>(slot);
+	ins.a.kind = Operand::Kind::IMMEDIATE;
+	ins.a.value = literal;
+	return true;
+}
+
+
+template <typename V>
+bool BlockCompiler<V>::value(Lexer &p, Operand &op)
+{
+	Lexer::Token t = p.next();
+	if (t == Lexer::Token::NUMBER)
+	{
+		T literal;
+		if (!V::fromLiteral(p.num(), literal))
+		{
+			return false;
+		}
+
+		op.kind = Operand::Kind::IMMEDIATE;
+		op.value = literal;
+		return true;
+	}
+
+	if (t == Lexer::Token::VARIABLE)
+	{
+		op.kind = Operand::Kind::SLOT;
+		op.value = static_cast<int64_t>(m_variables.slot(p.str()));
+		return true;
+	}
+
+	return false;
+}
+
+
+template <typename V>
+bool BlockCompiler<V>::variable(Lexer &p, Operand &op)
+{
+	if (p.next() != Lexer::Token::VARIABLE)
+	{
+		return false;
+	}
+
+	op.kind = Operand::Kind::SLOT;
+	op.value = static_cast<int64_t>(m_variables.slot(p.str()));
+	return true;
+}
+
+
+template <typename V>
+bool BlockCompiler<V>::target(Lexer &p, size_t &index)
+{
+	if (p.next() != Lexer::Token::NUMBER)
+	{
+		return false;
+	}
+
+	// Targets that haven't arrived yet (streaming) are left to the interpreter
+	const long long line = p.num();
+	if (line <= 0 || static_cast<unsigned long long>(line) > m_lines.size())
+	{
+		return false;
+	}
+
+	index = line - 1;
+	return true;
+}
+
+
+template <typename V>
+void BlockCompiler<V>::fuse(Block &block) const
+{
+	// Only the last two instructions can form a compare + branch pair,
+	// because a branch always ends the block
+	if (block.code.size() < 2)
+	{
+		return;
+	}
+
+	Instruction &cmp = block.code[block.code.size() - 2];
+	const Instruction &br = block.code.back();
+
+	if (br.op != Lexer::Token::JUMPT && br.op != Lexer::Token::JUMPF)
+	{
+		return;
+	}
+
+	switch (cmp.op)
+	{
+	case Lexer::Token::LT:
+	case Lexer::Token::GT:
+	case Lexer::Token::LTE:
+	case Lexer::Token::GTE:
+	case Lexer::Token::EQ:
+		break;
+
+	default:
+		return;
+	}
+
+	if (br.a.kind != Operand::Kind::SLOT || br.a.value != cmp.dst.value)
+	{
+		return;
+	}
+
+	cmp.branch = br.op;
+	cmp.target = br.target;
+	block.code.pop_back();
+}
+
+
+template class BlockCompiler<Int32Value>;
+template class BlockCompiler<Int64Value>;
+template class BlockCompiler<CheckedInt64Value>;
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "instruction.hpp"
+#include "variables.hpp"
+
+#include <string>
+#include <vector>
+
+
+template <typename V>
+class BlockCompiler
+{
+public:
+	typedef typename V::type T;
+
+	// unchecked has a nonzero entry for every line whose arithmetic can't overflow
+	BlockCompiler(const ProgramLines &lines, Variables<T> &variables, const std::pmr::vector<uint8_t> &unchecked);
+
+	// Compiles the longest run of lines starting at start that can run without any
+	// of the checks the plain interpreter does. Anything that could fail (malformed
+	// operands, jumps out of the program, reading a variable that doesn't exist yet,
+	// literals that don't fit the value type) ends the block, so errors are always reported by the plain interpreter.
+	bool compile(size_t start, Block &block);
+
+	bool decode(size_t index, Instruction &ins);
+
+private:
+	size_t scan(size_t start, size_t limit, Block &block);
+	bool initializer(size_t index, Instruction &ins);
+	bool value(Lexer &p, Operand &op);
+	bool variable(Lexer &p, Operand &op);
+	bool target(Lexer &p, size_t &index);
+
+	void fuse(Block &block) const;
+
+	const ProgramLines &m_lines;
+	Variables<T> &m_variables;
+	const std::pmr::vector<uint8_t> &m_unchecked;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "variables.hpp"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <algorithm>
+
+
+// Detects a program that came back to exactly the same state (line and every
+// variable) it was already in, which without new input means it will keep
+// going around forever. Uses Brent's algorithm, so only one snapshot is kept
+// and it is refreshed after 1, 2, 4, 8, .. checks. A hash of the state rules
+// out almost all mismatches before the full comparison.
+template <typename T>
+class CycleDetector
+{
+public:
+	typedef ArrayMap<T> Arrays;
+
+	// State changed in a way that doesn't come from the program itself (input)
+	void reset()
+	{
+		m_has_snapshot = false;
+		m_count = 0;
+		m_power = 1;
+	}
+
+	bool check(size_t line, const Variables<T> &variables, const Arrays &arrays)
+	{
+		const uint64_t hash = hashState(line, variables, arrays);
+
+		if (m_has_snapshot && hash == m_hash && line == m_line && sameState(variables, arrays))
+		{
+			return true;
+		}
+
+		if (++m_count == m_power)
+		{
+			m_has_snapshot = true;
+			m_count = 0;
+			m_power *= 2;
+
+			m_hash = hash;
+			m_line = line;
+			m_values.assign(variables.values(), variables.values() + variables.size());
+			m_defined.assign(variables.definedFlags(), variables.definedFlags() + variables.size());
+			m_arrays = arrays;
+		}
+
+		return false;
+	}
+
+private:
+	// FNV-1a
+	static void hashBytes(uint64_t &hash, const void *data, size_t size)
+	{
+		const uint8_t *p = static_cast<const uint8_t *>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ p[i]) * 1099511628211ULL;
+		}
+	}
+
+	static uint64_t hashState(size_t line, const Variables<T> &variables, const Arrays &arrays)
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		hashBytes(hash, &line, sizeof(line));
+		hashBytes(hash, variables.values(), variables.size() * sizeof(T));
+		hashBytes(hash, variables.definedFlags(), variables.size());
+
+		for (const auto &p : arrays)
+		{
+			hashBytes(hash, p.first.data(), p.first.size());
+			hashBytes(hash, p.second.data(), p.second.size() * sizeof(T));
+		}
+
+		return hash;
+	}
+
+	bool sameState(const Variables<T> &variables, const Arrays &arrays) const
+	{
+		return m_values.size() == variables.size() &&
+			std::equal(m_values.begin(), m_values.end(), variables.values()) &&
+			std::equal(m_defined.begin(), m_defined.end(), variables.definedFlags()) &&
+			m_arrays == arrays;
+	}
+
+	bool m_has_snapshot{ false };
+	size_t m_count{ 0 };
+	size_t m_power{ 1 };
+
+	uint64_t m_hash{ 0 };
+	size_t m_line{ 0 };
+	std::vector<T> m_values;
+	std::vector<uint8_t> m_defined;
+	Arrays m_arrays;
+};
\ No newline at end of file
@@ -0,0 +1,629 @@
+#include "daemon.hpp"
+#include "threadpool.hpp"
+
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+
+const size_t Daemon::max_cache_bytes;
+
+
+#ifndef _WIN32
+
+namespace
+{
+	// Refuses frames no sane program or input would need
+	const uint32_t MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+	bool sendAll(int fd, const char *data, size_t size)
+	{
+		while (size)
+		{
+			const ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+			if (sent < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (sent <= 0)
+			{
+				return false;
+			}
+
+			data += sent;
+			size -= sent;
+		}
+
+		return true;
+	}
+
+	bool readAll(int fd, char *data, size_t size)
+	{
+		while (size)
+		{
+			const ssize_t got = recv(fd, data, size, 0);
+			if (got < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (got <= 0)
+			{
+				return false;
+			}
+
+			data += got;
+			size -= got;
+		}
+
+		return true;
+	}
+
+	bool socketAddress(const std::string &path, sockaddr_un &address)
+	{
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path))
+		{
+			return false;
+		}
+
+		std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+		return true;
+	}
+
+	// Program output goes back to the client in OUTPUT frames as the buffer fills
+	class FrameStreambuf : public std::streambuf
+	{
+	public:
+		explicit FrameStreambuf(int fd) : m_fd(fd)
+		{
+			setp(m_buffer, m_buffer + sizeof(m_buffer));
+		}
+
+	protected:
+		int overflow(int c) override
+		{
+			if (sync() != 0)
+			{
+				return traits_type::eof();
+			}
+
+			if (c != traits_type::eof())
+			{
+				*pptr() = traits_type::to_char_type(c);
+				pbump(1);
+			}
+
+			return traits_type::not_eof(c);
+		}
+
+		int sync() override
+		{
+			const size_t size = pptr() - pbase();
+			if (size && !Protocol::sendFrame(m_fd, Protocol::OUTPUT, std::string(pbase(), size)))
+			{
+				return -1;
+			}
+
+			setp(m_buffer, m_buffer + sizeof(m_buffer));
+			return 0;
+		}
+
+	private:
+		int m_fd;
+		char m_buffer[4096];
+	};
+}
+
+
+bool Protocol::sendFrame(int fd, char type, const std::string &payload)
+{
+	const uint32_t size = static_cast<uint32_t>(payload.size());
+	const char header[5] = {
+		type,
+		static_cast<char>(size >> 24),
+		static_cast<char>(size >> 16),
+		static_cast<char>(size >> 8),
+		static_cast<char>(size)
+	};
+
+	return sendAll(fd, header, sizeof(header)) && sendAll(fd, payload.data(), payload.size());
+}
+
+
+bool Protocol::readFrame(int fd, char &type, std::string &payload)
+{
+	unsigned char header[5];
+	if (!readAll(fd, reinterpret_cast<char *>(header), sizeof(header)))
+	{
+		return false;
+	}
+
+	const uint32_t size = (uint32_t(header[1]) << 24) | (uint32_t(header[2]) << 16) | (uint32_t(header[3]) << 8) | header[4];
+	if (size > MAX_FRAME_SIZE)
+	{
+		return false;
+	}
+
+	type = static_cast<char>(header[0]);
+	payload.resize(size);
+	return size == 0 || readAll(fd, &payload[0], size);
+}
+
+
+Daemon::Daemon(const std::string &socket_path, size_t threads)
+	: m_socket_path(socket_path), m_threads(threads)
+{
+}
+
+
+Daemon::~Daemon()
+{
+	if (m_listen_fd >= 0)
+	{
+		close(m_listen_fd);
+		unlink(m_socket_path.c_str());
+	}
+}
+
+
+bool Daemon::start()
+{
+	sockaddr_un address;
+	if (!socketAddress(m_socket_path, address))
+	{
+		return false;
+	}
+
+	m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_listen_fd < 0)
+	{
+		return false;
+	}
+
+	// A socket file left behind by a previous run would make bind fail
+	unlink(m_socket_path.c_str());
+	if (bind(m_listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(m_listen_fd, SOMAXCONN) != 0)
+	{
+		close(m_listen_fd);
+		m_listen_fd = -1;
+		return false;
+	}
+
+	return true;
+}
+
+
+void Daemon::serve()
+{
+	ThreadPool pool(m_threads);
+
+	while (!m_stopping)
+	{
+		const int fd = accept(m_listen_fd, nullptr, nullptr);
+		if (fd < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			break;
+		}
+
+		pool.post([this, fd] { handle(fd); });
+	}
+}
+
+
+void Daemon::stop()
+{
+	m_stopping = true;
+
+	// Wakes up the accept in serve()
+	if (m_listen_fd >= 0)
+	{
+		shutdown(m_listen_fd, SHUT_RDWR);
+	}
+}
+
+
+size_t Daemon::getCachedProgramCount()
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	return m_lru.size();
+}
+
+
+size_t Daemon::getCachedBytes()
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	return m_cache_bytes;
+}
+
+
+Metrics Daemon::getMetrics()
+{
+	std::lock_guard<std::mutex> lock(m_metrics_mutex);
+	return m_metrics;
+}
+
+
+// Has to be called with m_cache_mutex held. Moves the program to the front.
+std::list<Daemon::CachedProgram>::iterator Daemon::findProgram(size_t hash, const std::string &text)
+{
+	auto it = m_cache.find(hash);
+	if (it == m_cache.end() || it->second->text != text)
+	{
+		return m_lru.end();
+	}
+
+	m_lru.splice(m_lru.begin(), m_lru, it->second);
+	return it->second;
+}
+
+
+// Has to be called with m_cache_mutex held
+void Daemon::evict()
+{
+	while (m_cache_bytes > max_cache_bytes && !m_lru.empty())
+	{
+		m_cache_bytes -= m_lru.back().bytes;
+		m_cache.erase(m_lru.back().hash);
+		m_lru.pop_back();
+	}
+}
+
+
+std::shared_ptr<const Daemon::Program> Daemon::program(size_t hash, const std::string &text)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_cache_mutex);
+		auto it = findProgram(hash, text);
+		if (it != m_lru.end())
+		{
+			return it->lines;
+		}
+	}
+
+	// Same rules as loadFile: one instruction per line, empty lines are skipped
+	auto lines = std::make_shared<Program>();
+	std::istringstream in(text);
+	std::string line;
+	while (std::getline(in, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+
+		if (!line.empty())
+		{
+			lines->push_back(line);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+
+	// Another request may have added it in the meantime
+	auto it = findProgram(hash, text);
+	if (it != m_lru.end())
+	{
+		return it->lines;
+	}
+
+	// A different program with the same hash gives up its place
+	auto collision = m_cache.find(hash);
+	if (collision != m_cache.end())
+	{
+		m_cache_bytes -= collision->second->bytes;
+		m_lru.erase(collision->second);
+		m_cache.erase(collision);
+	}
+
+	CachedProgram &cached = *m_lru.emplace(m_lru.begin());
+	cached.hash = hash;
+	cached.text = text;
+	cached.lines = lines;
+	// The text and its lines
+	cached.bytes = 2 * text.size();
+	m_cache[hash] = m_lru.begin();
+	m_cache_bytes += cached.bytes;
+	evict();
+	return lines;
+}
+
+
+template <typename V>
+std::unique_ptr<BasicInterpreter<V>> Daemon::checkOut(size_t hash, const std::string &text, const Program &lines)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_cache_mutex);
+		auto it = findProgram(hash, text);
+		if (it != m_lru.end() && !std::get<Idle<V>>(it->idle).empty())
+		{
+			Idle<V> &idle = std::get<Idle<V>>(it->idle);
+			std::unique_ptr<BasicInterpreter<V>> interp = std::move(idle.back());
+			idle.pop_back();
+
+			const size_t bytes = interp->getAllocatedBytes();
+			it->bytes -= bytes;
+			m_cache_bytes -= bytes;
+			return interp;
+		}
+	}
+
+	auto interp = std::make_unique<BasicInterpreter<V>>();
+	for (const std::string &line : lines)
+	{
+		interp->loadLine(line);
+	}
+
+	return interp;
+}
+
+
+template <typename V>
+void Daemon::checkIn(size_t hash, const std::string &text, std::unique_ptr<BasicInterpreter<V>> interp)
+{
+	// Idle interpreters hold no arrays, see reset()
+	interp->reset();
+	const size_t bytes = interp->getAllocatedBytes();
+
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	auto it = findProgram(hash, text);
+
+	// No more than can run at once. The ones not kept are destroyed after the
+	// lock is released.
+	if (it == m_lru.end() || std::get<Idle<V>>(it->idle).size() >= m_threads)
+	{
+		return;
+	}
+
+	std::get<Idle<V>>(it->idle).push_back(std::move(interp));
+	it->bytes += bytes;
+	m_cache_bytes += bytes;
+	evict();
+}
+
+
+void Daemon::handle(int fd)
+{
+	DaemonRequest request;
+	char type;
+	std::string config;
+
+	if (Protocol::readFrame(fd, type, config) && type == Protocol::CONFIG &&
+		Protocol::readFrame(fd, type, request.program) && type == Protocol::PROGRAM &&
+		Protocol::readFrame(fd, type, request.input) && type == Protocol::INPUT)
+	{
+		std::istringstream(config) >> request.value_type >> request.max_steps >> request.max_time >> request.detect_loops;
+
+		DaemonResponse response;
+		bool known = true;
+
+		// A job that throws only fails its own request, the daemon keeps serving
+		try
+		{
+			const size_t hash = std::hash<std::string>()(request.program);
+			std::shared_ptr<const Program> lines = program(hash, request.program);
+			if (request.value_type == "int32")
+			{
+				response = run<Int32Value>(fd, hash, *lines, request);
+			}
+			else if (request.value_type == "int64")
+			{
+				response = run<Int64Value>(fd, hash, *lines, request);
+			}
+			else if (request.value_type == "checked")
+			{
+				response = run<CheckedInt64Value>(fd, hash, *lines, request);
+			}
+			else
+			{
+				known = false;
+			}
+		}
+		catch (const std::exception &e)
+		{
+			response = failed(e.what());
+		}
+		catch (...)
+		{
+			response = failed("unknown exception");
+		}
+
+		// Unknown requests are answered by closing the connection
+		if (known)
+		{
+			Protocol::sendFrame(fd, Protocol::STATUS, std::to_string(static_cast<int>(response.status)) + " " +
+				std::to_string(response.line) + " " + response.error_info);
+		}
+	}
+
+	close(fd);
+}
+
+
+DaemonResponse Daemon::failed(const std::string &what)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_metrics_mutex);
+		m_metrics.runs++;
+		m_metrics.results[InterpreterBase::Status::INTERNAL_ERROR]++;
+	}
+
+	DaemonResponse response;
+	response.status = InterpreterBase::Status::INTERNAL_ERROR;
+	response.error_info = what;
+	return response;
+}
+
+
+template <typename V>
+DaemonResponse Daemon::run(int fd, size_t hash, const Program &program, const DaemonRequest &request)
+{
+	// If it throws, the interpreter is destroyed instead of going back to the cache
+	std::unique_ptr<BasicInterpreter<V>> interp = checkOut<V>(hash, request.program, program);
+
+	std::istringstream in(request.input);
+	FrameStreambuf buffer(fd);
+	std::ostream out(&buffer);
+
+	interp->setInput(in);
+	interp->setOutput(out);
+	interp->setStepBudget(request.max_steps);
+	interp->setTimeBudget(std::chrono::milliseconds(request.max_time));
+	interp->setCycleDetection(request.detect_loops);
+
+	DaemonResponse response;
+	response.status = interp->execute();
+	response.line = interp->getLineNumber();
+	response.error_info = interp->getErrorInfo();
+
+	{
+		std::lock_guard<std::mutex> lock(m_metrics_mutex);
+		m_metrics.merge(interp->getMetrics());
+	}
+
+	// The next request that gets this interpreter counts from zero
+	interp->clearMetrics();
+
+	out.flush();
+
+	// Both streams are gone once this returns
+	interp->setInput(std::cin);
+	interp->setOutput(std::cout);
+	checkIn<V>(hash, request.program, std::move(interp));
+	return response;
+}
+
+
+bool sendRequest(const std::string &socket_path, const DaemonRequest &request, std::ostream &out, DaemonResponse &response)
+{
+	sockaddr_un address;
+	if (!socketAddress(socket_path, address))
+	{
+		return false;
+	}
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	const std::string config = request.value_type + " " + std::to_string(request.max_steps) + " " + std::to_string(request.max_time) +
+		(request.detect_loops ? " 1" : " 0");
+	bool ok = connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 &&
+		Protocol::sendFrame(fd, Protocol::CONFIG, config) &&
+		Protocol::sendFrame(fd, Protocol::PROGRAM, request.program) &&
+		Protocol::sendFrame(fd, Protocol::INPUT, request.input);
+
+	bool finished = false;
+	char type;
+	std::string payload;
+	while (ok && !finished && Protocol::readFrame(fd, type, payload))
+	{
+		if (type == Protocol::OUTPUT)
+		{
+			out.write(payload.data(), payload.size());
+			out.flush();
+		}
+		else if (type == Protocol::STATUS)
+		{
+			std::istringstream status(payload);
+			int code = 0;
+			status >> code >> response.line;
+			status.get();
+			std::getline(status, response.error_info);
+
+			response.status = static_cast<InterpreterBase::Status>(code);
+			finished = true;
+		}
+		else
+		{
+			ok = false;
+		}
+	}
+
+	close(fd);
+	return ok && finished;
+}
+
+#else
+
+bool Protocol::sendFrame(int, char, const std::string &)
+{
+	return false;
+}
+
+
+bool Protocol::readFrame(int, char &, std::string &)
+{
+	return false;
+}
+
+
+Daemon::Daemon(const std::string &socket_path, size_t threads)
+	: m_socket_path(socket_path), m_threads(threads)
+{
+}
+
+
+Daemon::~Daemon()
+{
+}
+
+
+bool Daemon::start()
+{
+	return false;
+}
+
+
+void Daemon::serve()
+{
+}
+
+
+void Daemon::stop()
+{
+}
+
+
+size_t Daemon::getCachedProgramCount()
+{
+	return 0;
+}
+
+
+size_t Daemon::getCachedBytes()
+{
+	return 0;
+}
+
+
+Metrics Daemon::getMetrics()
+{
+	return Metrics();
+}
+
+
+bool sendRequest(const std::string &, const DaemonRequest &, std::ostream &, DaemonResponse &)
+{
+	return false;
+}
+
+#endif // _WIN32
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "interpreter.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <list>
+#include <tuple>
+#include <iostream>
+
+
+// Wire format shared by the daemon and the client. Every frame is a type byte,
+// a 4 byte big-endian payload length and the payload. A request is a CONFIG,
+// PROGRAM and INPUT frame, the answer is any number of OUTPUT frames followed
+// by one STATUS frame.
+namespace Protocol
+{
+	enum FrameType : char
+	{
+		CONFIG = 'C',	// "<int32|int64|checked> <max steps> <max time ms> <detect loops>"
+		PROGRAM = 'P',
+		INPUT = 'I',
+		OUTPUT = 'O',
+		STATUS = 'S'	// "<status> <line> <error info>"
+	};
+
+	bool sendFrame(int fd, char type, const std::string &payload);
+	bool readFrame(int fd, char &type, std::string &payload);
+}
+
+
+struct DaemonRequest
+{
+	std::string value_type{ "int32" };
+	size_t max_steps{ 0 };
+	size_t max_time{ 0 };
+	bool detect_loops{ false };
+	std::string program;
+	std::string input;
+};
+
+
+struct DaemonResponse
+{
+	InterpreterBase::Status status{ InterpreterBase::Status::OK };
+	size_t line{ 0 };
+	std::string error_info;
+};
+
+
+// Runs programs sent over a Unix domain socket so short jobs don't pay for
+// process startup. Only available on POSIX systems, start() fails elsewhere.
+class Daemon
+{
+public:
+	Daemon(const std::string &socket_path, size_t threads);
+	~Daemon();
+
+	// Binds and listens, serve() then handles connections until stop() is called
+	bool start();
+	void serve();
+	void stop();
+
+	// Programs and the idle interpreters that hold them, the least recently
+	// used ones are dropped past max_cache_bytes
+	static const size_t max_cache_bytes = size_t(64) << 20;
+	size_t getCachedProgramCount();
+	size_t getCachedBytes();
+
+	// Sum of the counters of every request served so far
+	Metrics getMetrics();
+
+private:
+	typedef std::vector<std::string> Program;
+
+	std::string m_socket_path;
+	size_t m_threads;
+	int m_listen_fd{ -1 };
+	std::atomic<bool> m_stopping{ false };
+
+	// Interpreters that have loaded a program and are waiting for the next
+	// request to run it, one list per value type
+	template <typename V>
+	using Idle = std::vector<std::unique_ptr<BasicInterpreter<V>>>;
+
+	// A program is kept split into lines, along with idle interpreters that
+	// already hold it (and the blocks they compiled). The text is kept too so
+	// a hash collision can't run the wrong program.
+	struct CachedProgram
+	{
+		size_t hash{ 0 };
+		std::string text;
+		std::shared_ptr<const Program> lines;
+		std::tuple<Idle<Int32Value>, Idle<Int64Value>, Idle<CheckedInt64Value>> idle;
+		// Text plus the memory of the idle interpreters
+		size_t bytes{ 0 };
+	};
+
+	// Most recently used first, programs are dropped from the back
+	std::mutex m_cache_mutex;
+	std::list<CachedProgram> m_lru;
+	std::unordered_map<size_t, std::list<CachedProgram>::iterator> m_cache;
+	size_t m_cache_bytes{ 0 };
+
+	// Workers count into their own interpreter and merge here once per request
+	std::mutex m_metrics_mutex;
+	Metrics m_metrics;
+
+	std::shared_ptr<const Program> program(size_t hash, const std::string &text);
+	std::list<CachedProgram>::iterator findProgram(size_t hash, const std::string &text);
+	void evict();
+
+	// An idle interpreter with the program loaded, or a new one if there is none
+	template <typename V>
+	std::unique_ptr<BasicInterpreter<V>> checkOut(size_t hash, const std::string &text, const Program &lines);
+	// Back to the cache, as long as the program is still in it
+	template <typename V>
+	void checkIn(size_t hash, const std::string &text, std::unique_ptr<BasicInterpreter<V>> interp);
+	void handle(int fd);
+	// Answer for a request whose job threw
+	DaemonResponse failed(const std::string &what);
+
+	template <typename V>
+	DaemonResponse run(int fd, size_t hash, const Program &program, const DaemonRequest &request);
+};
+
+
+// Sends one request to a daemon, output is written to `out` as it arrives
+bool sendRequest(const std::string &socket_path, const DaemonRequest &request, std::ostream &out, DaemonResponse &response);
\ No newline at end of file
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "lexer.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory_resource>
+#include <cstdint>
+
+
+// Pre-decoded form of a single line, used by the optimized tier
+struct Operand
+{
+	enum Kind : uint8_t
+	{
+		NONE,
+		SLOT,
+		IMMEDIATE
+	};
+
+	Kind kind{ NONE };
+
+	// Slot index for SLOT, the literal itself for IMMEDIATE
+	int64_t value{ 0 };
+};
+
+
+struct Instruction
+{
+	Lexer::Token op{ Lexer::Token::NOP };
+	Operand a, b, dst;
+
+	// Comparisons may be fused with the JUMPT/JUMPF that consumes their result,
+	// in which case branch holds JUMPT or JUMPF and the compare ends the block
+	Lexer::Token branch{ Lexer::Token::EOL };
+
+	// Checked arithmetic the optimizer proved can't overflow
+	bool unchecked{ false };
+
+	// Strength reduced MULTIPLY (see loopoptimizer.hpp), computes dst + increment.
+	// a and b are still the original factors, for the error message.
+	bool reduced{ false };
+	int64_t increment{ 0 };
+
+	// Zero-based line index of the jump target
+	size_t target{ 0 };
+
+	// Zero-based line index the instruction was decoded from
+	size_t line{ 0 };
+};
+
+
+// Straight-line run of instructions starting at a line that was reached often
+// enough to be worth compiling. It ends with a jump or right before the first
+// line that could not be compiled.
+struct Block
+{
+	// Lets containers hand their memory resource down to the code
+	typedef std::pmr::polymorphic_allocator<Instruction> allocator_type;
+
+	Block() = default;
+	explicit Block(const allocator_type &allocator) :
+		code{ allocator },
+		reads{ allocator },
+		unrolled{ allocator }
+	{
+		;
+	}
+
+	Block(const Block &other, const allocator_type &allocator) :
+		start{ other.start },
+		end{ other.end },
+		code{ other.code, allocator },
+		reads{ other.reads, allocator },
+		unrolled{ other.unrolled, allocator },
+		iterations{ other.iterations },
+		induction{ other.induction },
+		step{ other.step },
+		before_loop{ other.before_loop }
+	{
+		;
+	}
+
+	Block(Block &&other, const allocator_type &allocator) :
+		start{ other.start },
+		end{ other.end },
+		code{ std::move(other.code), allocator },
+		reads{ std::move(other.reads), allocator },
+		unrolled{ std::move(other.unrolled), allocator },
+		iterations{ other.iterations },
+		induction{ other.induction },
+		step{ other.step },
+		before_loop{ other.before_loop }
+	{
+		;
+	}
+
+	Block(const Block &) = default;
+	Block(Block &&) = default;
+	Block &operator=(const Block &) = default;
+	Block &operator=(Block &&) = default;
+
+	size_t start{ 0 };
+	size_t end{ 0 };
+	std::pmr::vector<Instruction> code;
+
+	// Slots read before the block writes them, they all existed when it was compiled
+	std::pmr::vector<size_t> reads;
+
+	// Blocks that jump back to their own start may also come unrolled, `iterations`
+	// copies of the body in a row (see loopoptimizer.hpp). 0 if there is no such code.
+	std::pmr::vector<Instruction> unrolled;
+	size_t iterations{ 0 };
+
+	// The loop's induction variable: its only store in the body adds `step` to it
+	size_t induction{ 0 };
+	int64_t step{ 0 };
+
+	// Ends right before the start of a loop, which has a block of its own
+	bool before_loop{ false };
+};
+
+
+// Source lines as the interpreter keeps them. A deque never moves its elements,
+// so lines (and tokens pointing into them) stay put while more lines arrive.
+typedef std::pmr::deque<std::pmr::string> ProgramLines;
@@ -1,17 +1,39 @@
 #include "interpreter.hpp"
+#include "blockcompiler.hpp"
+#include "loopoptimizer.hpp"
+#include "arraykernels.hpp"
 
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <algorithm>
-
-
-Interpreter::Interpreter()
+#include <limits>
+
+
+const size_t InterpreterBase::max_array_length;
+
+
+template <typename V>
+BasicInterpreter<V>::BasicInterpreter() :
+	m_lines{ m_arena.resource() },
+	m_variables{ m_arena.resource() },
+	m_arrays{ m_run_arena.resource() },
+	m_block_counts{ m_arena.resource() },
+	m_blocks{ m_arena.resource() },
+	m_block_storage{ m_arena.resource() },
+	m_scratch{ m_arena.resource() },
+	m_block_ready{ m_arena.resource() },
+	m_block_runs{ m_arena.resource() },
+	m_line_runs{ m_arena.resource() },
+	m_line_jumps{ m_arena.resource() },
+	m_unchecked{ m_arena.resource() }
 {
 	;
 }
 
 
-bool Interpreter::loadFile(const std::string &filename)
+template <typename V>
+bool BasicInterpreter<V>::loadFile(const std::string &filename)
 {
 	std::ifstream in(filename);
 	if (!in.is_open())
@@ -24,7 +46,7 @@ bool Interpreter::loadFile(const std::string &filename)
 	{
 		if (!line.empty())
 		{
-			m_lines.push_back(line);
+			addLine(line);
 		}
 	}
 
@@ -34,39 +56,700 @@ bool Interpreter::loadFile(const std::string &filename)
 }
 
 
-bool Interpreter::loadLine(const std::string &line)
+template <typename V>
+bool BasicInterpreter<V>::loadLine(const std::string &line)
 {
-	m_lines.push_back(line);
+	addLine(line);
 	return true;
 }
 
 
-Interpreter::Status Interpreter::execute()
+template <typename V>
+void BasicInterpreter<V>::addLine(std::string_view line)
+{
+	stripLine(line, m_lines.emplace_back());
+	m_line_runs.push_back(0);
+	m_line_jumps.push_back(0);
+}
+
+
+// Whitespace is dropped once when a line is stored, so the lexer never has to copy it
+template <typename V>
+void BasicInterpreter<V>::stripLine(std::string_view line, std::pmr::string &stored)
+{
+	stored.clear();
+	stored.reserve(line.size());
+	for (char c : line)
+	{
+		if (!isspace(static_cast<unsigned char>(c)))
+		{
+			stored.push_back(c);
+		}
+	}
+}
+
+
+// Compares a line as read with one already stripped, without copying it
+template <typename V>
+bool BasicInterpreter<V>::sameLine(std::string_view line, std::string_view stored)
 {
-	while (m_line_index < m_lines.size())
+	size_t i = 0;
+	for (char c : line)
 	{
-		const std::string &line = m_lines.at(m_line_index);
+		if (isspace(static_cast<unsigned char>(c)))
+		{
+			continue;
+		}
 
-		const size_t index_before = m_line_index;
+		if (i == stored.size() || stored[i] != c)
+		{
+			return false;
+		}
+
+		i++;
+	}
+
+	return i == stored.size();
+}
+
+
+template <typename V>
+size_t BasicInterpreter<V>::reload(std::istream &in)
+{
+	std::vector<size_t> changed;
+
+	// Same rules as loadFile, empty lines are skipped
+	std::string line;
+	size_t index = 0;
+	while (std::getline(in, line))
+	{
+		if (line.empty())
+		{
+			continue;
+		}
+
+		if (index == m_lines.size())
+		{
+			addLine(line);
+			changed.push_back(index);
+		}
+		else if (!sameLine(line, m_lines[index]))
+		{
+			stripLine(line, m_lines[index]);
+			changed.push_back(index);
+		}
+
+		index++;
+	}
+
+	for (size_t removed = index; removed < m_lines.size(); removed++)
+	{
+		changed.push_back(removed);
+	}
+
+	m_lines.resize(index);
+	invalidate(changed);
+	return changed.size();
+}
+
+
+template <typename V>
+bool BasicInterpreter<V>::reloadFile(const std::string &filename, size_t &changed)
+{
+	std::ifstream in(filename);
+	if (!in.is_open())
+	{
+		return false;
+	}
+
+	changed = reload(in);
+	return true;
+}
+
+
+// Drops the compiled blocks a reload made stale. A block is stale when one of
+// its lines changed, when the line that ended it changed (it may compile now),
+// or when it jumps to a line that no longer exists. changed is sorted.
+template <typename V>
+void BasicInterpreter<V>::invalidate(const std::vector<size_t> &changed)
+{
+	if (changed.empty())
+	{
+		return;
+	}
+
+	m_blocks.resize(std::min(m_blocks.size(), m_lines.size()));
+	m_block_runs.resize(std::min(m_block_runs.size(), m_lines.size()));
+	m_line_runs.resize(m_lines.size(), 0);
+	m_line_jumps.resize(m_lines.size(), 0);
+	m_block_counts.resize(std::min(m_block_counts.size(), m_lines.size()));
+	m_block_ready.resize(std::min(m_block_ready.size(), m_lines.size()));
+
+	for (Block &block : m_block_storage)
+	{
+		// Blocks a previous reload dropped, or that start past the new end
+		if (block.start >= m_blocks.size() || m_blocks[block.start] != &block)
+		{
+			if (!block.code.empty())
+			{
+				block = Block(m_block_storage.get_allocator());
+			}
+
+			continue;
+		}
+
+		auto it = std::lower_bound(changed.begin(), changed.end(), block.start);
+		bool stale = it != changed.end() && *it <= block.end;
+		for (const Instruction &ins : block.code)
+		{
+			const bool jumps = ins.op == Lexer::Token::JUMP || ins.op == Lexer::Token::JUMPT ||
+				ins.op == Lexer::Token::JUMPF || ins.branch != Lexer::Token::EOL;
+			stale = stale || (jumps && ins.target >= m_lines.size());
+		}
+
+		// Blocks never move, so the old one stays in the deque, but its code is
+		// freed and shows up in getStrandedBytes()
+		if (stale)
+		{
+			m_blocks[block.start] = nullptr;
+			block = Block(m_block_storage.get_allocator());
+		}
+	}
+
+	for (size_t line : changed)
+	{
+		if (line < m_block_counts.size())
+		{
+			m_block_counts[line] = 0;
+		}
+	}
+}
+
+
+template <typename V>
+void BasicInterpreter<V>::reset()
+{
+	m_variables.clear();
+	m_arrays.clear();
+	// Nothing is left in the run arena, so the next run starts from its first chunk
+	m_run_arena.release();
+	m_cycles.reset();
+	std::fill(m_block_ready.begin(), m_block_ready.end(), uint8_t(0));
+
+	m_line_index = 0;
+	m_jumped = true;
+	m_error_info.clear();
+	m_steps = 0;
+	m_back_edges = 0;
+}
+
+
+template <typename V>
+bool BasicInterpreter<V>::loadStream(std::istream &in)
+{
+	if (!in.good())
+	{
+		return false;
+	}
+
+	m_source = &in;
+	return true;
+}
+
+
+template <typename V>
+bool BasicInterpreter<V>::fetchLine(size_t index)
+{
+	// Blocks on the source until the requested line arrives or the source ends.
+	// Empty lines are skipped the same way loadFile skips them.
+	std::string line;
+	while (index >= m_lines.size() && m_source)
+	{
+		if (!std::getline(*m_source, line))
+		{
+			m_source = nullptr;
+			break;
+		}
+
+		if (!line.empty())
+		{
+			addLine(line);
+		}
+	}
+
+	return index < m_lines.size();
+}
+
+
+template <typename V>
+bool BasicInterpreter<V>::optimize()
+{
+	if (m_source || m_variables.size())
+	{
+		return false;
+	}
+
+	Optimizer<V> optimizer(m_lines);
+	optimizer.run();
+
+	// Keeping the line (as a NOP) keeps line numbers and step counts the same
+	// A folded comparison may turn out dead afterwards, so NOPs go last
+	for (const auto &rewrite : optimizer.rewrites())
+	{
+		m_lines[rewrite.first] = rewrite.second;
+	}
+
+	for (size_t line : optimizer.deadLines())
+	{
+		m_lines[line] = "NOP";
+	}
+
+	// Only the compiled tier skips the checks, the plain interpreter runs too
+	// rarely to be worth it
+	m_unchecked.assign(m_lines.size(), 0);
+	for (size_t line : optimizer.uncheckedLines())
+	{
+		m_unchecked[line] = 1;
+	}
+
+	m_optimization = optimizer.report();
+
+	for (size_t i = 0; i < optimizer.variableCount(); i++)
+	{
+		m_variables.bind(optimizer.variableName(i), optimizer.slotOf(i));
+	}
+
+	return true;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::execute()
+{
+	const Status status = loop();
+
+	m_metrics.runs++;
+	m_metrics.results[status]++;
+	m_metrics.variables = m_variables.size();
+	collectRuns();
+
+	return status;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::loop()
+{
+	m_start_time = std::chrono::steady_clock::now();
+
+	while (fetchLine(m_line_index))
+	{
 		Status status;
+
+		// Execution counts are only kept at block entries, so straight-line code
+		// in the plain interpreter pays nothing for tiering
+		if (m_jumped && m_hot_threshold)
+		{
+			const Block *block = hotBlock(m_line_index);
+
+			// Compiled blocks always run to their end, so near the step budget the
+			// plain interpreter takes over to stop on the exact line
+			if (block && (!m_step_budget || m_steps + (block->end - block->start) <= m_step_budget))
+			{
+				m_steps += block->end - block->start;
+				if ((status = runBlock(*block)) != Status::OK)
+				{
+					return status;
+				}
+
+				if (m_jumped && m_line_index < block->end && (status = backEdge()) != Status::OK)
+				{
+					return status;
+				}
+
+				continue;
+			}
+		}
+
+		if (m_step_budget && m_steps >= m_step_budget)
+		{
+			m_error_info = std::to_string(m_step_budget);
+			return Status::STEP_BUDGET_EXCEEDED;
+		}
+
+		const std::string_view line = m_lines[m_line_index];
+		const size_t index_before = m_line_index;
+
+		m_steps++;
+		m_jumped = false;
 		if ((status = step(line)) != Status::OK)
 		{
 			return status;
 		}
 
+		m_line_runs[index_before]++;
+
 		// If the line index was altered by an instruction (JUMPs), don't increment
 		// All JUMP instructions must ensure the jump is valid, so we dont do that here
-		if (m_line_index == index_before)
+		if (!m_jumped)
 		{
 			m_line_index++;
+			continue;
+		}
+
+		m_line_jumps[index_before]++;
+		if (m_line_index <= index_before && (status = backEdge()) != Status::OK)
+		{
+			return status;
+		}
+	}
+
+	// Values left over mean this run took a different path than the recorded one
+	if (m_replay && m_replay->remaining())
+	{
+		m_error_info = std::to_string(m_replay->remaining()) + " more values in the log";
+		return Status::REPLAY_MISMATCH;
+	}
+
+	return Status::OK;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::backEdge()
+{
+	m_back_edges++;
+
+	// Reading the clock on every iteration of a tight loop would cost more than the loop
+	if (m_time_budget.count() && (m_back_edges & 255) == 0 &&
+		std::chrono::steady_clock::now() - m_start_time > m_time_budget)
+	{
+		m_error_info = std::to_string(m_time_budget.count()) + " ms";
+		return Status::TIME_BUDGET_EXCEEDED;
+	}
+
+	if (m_detect_cycles && m_cycles.check(m_line_index, m_variables, m_arrays))
+	{
+		m_error_info = std::to_string(m_line_index + 1);
+		return Status::INFINITE_LOOP;
+	}
+
+	return Status::OK;
+}
+
+
+template <typename V>
+const Block *BasicInterpreter<V>::hotBlock(size_t index)
+{
+	if (m_block_counts.size() < m_lines.size())
+	{
+		m_block_counts.resize(m_lines.size(), 0);
+		m_blocks.resize(m_lines.size());
+		m_block_ready.resize(m_lines.size(), 0);
+		m_block_runs.resize(m_lines.size(), 0);
+	}
+
+	if (const Block *block = m_blocks[index])
+	{
+		// Variables only ever get defined during a run, so one check per run is enough
+		if (m_block_ready[index] || (m_block_ready[index] = ready(*block)))
+		{
+			return block;
+		}
+
+		return nullptr;
+	}
+
+	if (++m_block_counts[index] < m_hot_threshold)
+	{
+		return nullptr;
+	}
+
+	// Block couldn't be compiled (yet), try again once it gets hot again
+	m_block_counts[index] = 0;
+
+	BlockCompiler<V> compiler(m_lines, m_variables, m_unchecked);
+	if (!compiler.compile(index, m_scratch))
+	{
+		return nullptr;
+	}
+
+	// Both use the arena, so the code is handed over without copying
+	m_block_storage.push_back(std::move(m_scratch));
+
+	m_compiled_blocks++;
+	m_unrolled_loops += m_block_storage.back().iterations != 0;
+	m_blocks[index] = &m_block_storage.back();
+	m_block_ready[index] = 1;
+	return m_blocks[index];
+}
+
+
+template <typename V>
+void BasicInterpreter<V>::retire(const Instruction &ins, uint64_t count)
+{
+	m_metrics.retired[ins.op] += count;
+
+	// A fused compare + branch stands for two lines
+	if (ins.branch != Lexer::Token::EOL)
+	{
+		m_metrics.retired[ins.branch] += count;
+	}
+}
+
+
+// Moves the per line and per block run counts into the per opcode ones. Runs
+// only ever count, so nothing but an increment is paid while executing.
+template <typename V>
+void BasicInterpreter<V>::collectRuns()
+{
+	for (size_t i = 0; i < m_line_runs.size(); i++)
+	{
+		if (!m_line_runs[i])
+		{
+			continue;
+		}
+
+		// Lines that were executed lexed fine, empty ones are NOPs
+		Lexer p(m_lines[i]);
+		const Lexer::Token t = p.next();
+		m_metrics.retired[t == Lexer::Token::EOL ? Lexer::Token::NOP : t] += m_line_runs[i];
+
+		if (t == Lexer::Token::JUMPT || t == Lexer::Token::JUMPF)
+		{
+			m_metrics.branches_taken += m_line_jumps[i];
+			m_metrics.branches_not_taken += m_line_runs[i] - m_line_jumps[i];
+		}
+
+		m_line_runs[i] = 0;
+		m_line_jumps[i] = 0;
+	}
+
+	for (size_t i = 0; i < m_block_runs.size(); i++)
+	{
+		if (!m_block_runs[i])
+		{
+			continue;
+		}
+
+		for (const Instruction &ins : m_blocks[i]->code)
+		{
+			retire(ins, m_block_runs[i]);
+		}
+
+		m_block_runs[i] = 0;
+	}
+}
+
+
+// After a reset the variables a block was compiled against may not exist yet,
+// the plain interpreter runs those lines until they do
+template <typename V>
+bool BasicInterpreter<V>::ready(const Block &block) const
+{
+	for (size_t slot : block.reads)
+	{
+		if (!m_variables.defined(slot))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::runBlock(const Block &block)
+{
+	// Slots can't be added while a block runs, so the pointers stay valid
+	T *v = m_variables.values();
+	uint8_t *defined = m_variables.definedFlags();
+
+	// Arithmetic the optimizer proved can't overflow skips the check
+	typedef WrappingValue<T> Unchecked;
+
+	// Immediates were converted to T when the block was compiled
+	auto value = [v](const Operand &op) -> T {
+		return op.kind == Operand::Kind::SLOT ? v[op.value] : static_cast<T>(op.value);
+	};
+
+	auto store = [v, defined](const Operand &op, T result) {
+		v[op.value] = result;
+		defined[op.value] = 1;
+	};
+
+	// A branch always ends the block, so falling through continues right after it
+	auto branch = [this, &block](Lexer::Token kind, const Instruction &ins, T condition) -> Status {
+		if ((kind == Lexer::Token::JUMPT) == (condition != 0))
+		{
+			m_line_index = ins.target;
+			m_metrics.branches_taken++;
+		}
+		else
+		{
+			m_line_index = block.end;
+			m_metrics.branches_not_taken++;
+		}
+
+		m_jumped = true;
+		return Status::OK;
+	};
+
+	// Unrolled loops do several iterations in one go when the guard allows it.
+	// The extra iterations are counted as steps and block runs like any other.
+	size_t iterations = 1;
+	const size_t length = block.end - block.start;
+	if (block.iterations && !m_detect_cycles && (!m_step_budget || m_steps + (block.iterations - 1) * length <= m_step_budget) &&
+		LoopOptimizer<V>::guard(block, v))
+	{
+		iterations = block.iterations;
+		m_steps += (iterations - 1) * length;
+		m_metrics.branches_taken += iterations - 1;
+	}
+
+	const std::pmr::vector<Instruction> &code = iterations > 1 ? block.unrolled : block.code;
+
+	// Instructions are counted per block run (see collectRuns), a run that stops
+	// with an error only retired the ones before the failing instruction. Steps
+	// were added for the whole run up front and get the same correction.
+	m_block_runs[block.start] += iterations;
+	auto fail = [this, &block, &code, &store, iterations, length](const Instruction &failed, Status status) -> Status {
+		// Every copy of the body starts over at the first line
+		size_t done = 0;
+		for (const Instruction *ins = code.data() + 1; ins <= &failed; ins++)
+		{
+			done += ins->line <= ins[-1].line;
+		}
+
+		// Copies that left out the exit test didn't store its result either, it looped back every time
+		const Instruction &exit = block.code.back();
+		if (done && exit.branch != Lexer::Token::EOL)
+		{
+			store(exit.dst, exit.branch == Lexer::Token::JUMPT ? 1 : 0);
+		}
+
+		m_steps -= (iterations - done) * length - (failed.line - block.start + 1);
+		m_block_runs[block.start] -= iterations - done;
+		m_metrics.branches_taken -= iterations - 1 - done;
+		for (const Instruction &ins : block.code)
+		{
+			if (ins.line >= failed.line)
+			{
+				break;
+			}
+
+			retire(ins, 1);
+		}
+
+		return status;
+	};
+
+	for (const Instruction &ins : code)
+	{
+		T result;
+		bool ok = true;
+		switch (ins.op)
+		{
+		case Lexer::Token::NOP: continue;
+
+		case Lexer::Token::JUMP:
+			{
+				m_line_index = ins.target;
+				m_jumped = true;
+				return Status::OK;
+			}
+		case Lexer::Token::READ:
+			{
+				// Session logs record the line of every value
+				m_line_index = ins.line;
+
+				// Slots can be shared after optimization, so the name comes from the line
+				Lexer p(m_lines[ins.line]);
+				p.next();
+				p.next();
+
+				Status status;
+				if ((status = readValue(p.str(), result)) != Status::OK)
+				{
+					return fail(ins, status);
+				}
+
+				store(ins.dst, result);
+				continue;
+			}
+		case Lexer::Token::WRITE:
+			{
+				m_line_index = ins.line;
+
+				Lexer p(m_lines[ins.line]);
+				p.next();
+				p.next();
+
+				Status status;
+				if ((status = writeValue(p.str(), value(ins.a))) != Status::OK)
+				{
+					return fail(ins, status);
+				}
+
+				continue;
+			}
+
+		case Lexer::Token::ASSIGN: store(ins.dst, value(ins.a)); continue;
+		case Lexer::Token::JUMPT:
+		case Lexer::Token::JUMPF: return branch(ins.op, ins, value(ins.a));
+
+		// V::checked is a constant, the wrapping value types never look at the flag
+		case Lexer::Token::ADD:
+			ok = V::checked && ins.unchecked ? Unchecked::add(value(ins.a), value(ins.b), result) : V::add(value(ins.a), value(ins.b), result);
+			break;
+		case Lexer::Token::SUB:
+			ok = V::checked && ins.unchecked ? Unchecked::sub(value(ins.a), value(ins.b), result) : V::sub(value(ins.a), value(ins.b), result);
+			break;
+		case Lexer::Token::MULTIPLY:
+			if (ins.reduced)
+			{
+				ok = V::checked && ins.unchecked ? Unchecked::add(v[ins.dst.value], static_cast<T>(ins.increment), result) :
+					V::add(v[ins.dst.value], static_cast<T>(ins.increment), result);
+				break;
+			}
+			ok = V::checked && ins.unchecked ? Unchecked::mul(value(ins.a), value(ins.b), result) : V::mul(value(ins.a), value(ins.b), result);
+			break;
+		case Lexer::Token::LT: result = value(ins.a) < value(ins.b); break;
+		case Lexer::Token::GT: result = value(ins.a) > value(ins.b); break;
+		case Lexer::Token::LTE: result = value(ins.a) <= value(ins.b); break;
+		case Lexer::Token::GTE: result = value(ins.a) >= value(ins.b); break;
+		case Lexer::Token::EQ: result = value(ins.a) == value(ins.b); break;
+
+		default: continue;
+		}
+
+		// Always true for the wrapping value types, so it compiles away there
+		if (!ok)
+		{
+			m_line_index = ins.line;
+			return fail(ins, overflow(value(ins.a), ins.op, value(ins.b)));
+		}
+
+		store(ins.dst, result);
+
+		// Fused compare + branch superinstruction
+		if (ins.branch != Lexer::Token::EOL)
+		{
+			return branch(ins.branch, ins, result);
 		}
 	}
 
+	// Block ended right before a line that has to go through the plain interpreter,
+	// or right before a loop, whose block is looked up as if it was jumped to
+	m_line_index = block.end;
+	m_jumped = block.before_loop;
 	return Status::OK;
 }
 
 
-Interpreter::Status Interpreter::step(const std::string &line)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::step(std::string_view line)
 {
 	Lexer p(line);
 
@@ -87,11 +770,16 @@ Interpreter::Status Interpreter::step(const std::string &line)
 	case Lexer::Token::JUMP: status = ins_jump(p); break;
 	case Lexer::Token::READ: status = ins_read(p); break;
 	case Lexer::Token::WRITE: status = ins_write(p); break;
+	case Lexer::Token::READA: status = ins_reada(p); break;
+	case Lexer::Token::WRITEA: status = ins_writea(p); break;
 
 	// 2 operators
 	case Lexer::Token::ASSIGN: status = ins_assign(p); break;
 	case Lexer::Token::JUMPT: status = ins_jumpt(p); break;
 	case Lexer::Token::JUMPF: status = ins_jumpf(p); break;
+	case Lexer::Token::ARRAY: status = ins_array(p); break;
+	case Lexer::Token::FILL: status = ins_fill(p); break;
+	case Lexer::Token::SUM: status = ins_sum(p); break;
 
 	// 3 operators
 	case Lexer::Token::ADD: status = ins_add(p); break;
@@ -102,6 +790,15 @@ Interpreter::Status Interpreter::step(const std::string &line)
 	case Lexer::Token::LTE: status = ins_lte(p); break;
 	case Lexer::Token::GTE: status = ins_gte(p); break;
 	case Lexer::Token::EQ: status = ins_eq(p); break;
+	case Lexer::Token::GET: status = ins_get(p); break;
+	case Lexer::Token::SET: status = ins_set(p); break;
+	case Lexer::Token::VADD:
+	case Lexer::Token::VMUL:
+	case Lexer::Token::VLT:
+	case Lexer::Token::VGT:
+	case Lexer::Token::VLTE:
+	case Lexer::Token::VGTE:
+	case Lexer::Token::VEQ: status = ins_vector(p, t); break;
 
 	default:
 		{
@@ -114,14 +811,16 @@ Interpreter::Status Interpreter::step(const std::string &line)
 }
 
 
-Interpreter::Status Interpreter::ins_nop(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_nop(Lexer &p)
 {
 	// Literally do nothing
 	return Status::OK;
 }
 
 
-Interpreter::Status Interpreter::ins_jump(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_jump(Lexer &p)
 {
 	if (!expect(p, Lexer::Token::NUMBER))
 	{
@@ -132,77 +831,72 @@ Interpreter::Status Interpreter::ins_jump(Lexer &p)
 }
 
 
-Interpreter::Status Interpreter::ins_read(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_read(Lexer &p)
 {
 	if (!expect(p, Lexer::Token::VARIABLE))
 	{
 		return Status::INVALID_OPERATOR;
 	}
 
-	int value;
-	bool valid = false;
-
-	do {
-		std::cout << "Enter value for variable \"" << p.str() << "\": ";
-		std::cin >> value;
-
-		if (!(valid = std::cin.good()))
-		{
-			std::cout << "Invalid input\n";
-			std::cin.clear();
-			std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-		}
-	} while (!valid);
+	T value;
+	Status status;
+	if ((status = readValue(p.str(), value)) != Status::OK)
+	{
+		return status;
+	}
 
-	m_variables[p.str()] = value;
+	m_variables.set(p.str(), value);
 	return Status::OK;
 }
 
 
-Interpreter::Status Interpreter::ins_write(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_write(Lexer &p)
 {
 	if (!expect(p, Lexer::Token::VARIABLE))
 	{
 		return Status::INVALID_OPERATOR;
 	}
 
-	int value;
+	T value;
 	if (!getVar(p.str(), value))
 	{
 		return Status::VARIABLE_DOESNT_EXIST;
 	}
 
-	std::cout << "Value of variable \"" << p.str() << "\": " << value << "\n";
-	return Status::OK;
+	return writeValue(p.str(), value);
 }
 
 
-Interpreter::Status Interpreter::ins_assign(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_assign(Lexer &p)
 {
 	if (!expect(p, Lexer::Token::VARIABLE))
 	{
 		return Status::INVALID_OPERATOR;
 	}
 
-	// Cant use ref here as it might disappear later
-	std::string var = p.str();
+	// Tokens point into the line, so this stays valid after the lexer moves on
+	std::string_view var = p.str();
 
-	int value;
+	T value;
 	Status status;
 	if ((status = getValue(p, value)) != Status::OK)
 	{
 		return status;
 	}
 
-	m_variables[var] = value;
+	m_variables.set(var, value);
 
 	return Status::OK;
 }
 
 
-Interpreter::Status Interpreter::ins_jumpt(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_jumpt(Lexer &p)
 {
-	int value;
+	T value;
 	Status status;
 	if ((status = getValue(p, value)) != Status::OK)
 	{
@@ -224,9 +918,10 @@ Interpreter::Status Interpreter::ins_jumpt(Lexer &p)
 }
 
 
-Interpreter::Status Interpreter::ins_jumpf(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_jumpf(Lexer &p)
 {
-	int value;
+	T value;
 	Status status;
 	if ((status = getValue(p, value)) != Status::OK)
 	{
@@ -248,9 +943,10 @@ Interpreter::Status Interpreter::ins_jumpf(Lexer &p)
 }
 
 
-Interpreter::Status Interpreter::ins_add(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_add(Lexer &p)
 {
-	int v1, v2;
+	T v1, v2;
 	Status status;
 	
 	if ((status = getValue(p, v1)) != Status::OK)
@@ -268,15 +964,22 @@ Interpreter::Status Interpreter::ins_add(Lexer &p)
 		return Status::INVALID_OPERATOR;
 	}
 
-	m_variables[p.str()] = v1 + v2;
+	T result;
+	if (!V::add(v1, v2, result))
+	{
+		return overflow(v1, Lexer::Token::ADD, v2);
+	}
+
+	m_variables.set(p.str(), result);
 
 	return Status::OK;
 }
 
 
-Interpreter::Status Interpreter::ins_sub(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_sub(Lexer &p)
 {
-	int v1, v2;
+	T v1, v2;
 	Status status;
 
 	if ((status = getValue(p, v1)) != Status::OK)
@@ -294,15 +997,22 @@ Interpreter::Status Interpreter::ins_sub(Lexer &p)
 		return Status::INVALID_OPERATOR;
 	}
 
-	m_variables[p.str()] = v1 - v2;
+	T result;
+	if (!V::sub(v1, v2, result))
+	{
+		return overflow(v1, Lexer::Token::SUB, v2);
+	}
+
+	m_variables.set(p.str(), result);
 
 	return Status::OK;
 }
 
 
-Interpreter::Status Interpreter::ins_multiply(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_multiply(Lexer &p)
 {
-	int v1, v2;
+	T v1, v2;
 	Status status;
 
 	if ((status = getValue(p, v1)) != Status::OK)
@@ -320,15 +1030,22 @@ Interpreter::Status Interpreter::ins_multiply(Lexer &p)
 		return Status::INVALID_OPERATOR;
 	}
 
-	m_variables[p.str()] = v1 * v2;
+	T result;
+	if (!V::mul(v1, v2, result))
+	{
+		return overflow(v1, Lexer::Token::MULTIPLY, v2);
+	}
+
+	m_variables.set(p.str(), result);
 
 	return Status::OK;
 }
 
 
-Interpreter::Status Interpreter::ins_lt(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_lt(Lexer &p)
 {
-	int v1, v2;
+	T v1, v2;
 	Status status;
 
 	if ((status = getValue(p, v1)) != Status::OK)
@@ -346,15 +1063,16 @@ Interpreter::Status Interpreter::ins_lt(Lexer &p)
 		return Status::INVALID_OPERATOR;
 	}
 
-	m_variables[p.str()] = v1 < v2;
+	m_variables.set(p.str(), v1 < v2);
 
 	return Status::OK;
 }
 
 
-Interpreter::Status Interpreter::ins_gt(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_gt(Lexer &p)
 {
-	int v1, v2;
+	T v1, v2;
 	Status status;
 
 	if ((status = getValue(p, v1)) != Status::OK)
@@ -372,15 +1090,16 @@ Interpreter::Status Interpreter::ins_gt(Lexer &p)
 		return Status::INVALID_OPERATOR;
 	}
 
-	m_variables[p.str()] = v1 > v2;
+	m_variables.set(p.str(), v1 > v2);
 
 	return Status::OK;
 }
 
 
-Interpreter::Status Interpreter::ins_lte(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_lte(Lexer &p)
 {
-	int v1, v2;
+	T v1, v2;
 	Status status;
 
 	if ((status = getValue(p, v1)) != Status::OK)
@@ -398,15 +1117,16 @@ Interpreter::Status Interpreter::ins_lte(Lexer &p)
 		return Status::INVALID_OPERATOR;
 	}
 
-	m_variables[p.str()] = v1 <= v2;
+	m_variables.set(p.str(), v1 <= v2);
 
 	return Status::OK;
 }
 
 
-Interpreter::Status Interpreter::ins_gte(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_gte(Lexer &p)
 {
-	int v1, v2;
+	T v1, v2;
 	Status status;
 
 	if ((status = getValue(p, v1)) != Status::OK)
@@ -424,15 +1144,16 @@ Interpreter::Status Interpreter::ins_gte(Lexer &p)
 		return Status::INVALID_OPERATOR;
 	}
 
-	m_variables[p.str()] = v1 >= v2;
+	m_variables.set(p.str(), v1 >= v2);
 
 	return Status::OK;
 }
 
 
-Interpreter::Status Interpreter::ins_eq(Lexer &p)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_eq(Lexer &p)
 {
-	int v1, v2;
+	T v1, v2;
 	Status status;
 
 	if ((status = getValue(p, v1)) != Status::OK)
@@ -450,19 +1171,243 @@ Interpreter::Status Interpreter::ins_eq(Lexer &p)
 		return Status::INVALID_OPERATOR;
 	}
 
-	m_variables[p.str()] = v1 == v2;
+	m_variables.set(p.str(), v1 == v2);
+
+	return Status::OK;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_reada(Lexer &p)
+{
+	Array *array;
+	Status status;
+	if ((status = getArray(p, array)) != Status::OK)
+	{
+		return status;
+	}
+
+	for (size_t i = 0; i < array->size(); i++)
+	{
+		if ((status = readValue(std::string(p.str()) + "[" + std::to_string(i) + "]", (*array)[i])) != Status::OK)
+		{
+			return status;
+		}
+	}
+
+	return Status::OK;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_writea(Lexer &p)
+{
+	Array *array;
+	Status status;
+	if ((status = getArray(p, array)) != Status::OK)
+	{
+		return status;
+	}
+
+	for (T &value : *array)
+	{
+		if ((status = logValue(SessionLog::WRITE, value)) != Status::OK)
+		{
+			return status;
+		}
+	}
+
+	*m_out << "Value of variable \"" << p.str() << "\": [";
+	for (size_t i = 0; i < array->size(); i++)
+	{
+		*m_out << (i ? ", " : "") << (*array)[i];
+	}
+
+	*m_out << "]\n";
+	return Status::OK;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_array(Lexer &p)
+{
+	if (!expect(p, Lexer::Token::VARIABLE))
+	{
+		return Status::INVALID_OPERATOR;
+	}
+
+	std::string_view name = p.str();
+
+	T size;
+	Status status;
+	if ((status = getValue(p, size)) != Status::OK)
+	{
+		return status;
+	}
+
+	if (size < 0 || static_cast<unsigned long long>(size) > max_array_length)
+	{
+		m_error_info = std::string(name) + "[" + std::to_string(size) + "]";
+		return Status::INVALID_INDEX;
+	}
+
+	// Redeclaring an array starts it over
+	arrayFor(name).assign(static_cast<size_t>(size), 0);
+	return Status::OK;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_fill(Lexer &p)
+{
+	Array *array;
+	T value;
+	Status status;
+	if ((status = getArray(p, array)) != Status::OK || (status = getValue(p, value)) != Status::OK)
+	{
+		return status;
+	}
+
+	ArrayKernels<V>::fill(array->data(), array->size(), value);
+	return Status::OK;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_sum(Lexer &p)
+{
+	Array *array;
+	Status status;
+	if ((status = getArray(p, array)) != Status::OK)
+	{
+		return status;
+	}
+
+	std::string_view name = p.str();
+
+	if (!expect(p, Lexer::Token::VARIABLE))
+	{
+		return Status::INVALID_OPERATOR;
+	}
+
+	T result;
+	if (!ArrayKernels<V>::sum(array->data(), array->size(), result))
+	{
+		m_error_info = "sum of " + std::string(name);
+		return Status::ARITHMETIC_OVERFLOW;
+	}
+
+	m_variables.set(p.str(), result);
+	return Status::OK;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_get(Lexer &p)
+{
+	Array *array;
+	size_t index;
+	Status status;
+	if ((status = getArray(p, array)) != Status::OK || (status = getIndex(p, *array, index)) != Status::OK)
+	{
+		return status;
+	}
+
+	if (!expect(p, Lexer::Token::VARIABLE))
+	{
+		return Status::INVALID_OPERATOR;
+	}
+
+	m_variables.set(p.str(), (*array)[index]);
+	return Status::OK;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_set(Lexer &p)
+{
+	Array *array;
+	size_t index;
+	T value;
+	Status status;
+	if ((status = getArray(p, array)) != Status::OK || (status = getIndex(p, *array, index)) != Status::OK ||
+		(status = getValue(p, value)) != Status::OK)
+	{
+		return status;
+	}
+
+	(*array)[index] = value;
+	return Status::OK;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::ins_vector(Lexer &p, Lexer::Token op)
+{
+	Array *a, *b;
+	Status status;
+	if ((status = getArray(p, a)) != Status::OK)
+	{
+		return status;
+	}
+
+	std::string_view a_name = p.str();
+
+	if ((status = getArray(p, b)) != Status::OK)
+	{
+		return status;
+	}
+
+	if (a->size() != b->size())
+	{
+		m_error_info = std::string(a_name) + ", " + std::string(p.str());
+		return Status::ARRAY_SIZE_MISMATCH;
+	}
+
+	std::string_view b_name = p.str();
+
+	if (!expect(p, Lexer::Token::VARIABLE))
+	{
+		return Status::INVALID_OPERATOR;
+	}
+
+	// Result is created (or resized) like a scalar assignment would, map nodes don't
+	// move so a and b stay valid
+	Array &r = arrayFor(p.str());
+	r.resize(a->size());
+
+	bool ok = true;
+	switch (op)
+	{
+	case Lexer::Token::VADD: ok = ArrayKernels<V>::add(a->data(), b->data(), r.data(), r.size()); break;
+	case Lexer::Token::VMUL: ok = ArrayKernels<V>::mul(a->data(), b->data(), r.data(), r.size()); break;
+	case Lexer::Token::VLT: ArrayKernels<V>::compare(Lexer::Token::LT, a->data(), b->data(), r.data(), r.size()); break;
+	case Lexer::Token::VGT: ArrayKernels<V>::compare(Lexer::Token::GT, a->data(), b->data(), r.data(), r.size()); break;
+	case Lexer::Token::VLTE: ArrayKernels<V>::compare(Lexer::Token::LTE, a->data(), b->data(), r.data(), r.size()); break;
+	case Lexer::Token::VGTE: ArrayKernels<V>::compare(Lexer::Token::GTE, a->data(), b->data(), r.data(), r.size()); break;
+	case Lexer::Token::VEQ: ArrayKernels<V>::compare(Lexer::Token::EQ, a->data(), b->data(), r.data(), r.size()); break;
+	default: break;
+	}
+
+	if (!ok)
+	{
+		m_error_info = std::string(a_name) + " " + Lexer::token_to_str(op) + " " + std::string(b_name);
+		return Status::ARITHMETIC_OVERFLOW;
+	}
 
 	return Status::OK;
 }
 
 
-bool Interpreter::expect(Lexer &p, Lexer::Token t) const
+template <typename V>
+bool BasicInterpreter<V>::expect(Lexer &p, Lexer::Token t)
 {
 	Lexer::Token got = p.next();
 	if (got != t)
 	{
-		std::cerr << "Line: " << getLineNumber() << ", expected: " << p.token_to_str(t) << ", got: " << p.token_to_str(got)
-			<< " = " << (got == Lexer::Token::NUMBER ? std::to_string(p.num()) : p.str()) << "\n";
+		// Goes back with the status, the caller may not own this process's stderr (the daemon)
+		m_error_info = "expected: " + std::string(p.token_to_str(t)) + ", got: " + p.token_to_str(got) +
+			" = " + (got == Lexer::Token::NUMBER ? std::to_string(p.num()) : std::string(p.str()));
 		return false;
 	}
 
@@ -470,20 +1415,24 @@ bool Interpreter::expect(Lexer &p, Lexer::Token t) const
 }
 
 
-Interpreter::Status Interpreter::jump(int value)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::jump(long long value)
 {
-	if (value <= 0 || value - 1 >= m_lines.size())
+	// The target may not have arrived yet when streaming, so wait for it
+	if (value <= 0 || !fetchLine(value - 1))
 	{
 		m_error_info = std::to_string(value);
 		return Status::INVALID_JUMP;
 	}
 
 	m_line_index = value - 1;
+	m_jumped = true;
 	return Status::OK;
 }
 
 
-Interpreter::Status Interpreter::getValue(Lexer &p, int &value)
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::getValue(Lexer &p, T &value)
 {
 	Lexer::Token t = p.next();
 	if (t == Lexer::Token::VARIABLE)
@@ -495,26 +1444,189 @@ Interpreter::Status Interpreter::getValue(Lexer &p, int &value)
 	}
 	else if (t == Lexer::Token::NUMBER)
 	{
-		value = p.num();
+		if (!V::fromLiteral(p.num(), value))
+		{
+			m_error_info = std::to_string(p.num());
+			return Status::ARITHMETIC_OVERFLOW;
+		}
 	}
 	else
 	{
-		std::cerr << "Line: " << getLineNumber() << ", expected " << p.token_to_str(Lexer::Token::VARIABLE)
-			<< " or " << p.token_to_str(Lexer::Token::NUMBER) << ", got: " << p.token_to_str(t) << " = \"" << p.str() << "\"\n";
+		m_error_info = "expected " + std::string(p.token_to_str(Lexer::Token::VARIABLE)) + " or " + p.token_to_str(Lexer::Token::NUMBER) +
+			", got: " + p.token_to_str(t) + " = \"" + std::string(p.str()) + "\"";
+
+		return Status::INVALID_OPERATOR;
+	}
+
+	return Status::OK;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::overflow(T v1, Lexer::Token op, T v2)
+{
+	m_error_info = std::to_string(v1) + " " + Lexer::token_to_str(op) + " " + std::to_string(v2);
+	return Status::ARITHMETIC_OVERFLOW;
+}
 
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::getArray(Lexer &p, Array *&array)
+{
+	if (!expect(p, Lexer::Token::VARIABLE))
+	{
 		return Status::INVALID_OPERATOR;
 	}
 
+	auto it = m_arrays.find(p.str());
+	if (it == m_arrays.end())
+	{
+		m_error_info = p.str();
+		return Status::VARIABLE_DOESNT_EXIST;
+	}
+
+	array = &it->second;
+	return Status::OK;
+}
+
+
+template <typename V>
+typename BasicInterpreter<V>::Array &BasicInterpreter<V>::arrayFor(std::string_view name)
+{
+	auto it = m_arrays.find(name);
+	if (it == m_arrays.end())
+	{
+		it = m_arrays.emplace(name, Array()).first;
+	}
+
+	return it->second;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::getIndex(Lexer &p, const Array &array, size_t &index)
+{
+	// Name of the array is still the current token
+	std::string_view name = p.str();
+
+	T value;
+	Status status;
+	if ((status = getValue(p, value)) != Status::OK)
+	{
+		return status;
+	}
+
+	if (value < 0 || static_cast<unsigned long long>(value) >= array.size())
+	{
+		m_error_info = std::string(name) + "[" + std::to_string(value) + "]";
+		return Status::INVALID_INDEX;
+	}
+
+	index = static_cast<size_t>(value);
+	return Status::OK;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::readValue(std::string_view varname, T &value)
+{
+	bool valid = false;
+
+	// Whatever gets read makes the state depend on more than the program itself
+	m_cycles.reset();
+
+	if (m_replay)
+	{
+		return logValue(SessionLog::READ, value);
+	}
+
+	do {
+		*m_out << "Enter value for variable \"" << varname << "\": ";
+		*m_in >> value;
+
+		if (m_in->fail() && m_in->eof())
+		{
+			m_error_info = varname;
+			return Status::END_OF_INPUT;
+		}
+
+		if (!(valid = !m_in->fail()))
+		{
+			*m_out << "Invalid input\n";
+			m_in->clear();
+			m_in->ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+		}
+	} while (!valid);
+
+	return logValue(SessionLog::READ, value);
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::writeValue(std::string_view varname, T value)
+{
+	Status status;
+	if ((status = logValue(SessionLog::WRITE, value)) != Status::OK)
+	{
+		return status;
+	}
+
+	*m_out << "Value of variable \"" << varname << "\": " << value << "\n";
+	return Status::OK;
+}
+
+
+template <typename V>
+InterpreterBase::Status BasicInterpreter<V>::logValue(SessionLog::Kind kind, T &value)
+{
+	const size_t line = m_line_index + 1;
+
+	if (m_replay)
+	{
+		const SessionLog::Entry *entry = m_replay->next();
+		if (!entry || entry->kind != kind || entry->line != line ||
+			(kind == SessionLog::WRITE && entry->value != static_cast<int64_t>(value)))
+		{
+			std::ostringstream info;
+			info << "got " << SessionLog::kindName(kind);
+			if (kind == SessionLog::WRITE)
+			{
+				info << " " << value;
+			}
+
+			if (entry)
+			{
+				info << ", log has " << SessionLog::kindName(entry->kind) << " " << entry->value << " on line " << entry->line;
+			}
+			else
+			{
+				info << ", log has ended";
+			}
+
+			m_error_info = info.str();
+			return Status::REPLAY_MISMATCH;
+		}
+
+		if (kind == SessionLog::READ)
+		{
+			value = static_cast<T>(entry->value);
+		}
+	}
+
+	if (m_recording)
+	{
+		m_recording->append(kind, line, static_cast<int64_t>(value));
+	}
+
 	return Status::OK;
 }
 
 
-bool Interpreter::getVar(const std::string &varname, int &value)
+template <typename V>
+bool BasicInterpreter<V>::getVar(std::string_view varname, T &value)
 {
-	auto var = m_variables.find(varname);
-	if (var != m_variables.end())
+	if (m_variables.get(varname, value))
 	{
-		value = var->second;
 		return true;
 	}
 	else
@@ -522,4 +1634,23 @@ bool Interpreter::getVar(const std::string &varname, int &value)
 		m_error_info = varname;
 		return false;
 	}
-}
\ No newline at end of file
+}
+
+
+template <typename V>
+bool BasicInterpreter<V>::getArray(std::string_view name, std::vector<T> &values) const
+{
+	auto it = m_arrays.find(name);
+	if (it == m_arrays.end())
+	{
+		return false;
+	}
+
+	values.assign(it->second.begin(), it->second.end());
+	return true;
+}
+
+
+template class BasicInterpreter<Int32Value>;
+template class BasicInterpreter<Int64Value>;
+template class BasicInterpreter<CheckedInt64Value>;
\ No newline at end of file
@@ -1,13 +1,26 @@
 #pragma once
 
 #include "lexer.hpp"
+#include "variables.hpp"
+#include "instruction.hpp"
+#include "valuetypes.hpp"
+#include "cycledetector.hpp"
+#include "sessionlog.hpp"
+#include "arena.hpp"
+#include "optimizer.hpp"
+#include "metrics.hpp"
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
+#include <deque>
+#include <iostream>
+#include <chrono>
 
 
-class Interpreter
+// Shared by all value types so callers can handle the result without knowing
+// which interpreter produced it
+class InterpreterBase
 {
 public:
 	enum Status
@@ -16,27 +29,183 @@ public:
 		INVALID_INSTRUCTION,
 		INVALID_OPERATOR,
 		VARIABLE_DOESNT_EXIST,
-		INVALID_JUMP
+		INVALID_JUMP,
+		END_OF_INPUT,
+		ARITHMETIC_OVERFLOW,
+		INVALID_INDEX,
+		ARRAY_SIZE_MISMATCH,
+		STEP_BUDGET_EXCEEDED,
+		TIME_BUDGET_EXCEEDED,
+		INFINITE_LOOP,
+		REPLAY_MISMATCH,
+		INTERNAL_ERROR
 	};
 
-	explicit Interpreter();
+	// Longest array ARRAY may declare, bigger sizes fail like negative ones
+	static const size_t max_array_length = size_t(1) << 24;
+};
+
+
+// Interpreter over values described by V (see valuetypes.hpp). Every value type
+// is a separate instantiation, so the arithmetic is resolved at compile time.
+template <typename V>
+class BasicInterpreter : public InterpreterBase
+{
+public:
+	typedef typename V::type T;
+	typedef std::pmr::vector<T> Array;
+
+	explicit BasicInterpreter();
+
+	BasicInterpreter(const BasicInterpreter &) = delete;
+	BasicInterpreter &operator=(const BasicInterpreter &) = delete;
 
 	bool loadFile(const std::string &filename);
 	bool loadLine(const std::string &line);
+
+	// Lines are pulled from the stream only when execution (or a jump) reaches them,
+	// so a program can start running before it has fully arrived
+	bool loadStream(std::istream &in);
+
+	// Watch mode: replaces the program with what the stream or file holds now.
+	// Only lines that differ are replaced, and compiled blocks stay unless they
+	// cover one of them or jump past the new end. Returns the number of lines
+	// that changed, were added or were removed. Doesn't work on optimized
+	// programs, their variables may share slots the new program can't use.
+	size_t reload(std::istream &in);
+	bool reloadFile(const std::string &filename, size_t &changed);
+
+	// Forgets variables, arrays and the position, so the program can be
+	// executed again. Compiled blocks are kept, the arrays' memory is released.
+	void reset();
+
+	void setInput(std::istream &in) { m_in = &in; }
+	void setOutput(std::ostream &out) { m_out = &out; }
+
+	// Runs the whole-program optimizations from optimizer.hpp. Has to be called
+	// after loading and before execute, streamed programs can't be optimized.
+	bool optimize();
+	const OptimizationReport &getOptimizationReport() const { return m_optimization; }
+
 	Status execute();
 
+	// Number of times a block has to be entered before it is compiled, 0 keeps
+	// everything in the plain interpreter
+	void setHotThreshold(size_t threshold) { m_hot_threshold = threshold; }
+	size_t getCompiledBlockCount() const { return m_compiled_blocks; }
+	// Compiled blocks that are loops with an unrolled version, see loopoptimizer.hpp
+	size_t getUnrolledLoopCount() const { return m_unrolled_loops; }
+
+	// Limits on how long a program may run, 0 means unlimited. Steps are executed
+	// lines, wall time is only checked on backward jumps (every loop has one).
+	void setStepBudget(size_t steps) { m_step_budget = steps; }
+	void setTimeBudget(std::chrono::milliseconds time) { m_time_budget = time; }
+
+	// Stops programs that return to a state they have already been in
+	void setCycleDetection(bool enabled) { m_detect_cycles = enabled; }
+
+	size_t getStepCount() const { return m_steps; }
+
+	// Every READ and WRITE value gets appended to the log
+	void setRecording(SessionLog *log) { m_recording = log; }
+	// READ takes its values from the log instead of the input, and WRITE must
+	// produce exactly what was recorded (same line, same value)
+	void setReplay(SessionLog *log) { m_replay = log; }
+
 	const std::string &getErrorInfo() const { return m_error_info; }
 	size_t getLineNumber() const { return m_line_index + 1; }
 
+	// Counters over every execute so far, see metrics.hpp
+	const Metrics &getMetrics() const { return m_metrics; }
+	// For callers that merge the counters elsewhere after every run
+	void clearMetrics() { m_metrics = Metrics(); }
+
+	// Allocations made for this interpreter's state so far, see arena.hpp.
+	// Arrays only count since the last reset.
+	size_t getAllocationCount() const { return m_arena.allocations() + m_run_arena.allocations(); }
+	size_t getAllocatedBytes() const { return m_arena.bytes() + m_run_arena.bytes(); }
+	// Freed lines and blocks the arena can't reuse, reloads leave them behind.
+	// Once there are many of them, loading the program again is cheaper.
+	size_t getStrandedBytes() const { return m_arena.stranded(); }
+
 private:
-	std::vector<std::string> m_lines;
+	// Have to be the first members, everything below allocates from them.
+	// Arrays use the second one, reset() releases it.
+	Arena m_arena;
+	Arena m_run_arena;
+
+	ProgramLines m_lines;
+	std::istream *m_source{ nullptr };
+
+	std::istream *m_in{ &std::cin };
+	std::ostream *m_out{ &std::cout };
 
 	std::string m_error_info;
 	size_t m_line_index{ 0 };
 
-	std::map<std::string, int> m_variables;
-
-	Status step(const std::string &line);
+	// Set whenever control didn't just fall through to the next line, which is
+	// exactly when a new basic block starts
+	bool m_jumped{ true };
+
+	Variables<T> m_variables;
+
+	ArrayMap<T> m_arrays;
+
+	static const size_t default_hot_threshold = 50;
+	size_t m_hot_threshold{ default_hot_threshold };
+	size_t m_compiled_blocks{ 0 };
+	size_t m_unrolled_loops{ 0 };
+	std::pmr::vector<size_t> m_block_counts;
+	std::pmr::vector<const Block *> m_blocks;
+
+	// Compiled blocks never move, failed attempts reuse the scratch block
+	std::pmr::deque<Block> m_block_storage;
+	Block m_scratch;
+
+	// Whether a block's reads were checked in this run, see ready()
+	std::pmr::vector<uint8_t> m_block_ready;
+	// Runs of each block not yet added to m_metrics
+	std::pmr::vector<uint64_t> m_block_runs;
+	// Same for lines run by the plain interpreter, and how often they jumped
+	std::pmr::vector<uint64_t> m_line_runs;
+	std::pmr::vector<uint64_t> m_line_jumps;
+
+	// Lines whose arithmetic the optimizer proved can't overflow
+	std::pmr::vector<uint8_t> m_unchecked;
+	OptimizationReport m_optimization;
+
+	size_t m_steps{ 0 };
+	size_t m_step_budget{ 0 };
+	std::chrono::milliseconds m_time_budget{ 0 };
+	std::chrono::steady_clock::time_point m_start_time;
+
+	size_t m_back_edges{ 0 };
+	bool m_detect_cycles{ false };
+	CycleDetector<T> m_cycles;
+
+	SessionLog *m_recording{ nullptr };
+	SessionLog *m_replay{ nullptr };
+
+	Metrics m_metrics;
+
+	void addLine(std::string_view line);
+	static void stripLine(std::string_view line, std::pmr::string &stored);
+	static bool sameLine(std::string_view line, std::string_view stored);
+	void invalidate(const std::vector<size_t> &changed);
+	bool fetchLine(size_t index);
+	Status loop();
+	Status step(std::string_view line);
+
+	const Block *hotBlock(size_t index);
+	bool ready(const Block &block) const;
+	void retire(const Instruction &ins, uint64_t count);
+	void collectRuns();
+	Status runBlock(const Block &block);
+	Status backEdge();
+
+	Status readValue(std::string_view varname, T &value);
+	Status writeValue(std::string_view varname, T value);
+	Status logValue(SessionLog::Kind kind, T &value);
 
 	// 0 operators
 	Status ins_nop(Lexer &p);
@@ -45,11 +214,16 @@ private:
 	Status ins_jump(Lexer &p);
 	Status ins_read(Lexer &p);
 	Status ins_write(Lexer &p);
+	Status ins_reada(Lexer &p);
+	Status ins_writea(Lexer &p);
 
 	// 2 operators
 	Status ins_assign(Lexer &p);
 	Status ins_jumpt(Lexer &p);
 	Status ins_jumpf(Lexer &p);
+	Status ins_array(Lexer &p);
+	Status ins_fill(Lexer &p);
+	Status ins_sum(Lexer &p);
 
 	// 3 operators
 	Status ins_add(Lexer &p);
@@ -60,11 +234,22 @@ private:
 	Status ins_lte(Lexer &p);
 	Status ins_gte(Lexer &p);
 	Status ins_eq(Lexer &p);
-
-	bool expect(Lexer &p, Lexer::Token t) const;
-	Status jump(int value);
-	Status getValue(Lexer &p, int &value);
+	Status ins_get(Lexer &p);
+	Status ins_set(Lexer &p);
+	Status ins_vector(Lexer &p, Lexer::Token op);
+
+	bool expect(Lexer &p, Lexer::Token t);
+	Status jump(long long value);
+	Status getValue(Lexer &p, T &value);
+	Status overflow(T v1, Lexer::Token op, T v2);
+	Status getArray(Lexer &p, Array *&array);
+	Array &arrayFor(std::string_view name);
+	Status getIndex(Lexer &p, const Array &array, size_t &index);
 
 public:
-	bool getVar(const std::string &varname, int &value);
-};
\ No newline at end of file
+	bool getVar(std::string_view varname, T &value);
+	bool getArray(std::string_view name, std::vector<T> &values) const;
+};
+
+
+typedef BasicInterpreter<Int32Value> Interpreter;
\ No newline at end of file
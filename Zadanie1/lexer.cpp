@@ -1,43 +1,97 @@
 #include "lexer.hpp"
+#include "lexertable.hpp"
 
-#include <iostream>
 #include <algorithm>
+#include <charconv>
+#include <cctype>
 
 
 const std::vector<std::string> Lexer::token_strings
 {
 	"NOP",
 	"JUMP", "READ", "WRITE",
+	"READA", "WRITEA",
 	"=", "JUMPT", "JUMPF",
+	"ARRAY", "FILL", "SUM",
 	"+", "-", "*",
 	"<", ">", "<=", ">=", "==",
+	"GET", "SET",
+	"VADD", "VMUL",
+	"VLT", "VGT", "VLTE", "VGTE", "VEQ",
 	"(NUMBER)", "(VARIABLE)", "(STRING)", "(EOL)"
 };
 
 
-Lexer::Lexer(std::string line) :
+Lexer::Lexer(std::string_view line) :
 	m_line{ line }
 {
-	// Remove all whitespace from the line 
-	m_line.erase(std::remove_if(m_line.begin(), m_line.end(), isspace), m_line.end());
-
-	// Initialize stringstream -- we can't do this in initializer list
-	m_ss.str(m_line);
+	// Remove all whitespace from the line, most lines have none and are used as they are
+	auto space = [](char c) { return isspace(static_cast<unsigned char>(c)) != 0; };
+	if (std::any_of(line.begin(), line.end(), space))
+	{
+		m_stripped.assign(line.begin(), line.end());
+		m_stripped.erase(std::remove_if(m_stripped.begin(), m_stripped.end(), space), m_stripped.end());
+		m_line = m_stripped;
+	}
 }
 
 
 Lexer::Token Lexer::next()
 {
-	std::string token;
-	if (!std::getline(m_ss, token, ','))
+	if (m_position >= m_line.size())
+	{
+		m_tokenstr = "(NEWLINE)";
+		return Token::EOL;
+	}
+
+	// The whole field is run through the DFA, it ends up in the state telling what the field was
+	const size_t begin = m_position;
+	LexerTable::StateId state = LexerTable::start;
+	size_t end = begin;
+	for (; end < m_line.size() && m_line[end] != ','; end++)
+	{
+		state = LexerTable::next[state][LexerTable::byte_class[static_cast<unsigned char>(m_line[end])]];
+	}
+
+	m_position = end + 1;
+	if (end == begin)
+	{
+		m_tokenstr = "(NO_DATA)";
+		return Token::EOL;
+	}
+
+	m_tokenstr = m_line.substr(begin, end - begin);
+	const Token t = LexerTable::accept[state];
+	if (t == Token::NUMBER)
+	{
+		// Numbers that don't fit into long long are strings
+		return std::from_chars(m_line.data() + begin, m_line.data() + end, m_tokennum).ec == std::errc() ? t : Token::STRING;
+	}
+
+	return t;
+}
+
+
+Lexer::Token Lexer::nextReference()
+{
+	if (m_position >= m_line.size())
 	{
 		m_tokenstr = "(NEWLINE)";
 		return Token::EOL;
 	}
 
+	size_t end = m_line.find(',', m_position);
+	if (end == std::string_view::npos)
+	{
+		end = m_line.size();
+	}
+
+	const std::string_view token = m_line.substr(m_position, end - m_position);
+	m_position = end + 1;
+
 	for (size_t i = 0; i < token_strings.size(); i++)
 	{
-		if (token_strings.at(i) == token)
+		if (token_strings[i] == token)
 		{
 			m_tokenstr = token;
 			return static_cast<Token>(i);
@@ -46,22 +100,23 @@ Lexer::Token Lexer::next()
 
 	if (!token.empty())
 	{
-		if (isalpha(token[0]))
+		if (isalpha(static_cast<unsigned char>(token[0])))
 		{
 			// No strings exist in this language, so variable is assumed
 			// The actual validity of it is questionable and checked by interpreter
 			m_tokenstr = token;
 			return Token::VARIABLE;
 		}
-		else if (token[0] == '-' || isdigit(token[0]))
+		else if ((token[0] == '-' || isdigit(static_cast<unsigned char>(token[0]))) &&
+			std::from_chars(token.data(), token.data() + token.size(), m_tokennum).ec == std::errc())
 		{
-			// Number
-			m_tokennum = std::stoi(token);
+			// Number, trailing garbage is ignored the same way stoll ignores it
 			return Token::NUMBER;
 		}
 		else
 		{
 			// Everything else is a string.. not that we are going to need it
+			// (this includes numbers that don't fit into long long)
 			m_tokenstr = token;
 			return Token::STRING;
 		}
@@ -71,8 +126,6 @@ Lexer::Token Lexer::next()
 		m_tokenstr = "(NO_DATA)";
 		return Token::EOL;
 	}
-
-	return Token::NOP;
 }
 
 
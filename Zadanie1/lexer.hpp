@@ -1,18 +1,23 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <sstream>
 
 
+// Splits a line into tokens without copying it. Tokens returned by str() point
+// into the line, so the line has to outlive the lexer and every token taken
+// from it. Lines containing whitespace are the exception: they get copied once
+// with the whitespace removed.
 class Lexer
 {
 private:
-	std::string m_line;
-	std::istringstream m_ss;
+	std::string m_stripped;
+	std::string_view m_line;
+	size_t m_position{ 0 };
 
-	std::string m_tokenstr;
-	int m_tokennum;
+	std::string_view m_tokenstr;
+	long long m_tokennum{ 0 };
 
 	static const std::vector<std::string> token_strings;
 
@@ -23,21 +28,34 @@ public:
 		NOP,
 		// 1 operator
 		JUMP, READ, WRITE,
+		READA, WRITEA,
 		// 2 operators
 		ASSIGN, JUMPT, JUMPF,
+		ARRAY, FILL, SUM,
 		// 3 operators
 		ADD, SUB, MULTIPLY,
 		LT, GT, LTE, GTE, EQ,
+		GET, SET,
+		VADD, VMUL,
+		VLT, VGT, VLTE, VGTE, VEQ,
 
 		NUMBER, VARIABLE, STRING, EOL
 	};
 
-	explicit Lexer(std::string line);
+	explicit Lexer(std::string_view line);
+	Lexer(const Lexer &) = delete;
+	Lexer &operator=(const Lexer &) = delete;
+
+	// Scans with the tables lexgen generates from lexgen/tokens.txt
 	Token next();
 
-	int num() const { return m_tokennum; }
-	const std::string &str() const { return m_tokenstr; }
-	const std::string &token_to_str(Token t) const { return token_strings.at(t); }
+	// The hand-written scanner next() used to be, kept to check and benchmark
+	// the generated one against
+	Token nextReference();
+
+	long long num() const { return m_tokennum; }
+	std::string_view str() const { return m_tokenstr; }
+	static const std::string &token_to_str(Token t) { return token_strings.at(t); }
 
 	// Only used for tests
 	std::vector<Token> tokenize();
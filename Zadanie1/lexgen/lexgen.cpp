@@ -0,0 +1,696 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <bitset>
+#include <map>
+#include <set>
+#include <queue>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+
+#include "regexp.hpp"
+#include "fautils.hpp"
+
+
+// Generates the scanner tables used by Lexer::next (see lexer.cpp) from the
+// token regexes in tokens.txt:
+//
+// 1. Regexes are parsed, and bytes that no regex tells apart are merged into
+//    one class, so the automata work on a few dozen symbols instead of 256
+// 2. Every token gets a marker symbol appended to its regex, and the union of
+//    all of them is determinized with FAUtils::nfa_to_dfa. A DFA state accepts
+//    a token when it has a transition on that token's marker.
+// 3. The DFA (without the markers) is minimized by partition refinement, with
+//    states starting in the same block only if they accept the same token
+// 4. Tables are written as a header that lexer.cpp includes
+
+namespace
+{
+	typedef std::bitset<256> ByteSet;
+
+	struct Node
+	{
+		enum class Kind { BYTES, CONCAT, UNION, STAR, PLUS, OPTIONAL };
+
+		Kind kind{ Kind::BYTES };
+		ByteSet bytes;
+		std::vector<Node> children;
+	};
+
+	struct Rule
+	{
+		std::string token;
+		std::string regex;
+		Node tree;
+	};
+
+
+	// Recursive descent over one regex, `error` is set on the first problem
+	class Parser
+	{
+	public:
+		Parser(const std::string &regex, std::string &error) :
+			m_regex{ regex },
+			m_error{ error }
+		{
+			;
+		}
+
+		Node parse()
+		{
+			Node n = alternation();
+			if (m_position < m_regex.size() && m_error.empty())
+			{
+				m_error = "unexpected '" + std::string(1, m_regex[m_position]) + "'";
+			}
+
+			return n;
+		}
+
+	private:
+		const std::string &m_regex;
+		std::string &m_error;
+		size_t m_position{ 0 };
+
+		bool more() const { return m_position < m_regex.size() && m_error.empty(); }
+
+		Node alternation()
+		{
+			Node n;
+			n.kind = Node::Kind::UNION;
+			n.children.push_back(concatenation());
+
+			while (more() && m_regex[m_position] == '|')
+			{
+				m_position++;
+				n.children.push_back(concatenation());
+			}
+
+			return n.children.size() == 1 ? n.children[0] : n;
+		}
+
+		Node concatenation()
+		{
+			Node n;
+			n.kind = Node::Kind::CONCAT;
+
+			while (more() && m_regex[m_position] != '|' && m_regex[m_position] != ')')
+			{
+				n.children.push_back(repetition());
+			}
+
+			return n.children.size() == 1 ? n.children[0] : n;
+		}
+
+		Node repetition()
+		{
+			Node n = atom();
+
+			while (more())
+			{
+				Node r;
+				switch (m_regex[m_position])
+				{
+				case '*': r.kind = Node::Kind::STAR; break;
+				case '+': r.kind = Node::Kind::PLUS; break;
+				case '?': r.kind = Node::Kind::OPTIONAL; break;
+				default: return n;
+				}
+
+				m_position++;
+				r.children.push_back(n);
+				n = r;
+			}
+
+			return n;
+		}
+
+		Node atom()
+		{
+			Node n;
+			const char c = m_regex[m_position++];
+
+			switch (c)
+			{
+			case '(':
+				n = alternation();
+				if (!more() || m_regex[m_position] != ')')
+				{
+					m_error = "missing ')'";
+				}
+				m_position++;
+				break;
+
+			case '[':
+				n.bytes = bracket();
+				break;
+
+			case '.':
+				// Fields never contain commas, they are split at them
+				n.bytes.set();
+				n.bytes.reset(',');
+				break;
+
+			case '\\':
+				if (m_position >= m_regex.size())
+				{
+					m_error = "nothing to escape";
+					break;
+				}
+				n.bytes.set(static_cast<unsigned char>(m_regex[m_position++]));
+				break;
+
+			case '*':
+			case '+':
+			case '?':
+			case ')':
+				m_error = "unexpected '" + std::string(1, c) + "'";
+				break;
+
+			default:
+				n.bytes.set(static_cast<unsigned char>(c));
+				break;
+			}
+
+			return n;
+		}
+
+		ByteSet bracket()
+		{
+			ByteSet bytes;
+			bool negated = false;
+			if (m_position < m_regex.size() && m_regex[m_position] == '^')
+			{
+				negated = true;
+				m_position++;
+			}
+
+			while (m_position < m_regex.size() && m_regex[m_position] != ']')
+			{
+				unsigned char first = static_cast<unsigned char>(m_regex[m_position++]);
+				if (first == '\\' && m_position < m_regex.size())
+				{
+					first = static_cast<unsigned char>(m_regex[m_position++]);
+				}
+
+				unsigned char last = first;
+				if (m_position + 1 < m_regex.size() && m_regex[m_position] == '-' && m_regex[m_position + 1] != ']')
+				{
+					last = static_cast<unsigned char>(m_regex[m_position + 1]);
+					m_position += 2;
+				}
+
+				for (unsigned int b = first; b <= last; b++)
+				{
+					bytes.set(b);
+				}
+			}
+
+			if (m_position >= m_regex.size())
+			{
+				m_error = "missing ']'";
+			}
+			m_position++;
+
+			if (negated)
+			{
+				bytes.flip();
+				bytes.reset(',');
+			}
+
+			return bytes;
+		}
+	};
+
+
+	void collectSets(const Node &n, std::vector<ByteSet> &sets)
+	{
+		if (n.kind == Node::Kind::BYTES)
+		{
+			sets.push_back(n.bytes);
+		}
+
+		for (const Node &child : n.children)
+		{
+			collectSets(child, sets);
+		}
+	}
+
+	// Bytes belonging to exactly the same sets get the same class. Class 0 is
+	// for bytes that no set contains, nothing ever matches them.
+	std::vector<uint8_t> byteClasses(const std::vector<ByteSet> &sets, size_t &count)
+	{
+		std::map<std::vector<bool>, uint8_t> signatures;
+		signatures[std::vector<bool>(sets.size(), false)] = 0;
+
+		std::vector<uint8_t> classes(256);
+		for (size_t b = 0; b < 256; b++)
+		{
+			std::vector<bool> signature(sets.size());
+			for (size_t i = 0; i < sets.size(); i++)
+			{
+				signature[i] = sets[i].test(b);
+			}
+
+			const auto it = signatures.insert(std::make_pair(signature, static_cast<uint8_t>(signatures.size()))).first;
+			classes[b] = it->second;
+		}
+
+		count = signatures.size();
+		return classes;
+	}
+
+	// Automaton symbols are one character strings, with the character being the class + 1
+	std::string symbol(size_t id)
+	{
+		return std::string(1, static_cast<char>(id + 1));
+	}
+
+	RegExp build(const Node &n, const std::vector<uint8_t> &classes)
+	{
+		switch (n.kind)
+		{
+		case Node::Kind::BYTES:
+			{
+				std::set<uint8_t> used;
+				for (size_t b = 0; b < 256; b++)
+				{
+					if (n.bytes.test(b))
+					{
+						used.insert(classes[b]);
+					}
+				}
+
+				if (used.empty())
+				{
+					return RegExp();
+				}
+
+				RegExp r(symbol(*used.begin()));
+				for (auto it = std::next(used.begin()); it != used.end(); ++it)
+				{
+					RegExp s(symbol(*it));
+					r = r | s;
+				}
+
+				return r;
+			}
+
+		case Node::Kind::CONCAT:
+		case Node::Kind::UNION:
+			{
+				if (n.children.empty())
+				{
+					return RegExp("");
+				}
+
+				RegExp r = build(n.children[0], classes);
+				for (size_t i = 1; i < n.children.size(); i++)
+				{
+					RegExp s = build(n.children[i], classes);
+					r = n.kind == Node::Kind::CONCAT ? r + s : r | s;
+				}
+
+				return r;
+			}
+
+		case Node::Kind::STAR:
+			{
+				RegExp r = build(n.children[0], classes);
+				return *r;
+			}
+
+		case Node::Kind::PLUS:
+			{
+				RegExp r = build(n.children[0], classes);
+				RegExp star = *r;
+				return r + star;
+			}
+
+		case Node::Kind::OPTIONAL:
+		default:
+			{
+				RegExp r = build(n.children[0], classes);
+				RegExp epsilon("");
+				return r | epsilon;
+			}
+		}
+	}
+
+	bool loadRules(const std::string &filename, std::vector<Rule> &rules)
+	{
+		std::ifstream in_file(filename);
+		if (!in_file.is_open())
+		{
+			std::cerr << "Failed to open file \"" << filename << "\"\n";
+			return false;
+		}
+
+		std::string line;
+		size_t line_number = 0;
+		while (std::getline(in_file, line))
+		{
+			line_number++;
+			if (!line.empty() && line.back() == '\r')
+			{
+				line.pop_back();
+			}
+
+			std::stringstream ss(line);
+			Rule rule;
+			if (!(ss >> rule.token) || rule.token[0] == '#')
+			{
+				continue;
+			}
+
+			ss >> rule.regex;
+			std::string error;
+			if (rule.regex.empty())
+			{
+				error = "missing regex";
+			}
+			else
+			{
+				rule.tree = Parser(rule.regex, error).parse();
+			}
+
+			if (!error.empty())
+			{
+				std::cerr << filename << ":" << line_number << ": " << error << "\n";
+				return false;
+			}
+
+			rules.push_back(rule);
+		}
+
+		return true;
+	}
+
+
+	// DFA as a dense table, the last state is a dead state that every missing
+	// transition goes to
+	struct Table
+	{
+		size_t classes{ 0 };
+		std::vector<std::vector<size_t>> next;
+		std::vector<int> accept;
+
+		size_t dead() const { return next.size() - 1; }
+	};
+
+	Table tabulate(const DFiniteAutomaton &dfa, size_t classes, size_t tokens)
+	{
+		Table table;
+		table.classes = classes;
+
+		FiniteAutomaton::StateId initial = 0;
+		for (FiniteAutomaton::StateId id = 0; id < dfa.getStateCount(); id++)
+		{
+			if (dfa.getState(id).isInitial())
+			{
+				initial = id;
+			}
+		}
+
+		// Classes and markers that never made it into the DFA have no transitions at all
+		auto next = [&dfa](FiniteAutomaton::StateId from, const std::string &s, FiniteAutomaton::StateId &to) -> bool {
+			FiniteAutomaton::SymbolId id;
+			if (!dfa.findSymbol(s, id))
+			{
+				return false;
+			}
+
+			const FiniteAutomaton::Edges edges = dfa.getEdges(from, id);
+			if (edges.empty())
+			{
+				return false;
+			}
+
+			to = edges.begin()->to;
+			return true;
+		};
+
+		// Only class symbols are followed, so states reached by markers alone are left out
+		std::map<FiniteAutomaton::StateId, size_t> ids{ { initial, 0 } };
+		std::vector<FiniteAutomaton::StateId> states{ initial };
+		for (size_t i = 0; i < states.size(); i++)
+		{
+			table.next.emplace_back(classes, SIZE_MAX);
+			for (size_t c = 0; c < classes; c++)
+			{
+				FiniteAutomaton::StateId to;
+				if (next(states[i], symbol(c), to))
+				{
+					if (ids.insert(std::make_pair(to, states.size())).second)
+					{
+						states.push_back(to);
+					}
+
+					// Missing ones are filled in with the dead state once the number of states is known
+					table.next[i][c] = ids.at(to);
+				}
+			}
+
+			int accept = -1;
+			for (size_t t = 0; t < tokens && accept < 0; t++)
+			{
+				FiniteAutomaton::StateId to;
+				if (next(states[i], symbol(classes + t), to))
+				{
+					accept = static_cast<int>(t);
+				}
+			}
+
+			table.accept.push_back(accept);
+		}
+
+		table.next.emplace_back(classes, SIZE_MAX);
+		table.accept.push_back(-1);
+		for (std::vector<size_t> &row : table.next)
+		{
+			std::replace(row.begin(), row.end(), SIZE_MAX, table.dead());
+		}
+
+		return table;
+	}
+
+	// Moore's partition refinement. States stay together while they accept the
+	// same token and go to the same blocks on every class. The result is
+	// renumbered in breadth-first order from the start state.
+	Table minimize(const Table &table)
+	{
+		const size_t n = table.next.size();
+		std::vector<size_t> block(n);
+		for (size_t s = 0; s < n; s++)
+		{
+			block[s] = static_cast<size_t>(table.accept[s] + 1);
+		}
+
+		size_t blocks = 0;
+		while (true)
+		{
+			std::map<std::vector<size_t>, size_t> signatures;
+			std::vector<size_t> refined(n);
+			for (size_t s = 0; s < n; s++)
+			{
+				std::vector<size_t> signature{ block[s] };
+				for (size_t to : table.next[s])
+				{
+					signature.push_back(block[to]);
+				}
+
+				refined[s] = signatures.insert(std::make_pair(signature, signatures.size())).first->second;
+			}
+
+			block.swap(refined);
+			if (signatures.size() == blocks)
+			{
+				break;
+			}
+			blocks = signatures.size();
+		}
+
+		// Dead state is kept last, so it doesn't take part in the numbering
+		std::vector<size_t> ids(blocks, SIZE_MAX), order;
+		ids[block[table.dead()]] = blocks - 1;
+
+		Table minimal;
+		minimal.classes = table.classes;
+
+		std::vector<size_t> representative(blocks);
+		for (size_t s = n; s-- > 0;)
+		{
+			representative[block[s]] = s;
+		}
+
+		std::queue<size_t> q;
+		q.push(0);
+		ids[block[0]] = 0;
+		order.push_back(block[0]);
+		while (!q.empty())
+		{
+			const size_t s = q.front();
+			q.pop();
+
+			for (size_t to : table.next[s])
+			{
+				if (ids[block[to]] == SIZE_MAX)
+				{
+					ids[block[to]] = order.size();
+					order.push_back(block[to]);
+					q.push(to);
+				}
+			}
+		}
+		order.push_back(block[table.dead()]);
+
+		for (size_t b : order)
+		{
+			const size_t s = representative[b];
+			minimal.next.emplace_back();
+			for (size_t to : table.next[s])
+			{
+				minimal.next.back().push_back(ids[block[to]]);
+			}
+			minimal.accept.push_back(table.accept[s]);
+		}
+
+		return minimal;
+	}
+
+	bool write(const std::string &filename, const std::string &source, const Table &table,
+		const std::vector<uint8_t> &classes, const std::vector<Rule> &rules)
+	{
+		std::ofstream out_file(filename, std::ios::trunc);
+		if (!out_file.is_open())
+		{
+			return false;
+		}
+
+		const char *state_type = table.next.size() <= 256 ? "uint8_t" : "uint16_t";
+
+		// Same header no matter which platform generated it
+		std::string source_name(source);
+		std::replace(source_name.begin(), source_name.end(), '\\', '/');
+
+		out_file << "#pragma once\n\n"
+			<< "// Generated by lexgen from " << source_name << ", edit that and rebuild instead\n\n"
+			<< "#include \"lexer.hpp\"\n\n"
+			<< "#include <cstdint>\n\n\n"
+			<< "namespace LexerTable\n{\n"
+			<< "\ttypedef " << state_type << " StateId;\n\n"
+			<< "\tconst size_t classes = " << table.classes << ";\n"
+			<< "\tconst StateId start = 0;\n"
+			<< "\tconst StateId dead = " << table.dead() << ";\n\n"
+			<< "\tconst uint8_t byte_class[256] = {";
+
+		for (size_t b = 0; b < 256; b++)
+		{
+			out_file << (b % 16 ? " " : "\n\t\t") << static_cast<int>(classes[b]) << (b + 1 < 256 ? "," : "");
+		}
+
+		out_file << "\n\t};\n\n"
+			<< "\tconst StateId next[][classes] = {";
+
+		for (size_t s = 0; s < table.next.size(); s++)
+		{
+			out_file << "\n\t\t{ ";
+			for (size_t c = 0; c < table.classes; c++)
+			{
+				out_file << (c ? ", " : "") << table.next[s][c];
+			}
+			out_file << " }" << (s + 1 < table.next.size() ? "," : "");
+		}
+
+		out_file << "\n\t};\n\n"
+			<< "\t// Token of a field that ends in the state, STRING when nothing matches it\n"
+			<< "\tconst Lexer::Token accept[] = {";
+
+		for (size_t s = 0; s < table.accept.size(); s++)
+		{
+			const int a = table.accept[s];
+			out_file << (s % 8 ? " " : "\n\t\t") << "Lexer::" << (a < 0 ? "STRING" : rules[a].token)
+				<< (s + 1 < table.accept.size() ? "," : "");
+		}
+
+		out_file << "\n\t};\n}";
+		return out_file.good();
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		std::cerr << "Usage: " << argv[0] << " <tokens> <out_header>\n";
+		return EXIT_FAILURE;
+	}
+
+	const std::string in_tokens(argv[1]), out_header(argv[2]);
+
+	std::vector<Rule> rules;
+	if (!loadRules(in_tokens, rules))
+	{
+		return EXIT_FAILURE;
+	}
+
+	std::vector<ByteSet> sets;
+	for (const Rule &rule : rules)
+	{
+		collectSets(rule.tree, sets);
+	}
+
+	size_t class_count = 0;
+	const std::vector<uint8_t> classes = byteClasses(sets, class_count);
+
+	// Symbols are single chars, classes and markers together have to fit into one
+	if (class_count + rules.size() >= 255 || rules.empty())
+	{
+		std::cerr << "Too many tokens or byte classes (" << rules.size() << " tokens, " << class_count << " classes)\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "[+] " << rules.size() << " tokens, " << class_count << " byte classes\n";
+
+	RegExp all;
+	for (size_t t = 0; t < rules.size(); t++)
+	{
+		RegExp r = build(rules[t].tree, classes);
+		RegExp marker(symbol(class_count + t));
+		RegExp tagged = r + marker;
+		all = t == 0 ? tagged : all | tagged;
+	}
+
+	const NDFiniteAutomaton &nfa = all.getAutomaton();
+	std::cout << "[+] NFA has " << nfa.getStates().size() << " states\n";
+
+	DFiniteAutomaton dfa;
+	if (!FAUtils::nfa_to_dfa(nfa, dfa))
+	{
+		std::cerr << "Failed to convert NFA to DFA\n";
+		return EXIT_FAILURE;
+	}
+
+	const Table table = tabulate(dfa, class_count, rules.size());
+	const Table minimal = minimize(table);
+	std::cout << "[+] DFA has " << table.next.size() << " states, " << minimal.next.size() << " after minimization\n";
+
+	if (minimal.next.size() > 65536)
+	{
+		std::cerr << "Too many states for the table\n";
+		return EXIT_FAILURE;
+	}
+
+	if (!write(out_header, in_tokens, minimal, classes, rules))
+	{
+		std::cerr << "Failed to write tables to \"" << out_header << "\"\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "[+] Tables written to \"" << out_header << "\"\n";
+	return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,257 @@
+#include "loopoptimizer.hpp"
+#include "valuetypes.hpp"
+
+#include <limits>
+
+
+template <typename V>
+bool LoopOptimizer<V>::unroll(Block &block, const Instruction *init)
+{
+	block.unrolled.clear();
+	block.iterations = 0;
+
+	// The exit test is the only branch, it ends the block and goes back to its start
+	if (block.code.size() < 2)
+	{
+		return false;
+	}
+
+	const Instruction &exit = block.code.back();
+	const bool fused = exit.branch != Lexer::Token::EOL;
+	if ((!fused && exit.op != Lexer::Token::JUMPT && exit.op != Lexer::Token::JUMPF) || exit.target != block.start)
+	{
+		return false;
+	}
+
+	// The induction variable is the one the exit test reads and the body only ever adds a constant to
+	const Instruction *increment = nullptr;
+	for (const Operand *op : { &exit.a, &exit.b })
+	{
+		if (op->kind != Operand::Kind::SLOT)
+		{
+			continue;
+		}
+
+		const size_t slot = static_cast<size_t>(op->value);
+		const Instruction *writer = nullptr;
+		size_t writers = 0;
+		for (const Instruction &ins : block.code)
+		{
+			if (ins.dst.kind == Operand::Kind::SLOT && static_cast<size_t>(ins.dst.value) == slot)
+			{
+				writer = &ins;
+				writers++;
+			}
+		}
+
+		if (!writers)
+		{
+			// Reads something the loop doesn't change
+			continue;
+		}
+
+		if (increment || writers > 1)
+		{
+			return false;
+		}
+
+		// i = i + c, i = c + i or i = i - c
+		const Operand &a = writer->a, &b = writer->b;
+		const bool a_self = a.kind == Operand::Kind::SLOT && static_cast<size_t>(a.value) == slot;
+		const bool b_self = b.kind == Operand::Kind::SLOT && static_cast<size_t>(b.value) == slot;
+		if (writer->op == Lexer::Token::ADD && a_self && b.kind == Operand::Kind::IMMEDIATE)
+		{
+			block.step = b.value;
+		}
+		else if (writer->op == Lexer::Token::ADD && b_self && a.kind == Operand::Kind::IMMEDIATE)
+		{
+			block.step = a.value;
+		}
+		else if (writer->op == Lexer::Token::SUB && a_self && b.kind == Operand::Kind::IMMEDIATE &&
+			b.value != std::numeric_limits<int64_t>::min())
+		{
+			block.step = -b.value;
+		}
+		else
+		{
+			return false;
+		}
+
+		increment = writer;
+		block.induction = slot;
+	}
+
+	if (!increment)
+	{
+		return false;
+	}
+
+	// Loops entered with a known value of the induction variable, and tested
+	// against constants, are unrolled as a whole
+	auto known = [&block](const Operand &op) {
+		return op.kind != Operand::Kind::SLOT || static_cast<size_t>(op.value) == block.induction;
+	};
+
+	size_t iterations = unroll_factor;
+	if (init && init->op == Lexer::Token::ASSIGN && init->a.kind == Operand::Kind::IMMEDIATE &&
+		init->dst.kind == Operand::Kind::SLOT && static_cast<size_t>(init->dst.value) == block.induction &&
+		known(exit.a) && known(exit.b))
+	{
+		const size_t n = continues(block, static_cast<T>(init->a.value), nullptr, max_full_unroll) + 1;
+		if (n <= max_full_unroll)
+		{
+			iterations = n;
+		}
+	}
+
+	if (iterations < 2)
+	{
+		return false;
+	}
+
+	// Compares that only feed the exit test don't have to be kept in the copies that leave it out
+	const size_t condition = fused ? static_cast<size_t>(exit.dst.value) : 0;
+	bool condition_read = false;
+	for (size_t k = 0; fused && k + 1 < block.code.size(); k++)
+	{
+		condition_read = condition_read || readsSlot(block.code[k], condition);
+	}
+
+	for (size_t copy = 0; copy < iterations; copy++)
+	{
+		for (size_t k = 0; k + 1 < block.code.size(); k++)
+		{
+			Instruction ins = block.code[k];
+
+			// The first copy multiplies, so from the second one on x holds i * k
+			// from the iteration before, and i has grown by exactly one step since
+			if (copy > 0 && ins.op == Lexer::Token::MULTIPLY && ins.dst.kind == Operand::Kind::SLOT)
+			{
+				const Operand *factor = nullptr;
+				if (ins.a.kind == Operand::Kind::SLOT && static_cast<size_t>(ins.a.value) == block.induction)
+				{
+					factor = &ins.b;
+				}
+				else if (ins.b.kind == Operand::Kind::SLOT && static_cast<size_t>(ins.b.value) == block.induction)
+				{
+					factor = &ins.a;
+				}
+
+				T increment_by;
+				const size_t dst = static_cast<size_t>(ins.dst.value);
+				if (factor && factor->kind == Operand::Kind::IMMEDIATE && dst != block.induction && !written(block, dst, &block.code[k]) &&
+					V::mul(static_cast<T>(block.step), static_cast<T>(factor->value), increment_by))
+				{
+					ins.reduced = true;
+					ins.increment = increment_by;
+				}
+			}
+
+			block.unrolled.push_back(ins);
+		}
+
+		if (copy + 1 == iterations)
+		{
+			block.unrolled.push_back(exit);
+		}
+		else if (condition_read)
+		{
+			Instruction compare = exit;
+			compare.branch = Lexer::Token::EOL;
+			block.unrolled.push_back(compare);
+		}
+	}
+
+	block.iterations = iterations;
+	return true;
+}
+
+
+template <typename V>
+bool LoopOptimizer<V>::guard(const Block &block, const T *values)
+{
+	return continues(block, values[block.induction], values, block.iterations - 1) >= block.iterations - 1;
+}
+
+
+template <typename V>
+size_t LoopOptimizer<V>::continues(const Block &block, T i, const T *values, size_t limit)
+{
+	const Instruction &exit = block.code.back();
+
+	size_t count = 0;
+	for (; count < limit; count++)
+	{
+		// The increment always comes before the exit test
+		if (!V::add(i, static_cast<T>(block.step), i))
+		{
+			break;
+		}
+
+		T a = 0, b = 0;
+		for (const Operand *op : { &exit.a, &exit.b })
+		{
+			T &value = op == &exit.a ? a : b;
+			if (op->kind == Operand::Kind::IMMEDIATE)
+			{
+				value = static_cast<T>(op->value);
+			}
+			else if (op->kind == Operand::Kind::SLOT && static_cast<size_t>(op->value) == block.induction)
+			{
+				value = i;
+			}
+			else if (op->kind == Operand::Kind::SLOT)
+			{
+				value = values[op->value];
+			}
+		}
+
+		T condition = a;
+		switch (exit.op)
+		{
+		case Lexer::Token::LT: condition = a < b; break;
+		case Lexer::Token::GT: condition = a > b; break;
+		case Lexer::Token::LTE: condition = a <= b; break;
+		case Lexer::Token::GTE: condition = a >= b; break;
+		case Lexer::Token::EQ: condition = a == b; break;
+		default: break;
+		}
+
+		const Lexer::Token branch = exit.branch != Lexer::Token::EOL ? exit.branch : exit.op;
+		if ((branch == Lexer::Token::JUMPT) != (condition != 0))
+		{
+			break;
+		}
+	}
+
+	return count;
+}
+
+
+// Whether anything in the body besides `except` stores to the slot
+template <typename V>
+bool LoopOptimizer<V>::written(const Block &block, size_t slot, const Instruction *except)
+{
+	for (const Instruction &ins : block.code)
+	{
+		if (&ins != except && ins.dst.kind == Operand::Kind::SLOT && static_cast<size_t>(ins.dst.value) == slot)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+template <typename V>
+bool LoopOptimizer<V>::readsSlot(const Instruction &ins, size_t slot)
+{
+	return (ins.a.kind == Operand::Kind::SLOT && static_cast<size_t>(ins.a.value) == slot) ||
+		(ins.b.kind == Operand::Kind::SLOT && static_cast<size_t>(ins.b.value) == slot);
+}
+
+
+template class LoopOptimizer<Int32Value>;
+template class LoopOptimizer<Int64Value>;
+template class LoopOptimizer<CheckedInt64Value>;
\ No newline at end of file
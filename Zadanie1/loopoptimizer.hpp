@@ -0,0 +1,45 @@
+#pragma once
+
+#include "instruction.hpp"
+
+#include <cstddef>
+
+
+// Optimizes compiled blocks that jump back to their own start, which is what
+// every innermost loop ends up as:
+//
+// Unrolling: the body is repeated so a single run of the block does several
+// iterations, and the exit test is left out of every copy but the last one.
+// Before the unrolled code is used, a guard works out from the induction
+// variable that none of the left out tests would have exited. Everything else
+// (errors, READ/WRITE, counters) behaves exactly like that many runs of the
+// block. Loops right after a constant initialization that end within
+// max_full_unroll iterations are unrolled completely.
+//
+// Strength reduction: x = i * k with i the induction variable and k a constant
+// becomes x = x + step * k in every copy but the first, which still multiplies.
+template <typename V>
+class LoopOptimizer
+{
+public:
+	typedef typename V::type T;
+
+	static const size_t unroll_factor = 4;
+	static const size_t max_full_unroll = 16;
+
+	// Fills in the unrolled code if the block is a loop of a supported shape. init
+	// is the instruction on the line before the block, if there is one.
+	static bool unroll(Block &block, const Instruction *init);
+
+	// Whether the unrolled code can run with the variables holding these values
+	static bool guard(const Block &block, const T *values);
+
+private:
+	// How many times in a row the exit test loops back when the induction
+	// variable holds i at the start of the body, counting no further than limit.
+	// values may be null when the test only reads immediates and the induction variable.
+	static size_t continues(const Block &block, T i, const T *values, size_t limit);
+
+	static bool written(const Block &block, size_t slot, const Instruction *except);
+	static bool readsSlot(const Instruction &ins, size_t slot);
+};
\ No newline at end of file
@@ -1,66 +1,561 @@
 #include "interpreter.hpp"
+#include "daemon.hpp"
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 
 
-#ifndef _TESTS
+// The benchmark build brings its own main (bench.cpp)
+#if !defined(_TESTS) && !defined(_BENCHMARK)
 
-int main(int argc, char **argv)
+struct Options
 {
-	if (argc < 2)
+	enum ValueType
 	{
-		std::cerr << "Usage: " << argv[0] << " <instruction_file>\n";
-		return EXIT_FAILURE;
+		INT32,
+		INT64,
+		CHECKED
+	};
+
+	ValueType value_type{ INT32 };
+	std::string filename;
+	std::string input_file;
+
+	size_t max_steps{ 0 };
+	size_t max_time{ 0 };
+	bool detect_loops{ false };
+	bool optimize{ false };
+	bool watch{ false };
+
+	std::string record_file;
+	std::string replay_file;
+
+	std::string daemon_socket;
+	std::string connect_socket;
+	size_t threads{ std::thread::hardware_concurrency() };
+
+	std::string metrics_file;
+	size_t metrics_interval{ 10 };
+};
+
+
+void usage(const char *argv0)
+{
+	std::cerr << "Usage: " << argv0 << " [options] <instruction_file|-> [input_file]\n";
+	std::cerr << "       " << argv0 << " --daemon <socket> [--threads N]\n";
+	std::cerr << "  -              stream instructions from stdin, execution starts with the first line\n";
+	std::cerr << "  input_file     values for READ (required when instructions come from stdin, unless replaying)\n";
+	std::cerr << "Options:\n";
+	std::cerr << "  --int64        use 64-bit variables instead of 32-bit\n";
+	std::cerr << "  --checked      use 64-bit variables and stop on arithmetic overflow\n";
+	std::cerr << "  --max-steps N  stop after executing N lines\n";
+	std::cerr << "  --max-time MS  stop after running for MS milliseconds\n";
+	std::cerr << "  --detect-loops stop when the program returns to a state it was already in\n";
+	std::cerr << "  --optimize     share storage between variables and drop unused stores\n";
+	std::cerr << "  --watch        run again every time the instruction file changes\n";
+	std::cerr << "  --record FILE  log every READ and WRITE value to FILE\n";
+	std::cerr << "  --replay FILE  take READ values from a recorded log and check WRITEs against it\n";
+	std::cerr << "  --daemon PATH  serve requests on a Unix socket instead of running a file\n";
+	std::cerr << "  --threads N    number of programs the daemon runs at once\n";
+	std::cerr << "  --connect PATH send the program to a running daemon\n";
+	std::cerr << "  --metrics FILE write counters to FILE after the run (JSON for *.json, Prometheus text otherwise)\n";
+	std::cerr << "  --metrics-interval S  how often the daemon writes the metrics file, in seconds\n";
+}
+
+
+bool parseOptions(int argc, char **argv, Options &options)
+{
+	int i = 1;
+	for (; i < argc; i++)
+	{
+		const std::string arg(argv[i]);
+		if (arg.size() < 3 || arg.compare(0, 2, "--") != 0)
+		{
+			break;
+		}
+
+		if (arg == "--int64")
+		{
+			options.value_type = Options::ValueType::INT64;
+		}
+		else if (arg == "--checked")
+		{
+			options.value_type = Options::ValueType::CHECKED;
+		}
+		else if (arg == "--detect-loops")
+		{
+			options.detect_loops = true;
+		}
+		else if (arg == "--optimize")
+		{
+			options.optimize = true;
+		}
+		else if (arg == "--watch")
+		{
+			options.watch = true;
+		}
+		else if (arg == "--max-steps" || arg == "--max-time" || arg == "--threads" || arg == "--daemon" || arg == "--connect" ||
+			arg == "--record" || arg == "--replay" || arg == "--metrics" || arg == "--metrics-interval")
+		{
+			if (i + 1 >= argc)
+			{
+				std::cerr << "Option \"" << arg << "\" needs a value\n";
+				return false;
+			}
+
+			const std::string value(argv[++i]);
+			if (arg == "--daemon")
+			{
+				options.daemon_socket = value;
+			}
+			else if (arg == "--connect")
+			{
+				options.connect_socket = value;
+			}
+			else if (arg == "--record")
+			{
+				options.record_file = value;
+			}
+			else if (arg == "--replay")
+			{
+				options.replay_file = value;
+			}
+			else if (arg == "--metrics")
+			{
+				options.metrics_file = value;
+			}
+			else
+			{
+				const size_t number = std::strtoull(value.c_str(), nullptr, 10);
+				(arg == "--max-steps" ? options.max_steps : arg == "--max-time" ? options.max_time :
+					arg == "--metrics-interval" ? options.metrics_interval : options.threads) = number;
+			}
+		}
+		else
+		{
+			std::cerr << "Unknown option \"" << arg << "\"\n";
+			return false;
+		}
 	}
 
-	std::string filename(argv[1]);
-	Interpreter interp;
+	// The daemon gets its programs from clients
+	if (!options.daemon_socket.empty())
+	{
+		return i == argc;
+	}
 
-	if (!interp.loadFile(filename))
+	if (i >= argc)
 	{
-		std::cerr << "File \"" << filename << "\" was not found\n";
-		return EXIT_FAILURE;
+		return false;
 	}
 
-	Interpreter::Status status = interp.execute();
+	options.filename = argv[i++];
+	if (i < argc)
+	{
+		options.input_file = argv[i];
+	}
+
+	// READ would take its values from stdin too and eat the program's own lines
+	if (options.filename == "-" && options.input_file.empty() && options.replay_file.empty())
+	{
+		std::cerr << "Instructions from stdin need an input_file for READ\n";
+		return false;
+	}
+
+	return true;
+}
+
+
+void reportStatus(InterpreterBase::Status status, size_t line, const std::string &error_info)
+{
 	switch (status)
 	{
-	case Interpreter::Status::OK:
+	case InterpreterBase::Status::OK:
 		{
 			std::cout << "OK!\n";
 			break;
 		}
-	case Interpreter::Status::INVALID_INSTRUCTION:
+	case InterpreterBase::Status::INVALID_INSTRUCTION:
+		{
+			std::cerr << "Line: " << line << ", invalid instruction: \"" << error_info << "\"\n";
+			break;
+		}
+	case InterpreterBase::Status::INVALID_OPERATOR:
+		{
+			std::cerr << "Line: " << line << ", " << error_info << "\n";
+			break;
+		}
+	case InterpreterBase::Status::VARIABLE_DOESNT_EXIST:
+		{
+			std::cerr << "Line: " << line << ", variable \"" << error_info << "\" does not exist\n";
+			break;
+		}
+	case InterpreterBase::Status::INVALID_JUMP:
+		{
+			std::cerr << "Line: " << line << ", invalid jump to line " << error_info << "\n";
+			break;
+		}
+	case InterpreterBase::Status::END_OF_INPUT:
 		{
-			std::cerr << "Line: " << interp.getLineNumber() << ", invalid instruction: \"" << interp.getErrorInfo() << "\"\n";
+			std::cerr << "Line: " << line << ", input ended while reading variable \"" << error_info << "\"\n";
 			break;
 		}
-	case Interpreter::Status::INVALID_OPERATOR:
+	case InterpreterBase::Status::ARITHMETIC_OVERFLOW:
 		{
-			// Error message handled internally
+			std::cerr << "Line: " << line << ", arithmetic overflow: " << error_info << "\n";
 			break;
 		}
-	case Interpreter::Status::VARIABLE_DOESNT_EXIST:
+	case InterpreterBase::Status::INVALID_INDEX:
 		{
-			std::cerr << "Line: " << interp.getLineNumber() << ", variable \"" << interp.getErrorInfo() << "\" does not exist\n";
+			std::cerr << "Line: " << line << ", index out of range: " << error_info << "\n";
 			break;
 		}
-	case Interpreter::Status::INVALID_JUMP:
+	case InterpreterBase::Status::ARRAY_SIZE_MISMATCH:
 		{
-			std::cerr << "Line: " << interp.getLineNumber() << ", invalid jump to line " << interp.getErrorInfo() << "\n";
+			std::cerr << "Line: " << line << ", arrays differ in size: " << error_info << "\n";
 			break;
 		}
+	case InterpreterBase::Status::STEP_BUDGET_EXCEEDED:
+		{
+			std::cerr << "Line: " << line << ", step limit of " << error_info << " reached\n";
+			break;
+		}
+	case InterpreterBase::Status::TIME_BUDGET_EXCEEDED:
+		{
+			std::cerr << "Line: " << line << ", time limit of " << error_info << " reached\n";
+			break;
+		}
+	case InterpreterBase::Status::INFINITE_LOOP:
+		{
+			std::cerr << "Line: " << line << ", program is in an infinite loop\n";
+			break;
+		}
+	case InterpreterBase::Status::REPLAY_MISMATCH:
+		{
+			std::cerr << "Line: " << line << ", run differs from the recording: " << error_info << "\n";
+			break;
+		}
+	case InterpreterBase::Status::INTERNAL_ERROR:
+		{
+			std::cerr << "Line: " << line << ", internal error: " << error_info << "\n";
+			break;
+		}
+	}
+
+}
+
+
+// Everything from opening the input to reporting the result, watch mode does
+// this once per change of the file
+template <typename V>
+int execute(BasicInterpreter<V> &interp, const Options &options)
+{
+	std::ifstream input;
+	if (!options.input_file.empty())
+	{
+		input.open(options.input_file);
+		if (!input.is_open())
+		{
+			std::cerr << "File \"" << options.input_file << "\" was not found\n";
+			return EXIT_FAILURE;
+		}
+
+		interp.setInput(input);
+	}
+
+	SessionLog recording, replay;
+	if (!options.replay_file.empty())
+	{
+		if (!replay.load(options.replay_file))
+		{
+			std::cerr << "File \"" << options.replay_file << "\" is not a session log\n";
+			return EXIT_FAILURE;
+		}
+
+		interp.setReplay(&replay);
 	}
 
+	if (!options.record_file.empty())
+	{
+		interp.setRecording(&recording);
+	}
+
+	InterpreterBase::Status status = interp.execute();
+	reportStatus(status, interp.getLineNumber(), interp.getErrorInfo());
+
+	// Failed runs are saved as well, they are often the interesting ones
+	if (!options.record_file.empty() && !recording.save(options.record_file))
+	{
+		std::cerr << "Could not write \"" << options.record_file << "\"\n";
+	}
+
+	if (!options.metrics_file.empty() && !interp.getMetrics().save(options.metrics_file))
+	{
+		std::cerr << "Could not write \"" << options.metrics_file << "\"\n";
+	}
+
+	// The streams and logs above are gone once this returns
+	interp.setInput(std::cin);
+	interp.setRecording(nullptr);
+	interp.setReplay(nullptr);
 	return status;
 }
 
-#else
+
+// Limits on the run that every interpreter for these options gets
+template <typename V>
+void configure(BasicInterpreter<V> &interp, const Options &options)
+{
+	interp.setStepBudget(options.max_steps);
+	interp.setTimeBudget(std::chrono::milliseconds(options.max_time));
+	interp.setCycleDetection(options.detect_loops);
+}
+
+
+// Reloads leave replaced lines and dropped blocks in the interpreter's arena.
+// Past this much (and past the memory still in use) the program is loaded
+// into a new interpreter instead, which compiles its blocks again.
+const size_t max_stranded_bytes = size_t(1) << 20;
+
+
+// Polls the file's modification time and reruns the program whenever it
+// changes. Only the lines that differ are recompiled. Runs until killed.
+template <typename V>
+int watch(std::unique_ptr<BasicInterpreter<V>> interp, const Options &options)
+{
+	std::error_code error;
+	auto modified = std::filesystem::last_write_time(options.filename, error);
+
+	for (;;)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		const auto now = std::filesystem::last_write_time(options.filename, error);
+		if (error || now == modified)
+		{
+			continue;
+		}
+
+		modified = now;
+
+		const auto start = std::chrono::steady_clock::now();
+		size_t changed;
+		if (!interp->reloadFile(options.filename, changed))
+		{
+			continue;
+		}
+
+		const size_t stranded = interp->getStrandedBytes();
+		if (stranded > max_stranded_bytes && stranded > interp->getAllocatedBytes() - stranded)
+		{
+			auto fresh = std::make_unique<BasicInterpreter<V>>();
+			if (fresh->loadFile(options.filename))
+			{
+				configure(*fresh, options);
+				interp = std::move(fresh);
+			}
+		}
+
+		const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		std::cerr << "Reloaded \"" << options.filename << "\", " << changed << " lines changed (" << elapsed.count() / 1000.0 << " ms)\n";
+
+		interp->reset();
+		execute(*interp, options);
+
+		// Nothing else would flush it before the process gets killed
+		std::cout.flush();
+	}
+}
+
+
+template <typename V>
+int run(const Options &options)
+{
+	// On the heap, so watch mode can swap it for a new one
+	auto interp = std::make_unique<BasicInterpreter<V>>();
+
+	if (options.filename == "-")
+	{
+		if (options.watch)
+		{
+			std::cerr << "Only files can be watched\n";
+			return EXIT_FAILURE;
+		}
+
+		interp->loadStream(std::cin);
+	}
+	else if (!interp->loadFile(options.filename))
+	{
+		std::cerr << "File \"" << options.filename << "\" was not found\n";
+		return EXIT_FAILURE;
+	}
+
+	// Optimized programs share slots between variables, a reload can't keep those
+	if (options.optimize && options.watch)
+	{
+		std::cerr << "Watched programs can't be optimized, running as is\n";
+	}
+	else if (options.optimize && !interp->optimize())
+	{
+		std::cerr << "Streamed programs can't be optimized, running as is\n";
+	}
+	else if (options.optimize)
+	{
+		const OptimizationReport &report = interp->getOptimizationReport();
+		std::cerr << "Optimizer eliminated " << report.eliminated << " of " << report.lines << " lines ("
+			<< report.folded_branches << " branches and " << report.folded_compares << " comparisons folded, "
+			<< report.unchecked << " overflow checks dropped, " << report.variables << " variables in "
+			<< report.slots << " slots)\n";
+	}
+
+	configure(*interp, options);
+
+	const int status = execute(*interp, options);
+	return options.watch ? watch(std::move(interp), options) : status;
+}
+
+
+bool readWhole(const std::string &filename, std::string &contents)
+{
+	std::ifstream file;
+	if (filename != "-")
+	{
+		file.open(filename, std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cerr << "File \"" << filename << "\" was not found\n";
+			return false;
+		}
+	}
+
+	std::ostringstream buffer;
+	buffer << (filename == "-" ? std::cin.rdbuf() : file.rdbuf());
+	contents = buffer.str();
+	return true;
+}
+
+
+int serve(const Options &options)
+{
+	Daemon daemon(options.daemon_socket, options.threads);
+	if (!daemon.start())
+	{
+		std::cerr << "Could not listen on \"" << options.daemon_socket << "\"\n";
+		return EXIT_FAILURE;
+	}
+
+	if (options.metrics_file.empty())
+	{
+		daemon.serve();
+		return EXIT_SUCCESS;
+	}
+
+	// The daemon runs until it's killed, so the metrics are written periodically
+	std::mutex mutex;
+	std::condition_variable stopped;
+	bool done = false;
+	std::thread exporter([&] {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!stopped.wait_for(lock, std::chrono::seconds(options.metrics_interval), [&] { return done; }))
+		{
+			if (!daemon.getMetrics().save(options.metrics_file))
+			{
+				std::cerr << "Could not write \"" << options.metrics_file << "\"\n";
+			}
+		}
+	});
+
+	daemon.serve();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		done = true;
+	}
+
+	stopped.notify_one();
+	exporter.join();
+
+	return daemon.getMetrics().save(options.metrics_file) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+int connectTo(const Options &options)
+{
+	const char *value_types[] = { "int32", "int64", "checked" };
+
+	DaemonRequest request;
+	request.value_type = value_types[options.value_type];
+	request.max_steps = options.max_steps;
+	request.max_time = options.max_time;
+	request.detect_loops = options.detect_loops;
+
+	if (!readWhole(options.filename, request.program) ||
+		(!options.input_file.empty() && !readWhole(options.input_file, request.input)))
+	{
+		return EXIT_FAILURE;
+	}
+
+	DaemonResponse response;
+	if (!sendRequest(options.connect_socket, request, std::cout, response))
+	{
+		std::cerr << "No answer from daemon at \"" << options.connect_socket << "\"\n";
+		return EXIT_FAILURE;
+	}
+
+	reportStatus(response.status, response.line, response.error_info);
+	return response.status;
+}
+
+
+int main(int argc, char **argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!options.daemon_socket.empty())
+	{
+		return serve(options);
+	}
+
+	if (!options.connect_socket.empty())
+	{
+		return connectTo(options);
+	}
+
+	// The value type is picked once here, everything below runs a dedicated instantiation
+	switch (options.value_type)
+	{
+	case Options::ValueType::INT64: return run<Int64Value>(options);
+	case Options::ValueType::CHECKED: return run<CheckedInt64Value>(options);
+	default: return run<Int32Value>(options);
+	}
+}
+
+#elif defined(_TESTS)
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
 #include <fstream>
+#include <sstream>
+#include <thread>
 #include "Lexer.hpp"
+#include "optimizer.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 
 std::vector<std::vector<Lexer::Token>> tokenize_file(const std::string &filename)
@@ -213,6 +708,71 @@ TEST_CASE("Corner case tests", "[Lexer]")
 	REQUIRE(l15.next() == Lexer::Token::STRING);
 }
 
+TEST_CASE("Generated lexer tests", "[Lexer]")
+{
+	// Fields are glued from pieces that sit on the edges of some token
+	const std::vector<std::string> pieces{
+		"NOP", "JUMP", "JUMPT", "JUMPF", "READ", "READA", "WRITE", "WRITEA", "ARRAY", "FILL", "SUM",
+		"GET", "SET", "VADD", "VMUL", "VLT", "VGT", "VLTE", "VGTE", "VEQ", "V", "NO", "JUM", "REA",
+		"=", "==", "+", "-", "*", "<", ">", "<=", ">=", "!", "_", "(", "0", "1", "42", "-7",
+		"9223372036854775807", "9223372036854775808", "-9223372036854775808", "99999999999999999999",
+		"a", "x", "z", "Q", "i1", "\xe9", "\x7f", " ", "\t", ","
+	};
+
+	auto same = [](const std::string &line) -> bool {
+		Lexer generated(line), reference(line);
+		while (true)
+		{
+			const Lexer::Token t = generated.next();
+			if (t != reference.nextReference())
+			{
+				return false;
+			}
+
+			if (t == Lexer::Token::EOL)
+			{
+				return true;
+			}
+
+			if (t == Lexer::Token::NUMBER ? generated.num() != reference.num() : generated.str() != reference.str())
+			{
+				return false;
+			}
+		}
+	};
+
+	// Every pair, then random lines
+	for (const std::string &a : pieces)
+	{
+		for (const std::string &b : pieces)
+		{
+			REQUIRE(same(a + b));
+			REQUIRE(same(a + "," + b));
+		}
+	}
+
+	uint32_t seed = 12345;
+	for (size_t i = 0; i < 20000; i++)
+	{
+		std::string line;
+		seed = seed * 1664525 + 1013904223;
+		for (size_t n = seed >> 29; n > 0; n--)
+		{
+			seed = seed * 1664525 + 1013904223;
+			line += pieces[(seed >> 8) % pieces.size()];
+		}
+
+		INFO(line);
+		REQUIRE(same(line));
+	}
+
+	// Names of the pseudo tokens were matched as tokens by the old lexer
+	Lexer l1("(NUMBER),(EOL)");
+	REQUIRE(l1.next() == Lexer::Token::STRING);
+	REQUIRE(l1.next() == Lexer::Token::STRING);
+	REQUIRE(l1.next() == Lexer::Token::EOL);
+}
+
 TEST_CASE("= tests", "[interpreter]")
 {
 	Interpreter interp;
@@ -604,6 +1164,7 @@ TEST_CASE("Instruction tests", "[interpreter]")
 	i5.loadLine("=,i,10");
 	i5.loadLine("JUMP,i");
 	REQUIRE(i5.execute() == Interpreter::Status::INVALID_OPERATOR);
+	REQUIRE(i5.getErrorInfo() == "expected: (NUMBER), got: (VARIABLE) = i");
 
 	Interpreter i6;
 	i6.loadLine("=,i,j");
@@ -613,4 +1174,1143 @@ TEST_CASE("Instruction tests", "[interpreter]")
 	*/
 }
 
+TEST_CASE("Stream tests", "[interpreter]")
+{
+	// Program arrives through a stream and is only read as far as execution needs
+	std::istringstream src1("=,i,10\n\n+,i,5,i\nJUMP,5\n=,x,1\n=,j,i\n");
+	Interpreter i1;
+	REQUIRE(i1.loadStream(src1));
+	REQUIRE(i1.execute() == Interpreter::Status::OK);
+	int i, j, x;
+	REQUIRE(i1.getVar("i", i));
+	REQUIRE(i1.getVar("j", j));
+	REQUIRE(!i1.getVar("x", x));
+	REQUIRE(i == 15);
+	REQUIRE(j == 15);
+
+	// Execution stops at the failing line, so nothing after it is consumed
+	std::istringstream src2("=,i,10\n==,j,i,k\n=,i,20\n");
+	Interpreter i2;
+	REQUIRE(i2.loadStream(src2));
+	REQUIRE(i2.execute() == Interpreter::Status::VARIABLE_DOESNT_EXIST);
+	REQUIRE(i2.getLineNumber() == 2);
+	std::string rest;
+	REQUIRE(std::getline(src2, rest));
+	REQUIRE(rest == "=,i,20");
+
+	// Jump target never arrives
+	std::istringstream src3("=,i,10\nJUMP,10\nNOP\n");
+	Interpreter i3;
+	REQUIRE(i3.loadStream(src3));
+	REQUIRE(i3.execute() == Interpreter::Status::INVALID_JUMP);
+	REQUIRE(i3.getErrorInfo() == "10");
+}
+
+TEST_CASE("Input/output tests", "[interpreter]")
+{
+	std::istringstream in("abc\n5\n");
+	std::ostringstream out;
+
+	Interpreter i1;
+	i1.setInput(in);
+	i1.setOutput(out);
+	i1.loadLine("READ,i");
+	i1.loadLine("*,i,2,i");
+	i1.loadLine("WRITE,i");
+	REQUIRE(i1.execute() == Interpreter::Status::OK);
+	REQUIRE(out.str().find("Invalid input") != std::string::npos);
+	REQUIRE(out.str().find("Value of variable \"i\": 10") != std::string::npos);
+
+	std::istringstream empty;
+	Interpreter i2;
+	i2.setInput(empty);
+	i2.setOutput(out);
+	i2.loadLine("READ,i");
+	REQUIRE(i2.execute() == Interpreter::Status::END_OF_INPUT);
+	REQUIRE(i2.getErrorInfo() == "i");
+}
+
+TEST_CASE("Tiering tests", "[interpreter]")
+{
+	const std::vector<std::string> sum{
+		"=,i,0",
+		"=,s,0",
+		"+,s,i,s",
+		"+,i,1,i",
+		"<,i,101,c",
+		"JUMPT,c,3",
+		"-,s,5050,d"
+	};
+
+	// Same result no matter when (or if) the loop gets compiled
+	for (size_t threshold : { 0, 1, 2, 50 })
+	{
+		Interpreter interp;
+		interp.setHotThreshold(threshold);
+		for (const std::string &l : sum)
+		{
+			interp.loadLine(l);
+		}
+
+		REQUIRE(interp.execute() == Interpreter::Status::OK);
+		REQUIRE((interp.getCompiledBlockCount() > 0) == (threshold != 0));
+
+		int s, d;
+		REQUIRE(interp.getVar("s", s));
+		REQUIRE(interp.getVar("d", d));
+		REQUIRE(s == 5050);
+		REQUIRE(d == 0);
+	}
+
+	// Errors after the loop got hot are still reported by the plain interpreter
+	Interpreter i1;
+	i1.setHotThreshold(1);
+	i1.loadLine("=,i,0");
+	i1.loadLine("+,i,1,i");
+	i1.loadLine("==,i,60,c");
+	i1.loadLine("JUMPT,c,6");
+	i1.loadLine("JUMP,2");
+	i1.loadLine("==,q,1,k");
+	REQUIRE(i1.execute() == Interpreter::Status::VARIABLE_DOESNT_EXIST);
+	REQUIRE(i1.getLineNumber() == 6);
+	REQUIRE(i1.getErrorInfo() == "q");
+
+	Interpreter i2;
+	i2.setHotThreshold(1);
+	i2.loadLine("=,i,0");
+	i2.loadLine("+,i,1,i");
+	i2.loadLine("==,i,60,c");
+	i2.loadLine("JUMPT,c,100");
+	i2.loadLine("JUMP,2");
+	REQUIRE(i2.execute() == Interpreter::Status::INVALID_JUMP);
+	REQUIRE(i2.getLineNumber() == 4);
+	REQUIRE(i2.getErrorInfo() == "100");
+	int i;
+	REQUIRE(i2.getVar("i", i));
+	REQUIRE(i == 60);
+}
+
+TEST_CASE("Value type tests", "[interpreter]")
+{
+	const std::vector<std::string> program{
+		"=,i,2147483647",
+		"+,i,1,j",
+		"*,i,i,k",
+		"-,-2147483648,1,l"
+	};
+
+	for (size_t threshold : { 0, 1 })
+	{
+		// 32-bit wraps around
+		Interpreter i1;
+		i1.setHotThreshold(threshold);
+		for (const std::string &l : program)
+		{
+			i1.loadLine(l);
+		}
+
+		REQUIRE(i1.execute() == Interpreter::Status::OK);
+		int j, k, l;
+		REQUIRE(i1.getVar("j", j));
+		REQUIRE(i1.getVar("k", k));
+		REQUIRE(i1.getVar("l", l));
+		REQUIRE(j == -2147483647 - 1);
+		REQUIRE(k == 1);
+		REQUIRE(l == 2147483647);
+
+		// 64-bit has room for all of it
+		BasicInterpreter<Int64Value> i2;
+		i2.setHotThreshold(threshold);
+		for (const std::string &l : program)
+		{
+			i2.loadLine(l);
+		}
+
+		REQUIRE(i2.execute() == Interpreter::Status::OK);
+		int64_t j64, k64, l64;
+		REQUIRE(i2.getVar("j", j64));
+		REQUIRE(i2.getVar("k", k64));
+		REQUIRE(i2.getVar("l", l64));
+		REQUIRE(j64 == 2147483648LL);
+		REQUIRE(k64 == 4611686014132420609LL);
+		REQUIRE(l64 == -2147483649LL);
+	}
+
+	BasicInterpreter<CheckedInt64Value> i3;
+	i3.loadLine("=,i,9223372036854775807");
+	i3.loadLine("-,0,i,j");
+	i3.loadLine("-,j,1,k");
+	i3.loadLine("-,k,1,l");
+	REQUIRE(i3.execute() == Interpreter::Status::ARITHMETIC_OVERFLOW);
+	REQUIRE(i3.getLineNumber() == 4);
+	REQUIRE(i3.getErrorInfo() == "-9223372036854775808 - 1");
+
+	// Overflow inside a compiled loop is reported on the line that caused it
+	BasicInterpreter<CheckedInt64Value> i4;
+	i4.setHotThreshold(1);
+	i4.loadLine("=,i,1");
+	i4.loadLine("*,i,3,i");
+	i4.loadLine("JUMP,2");
+	REQUIRE(i4.execute() == Interpreter::Status::ARITHMETIC_OVERFLOW);
+	REQUIRE(i4.getLineNumber() == 2);
+	REQUIRE(i4.getCompiledBlockCount() > 0);
+	int64_t i;
+	REQUIRE(i4.getVar("i", i));
+	REQUIRE(i == 4052555153018976267LL);
+}
+
+template <typename I>
+void loadArrayProgram(I &interp)
+{
+	// 19 elements, so the SIMD kernels also go through their scalar tails
+	interp.loadLine("ARRAY,a,19");
+	interp.loadLine("ARRAY,b,19");
+	interp.loadLine("=,i,0");
+	interp.loadLine("SET,a,i,i");
+	interp.loadLine("-,10,i,x");
+	interp.loadLine("SET,b,i,x");
+	interp.loadLine("+,i,1,i");
+	interp.loadLine("<,i,19,c");
+	interp.loadLine("JUMPT,c,4");
+	interp.loadLine("VADD,a,b,sum");
+	interp.loadLine("VMUL,a,b,prod");
+	interp.loadLine("VLT,a,b,lt");
+	interp.loadLine("VGT,a,b,gt");
+	interp.loadLine("VLTE,a,b,lte");
+	interp.loadLine("VGTE,a,b,gte");
+	interp.loadLine("VEQ,a,b,eq");
+	interp.loadLine("SUM,prod,total");
+	interp.loadLine("GET,prod,18,last");
+	interp.loadLine("ARRAY,f,7");
+	interp.loadLine("FILL,f,-3");
+	interp.loadLine("SUM,f,ftotal");
+}
+
+template <typename I>
+void checkArrayProgram(I &interp)
+{
+	typedef typename std::remove_reference<decltype(interp)>::type::T T;
+
+	REQUIRE(interp.execute() == Interpreter::Status::OK);
+
+	std::vector<T> sum, prod, lt, gt, lte, gte, eq, f;
+	REQUIRE(interp.getArray("sum", sum));
+	REQUIRE(interp.getArray("prod", prod));
+	REQUIRE(interp.getArray("lt", lt));
+	REQUIRE(interp.getArray("gt", gt));
+	REQUIRE(interp.getArray("lte", lte));
+	REQUIRE(interp.getArray("gte", gte));
+	REQUIRE(interp.getArray("eq", eq));
+	REQUIRE(interp.getArray("f", f));
+	REQUIRE(sum.size() == 19);
+	REQUIRE(f == std::vector<T>(7, -3));
+
+	T expected_total = 0;
+	for (T i = 0; i < 19; i++)
+	{
+		const T a = i, b = 10 - i;
+		REQUIRE(sum[i] == 10);
+		REQUIRE(prod[i] == a * b);
+		REQUIRE(lt[i] == (a < b));
+		REQUIRE(gt[i] == (a > b));
+		REQUIRE(lte[i] == (a <= b));
+		REQUIRE(gte[i] == (a >= b));
+		REQUIRE(eq[i] == (a == b));
+		expected_total += a * b;
+	}
+
+	T total, last, ftotal;
+	REQUIRE(interp.getVar("total", total));
+	REQUIRE(interp.getVar("last", last));
+	REQUIRE(interp.getVar("ftotal", ftotal));
+	REQUIRE(total == expected_total);
+	REQUIRE(last == -144);
+	REQUIRE(ftotal == -21);
+}
+
+TEST_CASE("Array tests", "[interpreter]")
+{
+	Interpreter i1;
+	loadArrayProgram(i1);
+	checkArrayProgram(i1);
+
+	BasicInterpreter<Int64Value> i2;
+	loadArrayProgram(i2);
+	checkArrayProgram(i2);
+
+	BasicInterpreter<CheckedInt64Value> i3;
+	loadArrayProgram(i3);
+	checkArrayProgram(i3);
+
+	// Whole array input/output
+	std::istringstream in("1 2 3\n");
+	std::ostringstream out;
+	Interpreter i4;
+	i4.setInput(in);
+	i4.setOutput(out);
+	i4.loadLine("ARRAY,a,3");
+	i4.loadLine("READA,a");
+	i4.loadLine("VMUL,a,a,a");
+	i4.loadLine("WRITEA,a");
+	REQUIRE(i4.execute() == Interpreter::Status::OK);
+	REQUIRE(out.str().find("Enter value for variable \"a[2]\"") != std::string::npos);
+	REQUIRE(out.str().find("Value of variable \"a\": [1, 4, 9]") != std::string::npos);
+
+	Interpreter i5;
+	i5.loadLine("ARRAY,a,3");
+	i5.loadLine("SET,a,3,1");
+	REQUIRE(i5.execute() == Interpreter::Status::INVALID_INDEX);
+	REQUIRE(i5.getLineNumber() == 2);
+	REQUIRE(i5.getErrorInfo() == "a[3]");
+
+	Interpreter i6;
+	i6.loadLine("ARRAY,a,3");
+	i6.loadLine("ARRAY,b,4");
+	i6.loadLine("VADD,a,b,c");
+	REQUIRE(i6.execute() == Interpreter::Status::ARRAY_SIZE_MISMATCH);
+	REQUIRE(i6.getErrorInfo() == "a, b");
+
+	Interpreter i7;
+	i7.loadLine("=,a,3");
+	i7.loadLine("FILL,a,1");
+	REQUIRE(i7.execute() == Interpreter::Status::VARIABLE_DOESNT_EXIST);
+	REQUIRE(i7.getErrorInfo() == "a");
+
+	BasicInterpreter<CheckedInt64Value> i8;
+	i8.loadLine("ARRAY,a,5");
+	i8.loadLine("FILL,a,9223372036854775807");
+	i8.loadLine("VADD,a,a,b");
+	REQUIRE(i8.execute() == Interpreter::Status::ARITHMETIC_OVERFLOW);
+	REQUIRE(i8.getLineNumber() == 3);
+
+	// Sizes past the limit fail before anything is allocated
+	BasicInterpreter<Int64Value> i9;
+	i9.loadLine("ARRAY,a,4000000000000000000");
+	REQUIRE(i9.execute() == Interpreter::Status::INVALID_INDEX);
+	REQUIRE(i9.getErrorInfo() == "a[4000000000000000000]");
+
+	Interpreter i10;
+	i10.loadLine("ARRAY,a," + std::to_string(Interpreter::max_array_length + 1));
+	REQUIRE(i10.execute() == Interpreter::Status::INVALID_INDEX);
+	REQUIRE(i10.getLineNumber() == 1);
+	REQUIRE(i10.getAllocatedBytes() < Interpreter::max_array_length);
+}
+
+
+TEST_CASE("Budget tests", "[interpreter]")
+{
+	// Loop that never repeats a state: i keeps growing
+	const std::vector<std::string> counter{
+		"=,i,0",
+		"+,i,1,i",
+		"JUMP,2"
+	};
+
+	for (size_t threshold : { 0, 1, 50 })
+	{
+		Interpreter interp;
+		interp.setHotThreshold(threshold);
+		interp.setStepBudget(1001);
+		for (const std::string &l : counter)
+		{
+			interp.loadLine(l);
+		}
+
+		REQUIRE(interp.execute() == Interpreter::Status::STEP_BUDGET_EXCEEDED);
+		REQUIRE(interp.getStepCount() == 1001);
+		REQUIRE(interp.getErrorInfo() == "1001");
+
+		int i;
+		REQUIRE(interp.getVar("i", i));
+		REQUIRE(i == 500);
+	}
+
+	Interpreter i1;
+	i1.setTimeBudget(std::chrono::milliseconds(20));
+	i1.setCycleDetection(true);
+	for (const std::string &l : counter)
+	{
+		i1.loadLine(l);
+	}
+	REQUIRE(i1.execute() == Interpreter::Status::TIME_BUDGET_EXCEEDED);
+
+	for (size_t threshold : { 0, 1 })
+	{
+		Interpreter interp;
+		interp.setHotThreshold(threshold);
+		interp.setCycleDetection(true);
+		REQUIRE(interp.loadFile("tests/infinite_loop.txt"));
+		REQUIRE(interp.execute() == Interpreter::Status::INFINITE_LOOP);
+	}
+
+	// Same loop without detection runs into the step budget instead
+	Interpreter i2;
+	i2.setStepBudget(100000);
+	REQUIRE(i2.loadFile("tests/infinite_loop.txt"));
+	REQUIRE(i2.execute() == Interpreter::Status::STEP_BUDGET_EXCEEDED);
+
+	// Input breaks the cycle: the state repeats until READ gets a 1
+	std::istringstream in("0\n0\n0\n0\n0\n0\n0\n0\n1\n");
+	std::ostringstream out;
+	Interpreter i3;
+	i3.setInput(in);
+	i3.setOutput(out);
+	i3.setCycleDetection(true);
+	i3.loadLine("READ,x");
+	i3.loadLine("JUMPF,x,1");
+	REQUIRE(i3.execute() == Interpreter::Status::OK);
+}
+
+
+TEST_CASE("Allocation tests", "[interpreter]")
+{
+	auto allocations = [](size_t iterations, size_t threshold) {
+		Interpreter interp;
+		interp.setHotThreshold(threshold);
+		interp.loadLine("=,i,0");
+		interp.loadLine("ARRAY,a,8");
+		interp.loadLine("ARRAY,b,8");
+		interp.loadLine(" SET, a, 3, i ");
+		interp.loadLine("GET,a,3,x");
+		interp.loadLine("VADD,a,a,b");
+		interp.loadLine("+,i,1,i");
+		interp.loadLine("<,i," + std::to_string(iterations) + ",c");
+		interp.loadLine("JUMPT,c,4");
+		REQUIRE(interp.execute() == Interpreter::Status::OK);
+		return interp.getAllocationCount();
+	};
+
+	// Once every line and variable was seen, running longer allocates nothing
+	for (size_t threshold : { 0, 1, 50 })
+	{
+		const size_t warm = allocations(100, threshold);
+		REQUIRE(warm > 0);
+		REQUIRE(allocations(5000, threshold) == warm);
+	}
+
+	// Arrays go back on every reset, so running again doesn't keep adding to them
+	Interpreter rerun;
+	rerun.setHotThreshold(1);
+	rerun.loadLine("ARRAY,a,100000");
+	rerun.loadLine("=,i,0");
+	rerun.loadLine("SET,a,i,i");
+	rerun.loadLine("+,i,1,i");
+	rerun.loadLine("<,i,1000,c");
+	rerun.loadLine("JUMPT,c,3");
+	REQUIRE(rerun.execute() == Interpreter::Status::OK);
+	const size_t first = rerun.getAllocatedBytes();
+	REQUIRE(first > 100000 * sizeof(int32_t));
+	for (int run = 0; run < 5; run++)
+	{
+		rerun.reset();
+		REQUIRE(rerun.execute() == Interpreter::Status::OK);
+		REQUIRE(rerun.getAllocatedBytes() == first);
+	}
+
+	REQUIRE(rerun.getStrandedBytes() < first / 2);
+}
+
+
+template <typename I>
+InterpreterBase::Status runParity(I &interp, const std::string &input, std::string &output, bool optimize)
+{
+	// Temporaries (mensi, jetonula, half, twice) are dead long before the end
+	const std::vector<std::string> program{
+		"READ,vstup",
+		"=,orig,vstup",
+		"<,vstup,0,mensi",
+		"JUMPF,mensi,6",
+		"*,vstup,-1,vstup",
+		"<,vstup,2,mensi",
+		"JUMPT,mensi,10",
+		"-,vstup,2,vstup",
+		"JUMP,6",
+		"=,unused,orig",
+		"*,orig,2,twice",
+		"-,twice,orig,half",
+		"==,vstup,0,jetonula",
+		"=,status,jetonula",
+		"WRITE,status",
+		"WRITE,half"
+	};
+
+	std::istringstream in(input);
+	std::ostringstream out;
+	interp.setInput(in);
+	interp.setOutput(out);
+	for (const std::string &l : program)
+	{
+		interp.loadLine(l);
+	}
+
+	if (optimize)
+	{
+		REQUIRE(interp.optimize());
+	}
+
+	InterpreterBase::Status status = interp.execute();
+	output = out.str();
+	return status;
+}
+
+
+TEST_CASE("Optimizer tests", "[optimizer]")
+{
+	for (const char *input : { "7\n", "-10\n", "0\n", "1\n" })
+	{
+		for (size_t threshold : { 0, 1 })
+		{
+			std::string plain_out, optimized_out;
+			Interpreter plain, optimized;
+			plain.setHotThreshold(threshold);
+			optimized.setHotThreshold(threshold);
+			REQUIRE(runParity(plain, input, plain_out, false) == Interpreter::Status::OK);
+			REQUIRE(runParity(optimized, input, optimized_out, true) == Interpreter::Status::OK);
+			REQUIRE(plain_out == optimized_out);
+		}
+	}
+
+	// Line 2 of tests/5.txt stores mensi, which is overwritten before anything reads it
+	Interpreter i1;
+	REQUIRE(i1.loadFile("tests/5.txt"));
+	const ProgramLines five{ "READ,vstup", "<,vstup,0,mensi", "JUMPT,vacsi,14", "-,vstup,2,vstup", "<,vstup,0,mensi",
+		"JUMPF,mensi,4", "+,vstup,2,vstup", "==,vstup,0,jetonula", "JUMPF,jetonula,12", "=,status,0", "JUMP,15",
+		"=,status,1", "JUMP,15", "=,status,-1", "WRITE,status", "NOP" };
+	Optimizer<Int32Value> o1(five);
+	o1.run();
+	REQUIRE(o1.deadLines() == std::vector<size_t>{ 1 });
+	REQUIRE(o1.variableCount() == 5);
+	REQUIRE(o1.slotCount() < o1.variableCount());
+
+	// vacsi is read without ever being assigned, so it can't share a slot
+	for (size_t id = 0; id < o1.variableCount(); id++)
+	{
+		if (o1.variableName(id) != "vacsi")
+		{
+			REQUIRE(o1.slotOf(id) != o1.slotOf(2));
+		}
+	}
+
+	// The error it ends with doesn't change
+	std::istringstream in("3\n");
+	std::ostringstream out;
+	i1.setInput(in);
+	i1.setOutput(out);
+	REQUIRE(i1.optimize());
+	REQUIRE(i1.execute() == Interpreter::Status::VARIABLE_DOESNT_EXIST);
+	REQUIRE(i1.getLineNumber() == 3);
+	REQUIRE(i1.getErrorInfo() == "vacsi");
+
+	// Each of 200 chained temporaries dies where the next one is assigned
+	ProgramLines chain({ "=,t0,1" });
+	for (size_t i = 1; i < 200; i++)
+	{
+		chain.emplace_back("+,t" + std::to_string(i - 1) + ",1,t" + std::to_string(i));
+	}
+	chain.push_back("WRITE,t199");
+	Optimizer<Int32Value> o2(chain);
+	o2.run();
+	REQUIRE(o2.variableCount() == 200);
+	REQUIRE(o2.slotCount() == 1);
+	REQUIRE(o2.deadLines().empty());
+
+	// Stores that could fail are kept even when nothing reads them
+	BasicInterpreter<CheckedInt64Value> i2;
+	i2.loadLine("=,x,9223372036854775807");
+	i2.loadLine("+,x,1,y");
+	REQUIRE(i2.optimize());
+	REQUIRE(i2.execute() == Interpreter::Status::ARITHMETIC_OVERFLOW);
+
+	Interpreter i3;
+	i3.loadLine("=,y,q");
+	i3.loadLine("=,y,1");
+	i3.loadLine("WRITE,y");
+	REQUIRE(i3.optimize());
+	REQUIRE(i3.execute() == Interpreter::Status::VARIABLE_DOESNT_EXIST);
+	REQUIRE(i3.getErrorInfo() == "q");
+
+	// Same store without the undefined operand goes away
+	const ProgramLines twice{ "=,y,2", "=,y,1", "WRITE,y" };
+	Optimizer<Int32Value> o3(twice);
+	o3.run();
+	REQUIRE(o3.deadLines() == std::vector<size_t>{ 0 });
+}
+
+
+TEST_CASE("Range analysis tests", "[optimizer]")
+{
+	// The counter stays within [0, 100], the sum isn't bounded
+	const ProgramLines loop{ "=,i,0", "=,s,0", "<,i,100,c", "JUMPF,c,8", "+,s,i,s", "+,i,1,i", "JUMP,3",
+		"<,i,0,neg", "JUMPT,neg,11", "WRITE,s", "WRITE,i" };
+	Optimizer<CheckedInt64Value> o1(loop);
+	o1.run();
+	REQUIRE(o1.uncheckedLines() == std::vector<size_t>{ 5 });
+	REQUIRE(o1.rewrites() == std::vector<std::pair<size_t, std::string>>{ { 7, "=,neg,0" } });
+
+	// The comparison is only read by the branch, so it goes away with it
+	REQUIRE(o1.deadLines() == std::vector<size_t>{ 7, 8 });
+	REQUIRE(o1.report().eliminated == 2);
+	REQUIRE(o1.report().folded_branches == 1);
+	REQUIRE(o1.report().folded_compares == 1);
+	REQUIRE(o1.report().unchecked == 1);
+
+	for (bool optimize : { false, true })
+	{
+		std::ostringstream out;
+		BasicInterpreter<CheckedInt64Value> interp;
+		interp.setOutput(out);
+		interp.setHotThreshold(1);
+		for (const auto &line : loop)
+		{
+			interp.loadLine(std::string(line));
+		}
+
+		REQUIRE((!optimize || interp.optimize()));
+		REQUIRE(interp.execute() == Interpreter::Status::OK);
+		REQUIRE(out.str() == "Value of variable \"s\": 4950\nValue of variable \"i\": 100\n");
+		REQUIRE(interp.getStepCount() == 508);
+		REQUIRE(interp.getOptimizationReport().unchecked == (optimize ? 1 : 0));
+	}
+
+	// Always taken, so the only line that would WRITE x is never reached and
+	// nothing needs x or c anymore
+	const ProgramLines taken{ "=,x,5", ">,x,3,c", "JUMPT,c,5", "WRITE,x", "NOP" };
+	Optimizer<Int32Value> o2(taken);
+	o2.run();
+	REQUIRE(o2.rewrites() == std::vector<std::pair<size_t, std::string>>{ { 1, "=,c,1" }, { 2, "JUMP,5" } });
+	REQUIRE(o2.deadLines() == std::vector<size_t>{ 0, 1 });
+
+	// Values that wrap around are unknown
+	const ProgramLines wraps{ "=,x,2147483647", "+,x,1,x", ">,x,0,c", "JUMPT,c,5", "WRITE,x" };
+	Optimizer<Int32Value> o3(wraps);
+	o3.run();
+	REQUIRE(o3.rewrites().empty());
+	REQUIRE(o3.deadLines().empty());
+
+	// The same in 64 bits doesn't wrap
+	Optimizer<Int64Value> o4(wraps);
+	o4.run();
+	REQUIRE(o4.report().folded_branches == 1);
+}
+
+
+// Runs a program in the plain interpreter and with every block compiled on
+// first entry, everything the program can observe has to come out the same
+template <typename V>
+size_t requireSameRun(const std::vector<std::string> &program, const std::vector<std::string> &names)
+{
+	struct Run
+	{
+		InterpreterBase::Status status;
+		std::string error;
+		size_t line, steps;
+		std::string output;
+		std::vector<std::pair<bool, typename V::type>> variables;
+		Metrics metrics;
+	};
+
+	Run runs[2];
+	size_t unrolled = 0;
+	for (size_t tier = 0; tier < 2; tier++)
+	{
+		BasicInterpreter<V> interp;
+		interp.setHotThreshold(tier);
+		interp.setStepBudget(50000);
+		std::ostringstream out;
+		interp.setOutput(out);
+		for (const std::string &line : program)
+		{
+			interp.loadLine(line);
+		}
+
+		Run &r = runs[tier];
+		r.status = interp.execute();
+		r.error = interp.getErrorInfo();
+		r.line = interp.getLineNumber();
+		r.steps = interp.getStepCount();
+		r.output = out.str();
+		for (const std::string &name : names)
+		{
+			typename V::type value = 0;
+			const bool defined = interp.getVar(name, value);
+			r.variables.emplace_back(defined, value);
+		}
+		r.metrics = interp.getMetrics();
+		unrolled += interp.getUnrolledLoopCount();
+	}
+
+	REQUIRE(runs[0].status == runs[1].status);
+	REQUIRE(runs[0].error == runs[1].error);
+	REQUIRE(runs[0].line == runs[1].line);
+	REQUIRE(runs[0].steps == runs[1].steps);
+	REQUIRE(runs[0].output == runs[1].output);
+	REQUIRE(runs[0].variables == runs[1].variables);
+	REQUIRE(runs[0].metrics.retired == runs[1].metrics.retired);
+	REQUIRE(runs[0].metrics.branches_taken == runs[1].metrics.branches_taken);
+	REQUIRE(runs[0].metrics.branches_not_taken == runs[1].metrics.branches_not_taken);
+	return unrolled;
+}
+
+TEST_CASE("Loop optimizer tests", "[optimizer]")
+{
+	// Sum of i * 3 over a counted loop, the multiply is strength reduced
+	const std::vector<std::string> sum{
+		"=,i,0",
+		"=,s,0",
+		"*,i,3,x",
+		"+,s,x,s",
+		"+,i,1,i",
+		"<,i,1001,c",
+		"JUMPT,c,3"
+	};
+	const std::vector<std::string> names{ "i", "s", "x", "c" };
+
+	REQUIRE(requireSameRun<Int32Value>(sum, names) == 1);
+	REQUIRE(requireSameRun<CheckedInt64Value>(sum, names) == 1);
+
+	Interpreter i1;
+	i1.setHotThreshold(1);
+	for (const std::string &line : sum)
+	{
+		i1.loadLine(line);
+	}
+	REQUIRE(i1.execute() == Interpreter::Status::OK);
+	int s;
+	REQUIRE(i1.getVar("s", s));
+	REQUIRE(s == 3 * 1000 * 1001 / 2);
+
+	// Small loop after a constant initialization is unrolled as a whole
+	const std::vector<std::string> nested{
+		"=,o,0",
+		"=,s,0",
+		"=,j,0",
+		"*,j,o,x",
+		"+,s,x,s",
+		"+,j,2,j",
+		">=,j,7,c",
+		"JUMPF,c,4",
+		"+,o,1,o",
+		"<,o,50,d",
+		"JUMPT,d,3"
+	};
+	REQUIRE(requireSameRun<Int64Value>(nested, { "o", "s", "j", "x", "c", "d" }) == 1);
+
+	// Overflow in the middle of an unrolled run, in a reduced multiply and in the increment
+	REQUIRE(requireSameRun<CheckedInt64Value>({
+		"=,i,0", "=,x,0", "*,i,1000000000000000000,x", "+,i,1,i", "<,i,100,c", "JUMPT,c,3"
+	}, { "i", "x" }) == 1);
+	REQUIRE(requireSameRun<CheckedInt64Value>({
+		"=,i,9223372036854775000", "+,i,100,i", "<,i,0,c", "JUMPF,c,2"
+	}, { "i", "c" }) == 1);
+
+	// WRITE inside the body and the compare result read before the next test
+	REQUIRE(requireSameRun<Int32Value>({
+		"=,s,0", "=,c,0", "=,i,20", "+,s,c,s", "WRITE,i", "-,i,3,i", ">,i,0,c", "JUMPT,c,4"
+	}, { "i", "c", "s" }) == 1);
+
+	// Loops that never leave run into the step budget the same way
+	REQUIRE(requireSameRun<Int32Value>({ "=,i,0", "+,i,1,i", "<,i,0,c", "JUMPF,c,2" }, { "i" }) == 1);
+
+	// Not loops of the supported shape: two stores to the tested variable, a test
+	// of something that isn't counted
+	REQUIRE(requireSameRun<Int32Value>({ "=,i,0", "+,i,1,i", "+,i,1,i", "<,i,100,c", "JUMPT,c,2" }, { "i" }) == 0);
+	REQUIRE(requireSameRun<Int32Value>({ "=,i,1", "*,i,2,i", "<,i,1000,c", "JUMPT,c,2" }, { "i" }) == 0);
+
+	// Generated loops: counting up or down by different steps, tested every way
+	// against a literal or a variable, with multiplies by the induction variable
+	uint32_t seed = 4242;
+	auto random = [&seed](uint32_t n) -> int {
+		seed = seed * 1664525 + 1013904223;
+		return static_cast<int>((seed >> 8) % n);
+	};
+
+	size_t unrolled = 0;
+	for (size_t n = 0; n < 300; n++)
+	{
+		const int step = (random(2) ? 1 : -1) * (1 + random(3));
+		const int init = random(40) - 20;
+		const int trips = random(12);
+		const int limit = init + step * trips;
+		const bool up = step > 0;
+		const std::string bound = random(2) ? std::to_string(limit) : "n";
+		const std::string factor = std::to_string(random(2) ? random(7) - 3 : 1000000007);
+
+		// The same exit test written in several ways
+		std::string test, branch;
+		switch (random(5))
+		{
+		case 0: test = std::string(up ? "<," : ">,") + "i," + bound; branch = "JUMPT"; break;
+		case 1: test = std::string(up ? ">=," : "<=,") + "i," + bound; branch = "JUMPF"; break;
+		case 2: test = std::string(up ? ">," : "<,") + bound + ",i"; branch = "JUMPT"; break;
+		case 3: test = std::string(up ? "<=," : ">=,") + "i," + std::to_string(limit - step / (step < 0 ? -step : step)); branch = "JUMPT"; break;
+		default: test = "==,i," + bound; branch = "JUMPF"; break;
+		}
+
+		std::vector<std::string> program{
+			"=,n," + std::to_string(limit),
+			"=,s,0",
+			"=,o,0",
+			"=,c,0",
+			"=,i," + std::to_string(init)
+		};
+
+		const size_t head = program.size() + 1;
+		if (random(2))
+		{
+			program.push_back("*,i," + factor + ",x");
+		}
+		else
+		{
+			program.push_back("*," + factor + ",i,x");
+		}
+		program.push_back("+,s,x,s");
+		if (random(3) == 0)
+		{
+			program.push_back("WRITE,x");
+		}
+		if (random(3) == 0)
+		{
+			program.push_back("+,s,c,s");
+		}
+		switch (random(3))
+		{
+		case 0: program.push_back("+,i," + std::to_string(step) + ",i"); break;
+		case 1: program.push_back("+," + std::to_string(step) + ",i,i"); break;
+		default: program.push_back("-,i," + std::to_string(-step) + ",i"); break;
+		}
+		program.push_back(test + ",c");
+		program.push_back(branch + ",c," + std::to_string(head));
+		program.push_back("+,o,1,o");
+		program.push_back("<,o," + std::to_string(1 + random(4)) + ",d");
+		program.push_back("JUMPT,d," + std::to_string(head - 1));
+
+		INFO(n);
+		const std::vector<std::string> names{ "n", "s", "o", "c", "i", "x", "d" };
+		unrolled += requireSameRun<Int32Value>(program, names);
+		unrolled += requireSameRun<Int64Value>(program, names);
+		unrolled += requireSameRun<CheckedInt64Value>(program, names);
+	}
+
+	// Most of them are unrolled
+	REQUIRE(unrolled > 600);
+}
+
+
+TEST_CASE("Reload tests", "[interpreter]")
+{
+	Interpreter interp;
+	interp.setHotThreshold(1);
+
+	std::istringstream program("READ,n\n=,i,0\n=,s,0\n+,i,1,i\n+,s,i,s\n<,i,n,c\nJUMPT,c,4\nWRITE,s\n");
+	REQUIRE(interp.reload(program) == 8);
+
+	std::istringstream in1("10\n");
+	std::ostringstream out1;
+	interp.setInput(in1);
+	interp.setOutput(out1);
+	REQUIRE(interp.execute() == Interpreter::Status::OK);
+	REQUIRE(out1.str() == "Enter value for variable \"n\": Value of variable \"s\": 55\n");
+	const size_t compiled = interp.getCompiledBlockCount();
+
+	// Whitespace doesn't count as a change. The loop's block at line 4 covers
+	// line 5 and gets compiled again, the ones at lines 1 and 8 are kept.
+	std::istringstream edited("READ, n\n=,i,0\n=,s,0\n+,i,1,i\n+,s,2,s\n<,i,n,c\nJUMPT,c,4\n  WRITE,s\n\n");
+	REQUIRE(interp.reload(edited) == 1);
+	interp.reset();
+
+	std::istringstream in2("10\n");
+	std::ostringstream out2;
+	interp.setInput(in2);
+	interp.setOutput(out2);
+	REQUIRE(interp.execute() == Interpreter::Status::OK);
+	REQUIRE(out2.str() == "Enter value for variable \"n\": Value of variable \"s\": 20\n");
+	REQUIRE(interp.getCompiledBlockCount() == compiled + 1);
+	REQUIRE(interp.getStepCount() == 44);
+
+	// The recompiled loop's old code is freed, reloading the same text again isn't
+	const size_t stranded = interp.getStrandedBytes();
+	REQUIRE(stranded > 0);
+	std::istringstream same("READ, n\n=,i,0\n=,s,0\n+,i,1,i\n+,s,2,s\n<,i,n,c\nJUMPT,c,4\n  WRITE,s\n\n");
+	REQUIRE(interp.reload(same) == 0);
+	REQUIRE(interp.getStrandedBytes() == stranded);
+
+	// A kept block reading a variable the new program never assigns
+	Interpreter i2;
+	i2.setHotThreshold(1);
+	std::ostringstream out;
+	i2.setOutput(out);
+	std::istringstream p1("=,x,1\nJUMP,3\nWRITE,x\n");
+	i2.reload(p1);
+	REQUIRE(i2.execute() == Interpreter::Status::OK);
+
+	std::istringstream p2("=,y,1\nJUMP,3\nWRITE,x\n");
+	REQUIRE(i2.reload(p2) == 1);
+	i2.reset();
+	REQUIRE(i2.execute() == Interpreter::Status::VARIABLE_DOESNT_EXIST);
+	REQUIRE(i2.getLineNumber() == 3);
+	REQUIRE(i2.getErrorInfo() == "x");
+
+	// Removed lines count as changed, and jumps to them fail like in a fresh load
+	std::istringstream p3("=,y,1\nJUMP,3\n");
+	REQUIRE(i2.reload(p3) == 1);
+	i2.reset();
+
+	Interpreter fresh;
+	fresh.loadLine("=,y,1");
+	fresh.loadLine("JUMP,3");
+	REQUIRE(i2.execute() == fresh.execute());
+	REQUIRE(i2.getLineNumber() == fresh.getLineNumber());
+}
+
+
+TEST_CASE("Metrics tests", "[interpreter]")
+{
+	// Both tiers count the same, including a run that fails inside a compiled block
+	const std::vector<std::string> program{
+		"READ,n",
+		"=,i,0",
+		"+,i,1,i",
+		"<,i,n,c",
+		"JUMPT,c,3",
+		"",
+		"READ,n",
+		"WRITE,n"
+	};
+
+	std::vector<Metrics> metrics;
+	for (size_t threshold : { 0, 1 })
+	{
+		Interpreter interp;
+		interp.setHotThreshold(threshold);
+		std::ostringstream out;
+		interp.setOutput(out);
+		for (const std::string &line : program)
+		{
+			interp.loadLine(line);
+		}
+
+		std::istringstream in1("10\n7\n");
+		interp.setInput(in1);
+		REQUIRE(interp.execute() == Interpreter::Status::OK);
+
+		interp.reset();
+		std::istringstream in2("10\n");
+		interp.setInput(in2);
+		REQUIRE(interp.execute() == Interpreter::Status::END_OF_INPUT);
+
+		metrics.push_back(interp.getMetrics());
+	}
+
+	const Metrics &m = metrics[0];
+	REQUIRE(m.retired == metrics[1].retired);
+	REQUIRE(m.branches_taken == metrics[1].branches_taken);
+	REQUIRE(m.branches_not_taken == metrics[1].branches_not_taken);
+
+	REQUIRE(m.retired[Lexer::Token::READ] == 3);
+	REQUIRE(m.retired[Lexer::Token::ADD] == 20);
+	REQUIRE(m.retired[Lexer::Token::JUMPT] == 20);
+	REQUIRE(m.retired[Lexer::Token::NOP] == 2);
+	REQUIRE(m.retired[Lexer::Token::WRITE] == 1);
+	REQUIRE(m.branches_taken == 18);
+	REQUIRE(m.branches_not_taken == 2);
+	REQUIRE(m.runs == 2);
+	REQUIRE(m.results[Interpreter::Status::OK] == 1);
+	REQUIRE(m.results[Interpreter::Status::END_OF_INPUT] == 1);
+	REQUIRE(m.variables == 3);
+
+	std::ostringstream prometheus;
+	m.writePrometheus(prometheus);
+	REQUIRE(prometheus.str().find("interpreter_instructions_retired_total{opcode=\"ADD\"} 20\n") != std::string::npos);
+	REQUIRE(prometheus.str().find("interpreter_branches_total{taken=\"true\"} 18\n") != std::string::npos);
+	REQUIRE(prometheus.str().find("interpreter_runs_total 2\n") != std::string::npos);
+	REQUIRE(prometheus.str().find("interpreter_errors_total{status=\"END_OF_INPUT\"} 1\n") != std::string::npos);
+	REQUIRE(prometheus.str().find("status=\"OK\"") == std::string::npos);
+
+	std::ostringstream json;
+	m.writeJson(json);
+	REQUIRE(json.str().find("\"runs\": 2,") != std::string::npos);
+	REQUIRE(json.str().find("\"branches\": { \"taken\": 18, \"not_taken\": 2 }") != std::string::npos);
+	REQUIRE(json.str().find("\"END_OF_INPUT\": 1") != std::string::npos);
+
+	Metrics total;
+	total.merge(metrics[0]);
+	total.merge(metrics[1]);
+	REQUIRE(total.runs == 4);
+	REQUIRE(total.retired[Lexer::Token::ADD] == 40);
+}
+
+
+TEST_CASE("Record/replay tests", "[interpreter]")
+{
+	const std::vector<std::string> program{
+		"READ,n",
+		"=,i,0",
+		"READ,x",
+		"*,x,-3,x",
+		"WRITE,x",
+		"+,i,1,i",
+		"<,i,n,c",
+		"JUMPT,c,3",
+		"ARRAY,a,2",
+		"FILL,a,x",
+		"WRITEA,a"
+	};
+
+	std::istringstream in("20\n1\n2\n3\n4\n5\n6\n7\n8\n9\n10\n11\n12\n13\n14\n15\n16\n17\n18\n19\n1000000\n");
+	std::ostringstream out;
+	SessionLog recording;
+	Interpreter i1;
+	i1.setHotThreshold(2);
+	i1.setInput(in);
+	i1.setOutput(out);
+	i1.setRecording(&recording);
+	for (const std::string &l : program)
+	{
+		i1.loadLine(l);
+	}
+	REQUIRE(i1.execute() == Interpreter::Status::OK);
+	REQUIRE(recording.size() == 1 + 20 * 2 + 2);
+	REQUIRE(recording[0].kind == SessionLog::READ);
+	REQUIRE(recording[0].line == 1);
+	REQUIRE(recording[4].kind == SessionLog::WRITE);
+	REQUIRE(recording[4].line == 5);
+	REQUIRE(recording[4].value == -6);
+
+	std::stringstream file;
+	REQUIRE(recording.write(file));
+	SessionLog log;
+	REQUIRE(log.read(file));
+	REQUIRE(log.size() == recording.size());
+	REQUIRE(log[40].value == -3000000);
+
+	// Replay needs no input and succeeds on both tiers
+	for (size_t threshold : { 0, 1 })
+	{
+		std::ostringstream replay_out;
+		log.rewind();
+		Interpreter interp;
+		interp.setHotThreshold(threshold);
+		interp.setOutput(replay_out);
+		interp.setReplay(&log);
+		for (const std::string &l : program)
+		{
+			interp.loadLine(l);
+		}
+		REQUIRE(interp.execute() == Interpreter::Status::OK);
+		REQUIRE(log.remaining() == 0);
+	}
+
+	// A changed program is caught at the first differing WRITE
+	log.rewind();
+	std::ostringstream changed_out;
+	Interpreter i2;
+	i2.setOutput(changed_out);
+	i2.setReplay(&log);
+	for (const std::string &l : program)
+	{
+		i2.loadLine(l == "*,x,-3,x" ? "*,x,3,x" : l);
+	}
+	REQUIRE(i2.execute() == Interpreter::Status::REPLAY_MISMATCH);
+	REQUIRE(i2.getLineNumber() == 5);
+	REQUIRE(i2.getErrorInfo() == "got WRITE 3, log has WRITE -3 on line 5");
+
+	// Stopping early leaves values in the log
+	log.rewind();
+	Interpreter i3;
+	i3.setOutput(changed_out);
+	i3.setReplay(&log);
+	i3.loadLine("READ,n");
+	REQUIRE(i3.execute() == Interpreter::Status::REPLAY_MISMATCH);
+	REQUIRE(i3.getErrorInfo() == "42 more values in the log");
+
+	std::istringstream garbage("Z1LGR\x80");
+	REQUIRE(!log.read(garbage));
+	std::istringstream wrong_magic("LOG!");
+	REQUIRE(!log.read(wrong_magic));
+}
+
+
+#ifndef _WIN32
+TEST_CASE("Daemon tests", "[daemon]")
+{
+	const std::string path = "/tmp/zadanie1_test_" + std::to_string(getpid()) + ".sock";
+	Daemon daemon(path, 2);
+	REQUIRE(daemon.start());
+	std::thread server([&daemon] { daemon.serve(); });
+
+	DaemonRequest request;
+	request.program = "READ,i\r\n\n*,i,3,i\nWRITE,i\n";
+	request.input = "14\n";
+
+	// Concurrent clients sending the same program share one cache entry
+	std::vector<std::thread> clients;
+	std::vector<std::string> outputs(8);
+	std::vector<DaemonResponse> responses(8);
+	std::vector<int> answered(8);
+	for (size_t c = 0; c < outputs.size(); c++)
+	{
+		clients.emplace_back([&, c] {
+			std::ostringstream out;
+			answered[c] = sendRequest(path, request, out, responses[c]);
+			outputs[c] = out.str();
+		});
+	}
+	for (std::thread &client : clients)
+	{
+		client.join();
+	}
+
+	for (size_t c = 0; c < outputs.size(); c++)
+	{
+		REQUIRE(answered[c]);
+		REQUIRE(responses[c].status == InterpreterBase::Status::OK);
+		REQUIRE(outputs[c].find("Value of variable \"i\": 42") != std::string::npos);
+	}
+	REQUIRE(daemon.getCachedProgramCount() == 1);
+
+	// The interpreters that ran it stay loaded for the next request
+	const size_t text_bytes = 2 * request.program.size();
+	REQUIRE(daemon.getCachedBytes() > text_bytes);
+	std::ostringstream again;
+	REQUIRE(sendRequest(path, request, again, responses[0]));
+	REQUIRE(again.str() == outputs[0]);
+	REQUIRE(daemon.getCachedProgramCount() == 1);
+	REQUIRE(daemon.getCachedBytes() <= Daemon::max_cache_bytes);
+
+	// Errors come back with the line and details
+	DaemonRequest loop;
+	loop.value_type = "checked";
+	loop.program = "=,i,0\n+,i,1,i\nJUMP,2";
+	loop.max_steps = 101;
+	DaemonResponse response;
+	std::ostringstream out;
+	REQUIRE(sendRequest(path, loop, out, response));
+	REQUIRE(response.status == InterpreterBase::Status::STEP_BUDGET_EXCEEDED);
+	REQUIRE(response.line == 2);
+	REQUIRE(response.error_info == "101");
+	REQUIRE(daemon.getCachedProgramCount() == 2);
+
+	// So do parse errors, they aren't written to the daemon's stderr
+	DaemonRequest broken;
+	broken.program = "+,1,1";
+	REQUIRE(sendRequest(path, broken, out, response));
+	REQUIRE(response.status == InterpreterBase::Status::INVALID_OPERATOR);
+	REQUIRE(response.line == 1);
+	REQUIRE(response.error_info.find("expected: (VARIABLE)") == 0);
+
+	// Every request's counters end up in the daemon's
+	const Metrics metrics = daemon.getMetrics();
+	REQUIRE(metrics.runs == 11);
+	REQUIRE(metrics.retired[Lexer::Token::MULTIPLY] == 9);
+	REQUIRE(metrics.results[InterpreterBase::Status::OK] == 9);
+	REQUIRE(metrics.results[InterpreterBase::Status::STEP_BUDGET_EXCEEDED] == 1);
+
+	loop.value_type = "int128";
+	REQUIRE(!sendRequest(path, loop, out, response));
+
+	daemon.stop();
+	server.join();
+}
+#endif
+
 #endif // _TESTS
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "metrics.hpp"
+#include "interpreter.hpp"
+
+#include <fstream>
+#include <filesystem>
+
+
+static_assert(Metrics::statuses == InterpreterBase::Status::INTERNAL_ERROR + 1, "Metrics::statuses is out of date");
+
+
+namespace
+{
+	// Lexer::token_to_str gives the source syntax ("+", "<="), these are usable as label values
+	const char *const opcode_names[Metrics::opcodes] = {
+		"NOP",
+		"JUMP", "READ", "WRITE",
+		"READA", "WRITEA",
+		"ASSIGN", "JUMPT", "JUMPF",
+		"ARRAY", "FILL", "SUM",
+		"ADD", "SUB", "MULTIPLY",
+		"LT", "GT", "LTE", "GTE", "EQ",
+		"GET", "SET",
+		"VADD", "VMUL",
+		"VLT", "VGT", "VLTE", "VGTE", "VEQ"
+	};
+
+	const char *const status_names[Metrics::statuses] = {
+		"OK",
+		"INVALID_INSTRUCTION",
+		"INVALID_OPERATOR",
+		"VARIABLE_DOESNT_EXIST",
+		"INVALID_JUMP",
+		"END_OF_INPUT",
+		"ARITHMETIC_OVERFLOW",
+		"INVALID_INDEX",
+		"ARRAY_SIZE_MISMATCH",
+		"STEP_BUDGET_EXCEEDED",
+		"TIME_BUDGET_EXCEEDED",
+		"INFINITE_LOOP",
+		"REPLAY_MISMATCH",
+		"INTERNAL_ERROR"
+	};
+}
+
+
+const char *Metrics::opcodeName(size_t opcode)
+{
+	return opcode_names[opcode];
+}
+
+
+const char *Metrics::statusName(size_t status)
+{
+	return status_names[status];
+}
+
+
+void Metrics::merge(const Metrics &other)
+{
+	for (size_t i = 0; i < opcodes; i++)
+	{
+		retired[i] += other.retired[i];
+	}
+
+	branches_taken += other.branches_taken;
+	branches_not_taken += other.branches_not_taken;
+
+	runs += other.runs;
+	for (size_t i = 0; i < statuses; i++)
+	{
+		results[i] += other.results[i];
+	}
+
+	variables = other.variables;
+}
+
+
+void Metrics::writePrometheus(std::ostream &out) const
+{
+	out << "# HELP interpreter_instructions_retired_total Instructions executed, by opcode\n";
+	out << "# TYPE interpreter_instructions_retired_total counter\n";
+	for (size_t i = 0; i < opcodes; i++)
+	{
+		out << "interpreter_instructions_retired_total{opcode=\"" << opcode_names[i] << "\"} " << retired[i] << "\n";
+	}
+
+	out << "# HELP interpreter_branches_total Conditional jumps, by whether they were taken\n";
+	out << "# TYPE interpreter_branches_total counter\n";
+	out << "interpreter_branches_total{taken=\"true\"} " << branches_taken << "\n";
+	out << "interpreter_branches_total{taken=\"false\"} " << branches_not_taken << "\n";
+
+	out << "# HELP interpreter_runs_total Programs executed\n";
+	out << "# TYPE interpreter_runs_total counter\n";
+	out << "interpreter_runs_total " << runs << "\n";
+
+	out << "# HELP interpreter_errors_total Runs that ended with an error, by status\n";
+	out << "# TYPE interpreter_errors_total counter\n";
+	for (size_t i = 1; i < statuses; i++)
+	{
+		out << "interpreter_errors_total{status=\"" << status_names[i] << "\"} " << results[i] << "\n";
+	}
+
+	out << "# HELP interpreter_variables Variables used by the most recent run\n";
+	out << "# TYPE interpreter_variables gauge\n";
+	out << "interpreter_variables " << variables << "\n";
+}
+
+
+void Metrics::writeJson(std::ostream &out) const
+{
+	out << "{\n\t\"runs\": " << runs << ",\n\t\"variables\": " << variables << ",\n";
+	out << "\t\"branches\": { \"taken\": " << branches_taken << ", \"not_taken\": " << branches_not_taken << " },\n";
+
+	out << "\t\"retired\": {";
+	for (size_t i = 0; i < opcodes; i++)
+	{
+		out << (i ? ", " : " ") << "\"" << opcode_names[i] << "\": " << retired[i];
+	}
+
+	out << " },\n\t\"errors\": {";
+	for (size_t i = 1; i < statuses; i++)
+	{
+		out << (i > 1 ? ", " : " ") << "\"" << status_names[i] << "\": " << results[i];
+	}
+
+	out << " }\n}\n";
+}
+
+
+bool Metrics::save(const std::string &filename) const
+{
+	const bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+	const std::string temporary = filename + ".tmp";
+
+	{
+		std::ofstream out(temporary, std::ios::binary);
+		if (!out.is_open())
+		{
+			return false;
+		}
+
+		json ? writeJson(out) : writePrometheus(out);
+		if (!out.good())
+		{
+			return false;
+		}
+	}
+
+	// Unlike std::rename, this replaces an existing file on every platform
+	std::error_code error;
+	std::filesystem::rename(temporary, filename, error);
+	return !error;
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "lexer.hpp"
+
+#include <string>
+#include <array>
+#include <iostream>
+#include <cstdint>
+
+
+// Counters an interpreter keeps about what it executed. They are plain
+// integers owned by one interpreter, so counting is a single increment; a
+// process running many interpreters merges them into one copy after each run
+// (see Daemon) and exports that.
+class Metrics
+{
+public:
+	static const size_t opcodes = Lexer::Token::VEQ + 1;
+	// Same order as InterpreterBase::Status
+	static const size_t statuses = 14;
+
+	// Instructions that completed, indexed by Lexer::Token
+	std::array<uint64_t, opcodes> retired{};
+
+	// JUMPT and JUMPF only, JUMP is always taken
+	uint64_t branches_taken{ 0 };
+	uint64_t branches_not_taken{ 0 };
+
+	uint64_t runs{ 0 };
+	// Runs by the status they ended with, OK included
+	std::array<uint64_t, statuses> results{};
+
+	// Variables (slots) of the most recent run
+	uint64_t variables{ 0 };
+
+	void merge(const Metrics &other);
+
+	// Prometheus text format (what node_exporter's textfile collector reads)
+	void writePrometheus(std::ostream &out) const;
+	void writeJson(std::ostream &out) const;
+
+	// JSON for *.json, Prometheus text otherwise. Written to a temporary file
+	// that replaces the old one, so readers never see half a file.
+	bool save(const std::string &filename) const;
+
+	static const char *opcodeName(size_t opcode);
+	static const char *statusName(size_t status);
+};
\ No newline at end of file
@@ -0,0 +1,1004 @@
+#include "optimizer.hpp"
+#include "valuetypes.hpp"
+
+#include <algorithm>
+#include <limits>
+
+
+namespace
+{
+	typedef std::vector<uint64_t> Bits;
+
+	bool test(const Bits &bits, size_t i) { return (bits[i / 64] >> (i % 64)) & 1; }
+	void set(Bits &bits, size_t i) { bits[i / 64] |= uint64_t(1) << (i % 64); }
+	void reset(Bits &bits, size_t i) { bits[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+
+	// A loop grows a bound by one step per iteration, so after this many changes
+	// the bounds at a join point jump straight to the limits of the value type
+	const size_t widen_after = 8;
+
+	// Passes taking back what widening overshot
+	const size_t narrow_passes = 4;
+}
+
+
+template <typename V>
+Optimizer<V>::Optimizer(const ProgramLines &lines) :
+	m_lines{ lines }
+{
+	;
+}
+
+
+template <typename V>
+void Optimizer<V>::run()
+{
+	m_code.assign(m_lines.size(), Line());
+	for (size_t i = 0; i < m_lines.size(); i++)
+	{
+		// A line that doesn't decode stops the program with an error, so nothing follows it
+		if (!decode(i, m_code[i]))
+		{
+			m_code[i] = Line();
+		}
+	}
+
+	definiteAssignment();
+	ranges();
+	fold();
+
+	// Folded branches have fewer successors, which can only make more variables
+	// definitely assigned
+	definiteAssignment();
+
+	// Dropping a store can make the stores feeding it dead as well
+	do {
+		liveness();
+	} while (removeDeadStores());
+
+	packSlots();
+
+	std::sort(m_dead.begin(), m_dead.end());
+
+	m_report.lines = m_code.size();
+	m_report.eliminated = m_dead.size();
+	m_report.unchecked = m_unchecked.size();
+	m_report.variables = m_names.size();
+	m_report.slots = m_slot_count;
+}
+
+
+template <typename V>
+size_t Optimizer<V>::variable(std::string_view name)
+{
+	auto it = m_ids.find(name);
+	if (it != m_ids.end())
+	{
+		return it->second;
+	}
+
+	m_names.emplace_back(name);
+	m_ids.emplace(std::string(name), m_names.size() - 1);
+	return m_names.size() - 1;
+}
+
+
+// Reads a NUMBER or VARIABLE operand, fits is cleared for literals the value
+// type can't hold (the interpreter reports those)
+template <typename V>
+bool Optimizer<V>::operand(Lexer &p, Line &line)
+{
+	const Lexer::Token t = p.next();
+	Arg arg;
+	if (t == Lexer::Token::NUMBER)
+	{
+		line.fits = V::fromLiteral(p.num(), arg.value) && line.fits;
+	}
+	else if (t == Lexer::Token::VARIABLE)
+	{
+		arg.id = variable(p.str());
+		line.uses.push_back(arg.id);
+	}
+	else
+	{
+		return false;
+	}
+
+	line.args.push_back(arg);
+	return true;
+}
+
+
+template <typename V>
+bool Optimizer<V>::target(Lexer &p, Line &line)
+{
+	if (p.next() != Lexer::Token::NUMBER)
+	{
+		return false;
+	}
+
+	// Jumps out of the program end it with an error
+	const long long to = p.num();
+	if (to > 0 && static_cast<unsigned long long>(to) <= m_lines.size())
+	{
+		line.jump = static_cast<size_t>(to - 1);
+		line.successors.push_back(line.jump);
+	}
+
+	return true;
+}
+
+
+template <typename V>
+bool Optimizer<V>::decode(size_t index, Line &line)
+{
+	Lexer p(m_lines[index]);
+	const Lexer::Token op = p.next();
+	line.op = op;
+
+	auto next = [&]() {
+		if (index + 1 < m_lines.size())
+		{
+			line.successors.push_back(index + 1);
+		}
+	};
+
+	auto def = [&]() -> bool {
+		if (p.next() != Lexer::Token::VARIABLE)
+		{
+			return false;
+		}
+
+		line.def = variable(p.str());
+		return true;
+	};
+
+	auto array = [&]() -> bool {
+		return p.next() == Lexer::Token::VARIABLE;
+	};
+
+	switch (op)
+	{
+	case Lexer::Token::EOL:
+	case Lexer::Token::NOP:
+		next();
+		return true;
+
+	case Lexer::Token::JUMP:
+		return target(p, line);
+	case Lexer::Token::JUMPT:
+	case Lexer::Token::JUMPF:
+		next();
+		return operand(p, line) && target(p, line);
+
+	// Reading input is a side effect, never removable
+	case Lexer::Token::READ:
+		next();
+		return def();
+	case Lexer::Token::WRITE:
+		next();
+		return operand(p, line);
+
+	case Lexer::Token::ASSIGN:
+		{
+			next();
+			if (!def() || !operand(p, line))
+			{
+				return false;
+			}
+
+			line.removable = line.fits;
+			return true;
+		}
+
+	case Lexer::Token::ADD:
+	case Lexer::Token::SUB:
+	case Lexer::Token::MULTIPLY:
+	case Lexer::Token::LT:
+	case Lexer::Token::GT:
+	case Lexer::Token::LTE:
+	case Lexer::Token::GTE:
+	case Lexer::Token::EQ:
+		{
+			next();
+			if (!operand(p, line) || !operand(p, line) || !def())
+			{
+				return false;
+			}
+
+			const bool arithmetic = op == Lexer::Token::ADD || op == Lexer::Token::SUB || op == Lexer::Token::MULTIPLY;
+			line.removable = line.fits && !(arithmetic && V::checked);
+			return true;
+		}
+
+	// Arrays have their own namespace and aren't analyzed, only the scalars around them
+	case Lexer::Token::READA:
+	case Lexer::Token::WRITEA:
+		next();
+		return array();
+	case Lexer::Token::ARRAY:
+	case Lexer::Token::FILL:
+		next();
+		return array() && operand(p, line);
+	case Lexer::Token::SUM:
+		next();
+		return array() && def();
+	case Lexer::Token::GET:
+		next();
+		return array() && operand(p, line) && def();
+	case Lexer::Token::SET:
+		next();
+		return array() && operand(p, line) && operand(p, line);
+	case Lexer::Token::VADD:
+	case Lexer::Token::VMUL:
+	case Lexer::Token::VLT:
+	case Lexer::Token::VGT:
+	case Lexer::Token::VLTE:
+	case Lexer::Token::VGTE:
+	case Lexer::Token::VEQ:
+		next();
+		return array() && array() && array();
+
+	default:
+		return false;
+	}
+}
+
+
+// Forward "must" analysis: a variable is definitely assigned on entry to a line
+// when every path from the start assigns it
+template <typename V>
+void Optimizer<V>::definiteAssignment()
+{
+	const size_t words = (m_names.size() + 63) / 64;
+
+	// Lines that are never reached keep everything assigned, they can't run anyway
+	m_defined_in.assign(m_code.size(), Bits(words, ~uint64_t(0)));
+	if (!m_code.empty())
+	{
+		m_defined_in[0].assign(words, 0);
+	}
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (size_t i = 0; i < m_code.size(); i++)
+		{
+			Bits out = m_defined_in[i];
+			if (m_code[i].def != none)
+			{
+				set(out, m_code[i].def);
+			}
+
+			for (size_t s : m_code[i].successors)
+			{
+				for (size_t w = 0; w < words; w++)
+				{
+					const uint64_t merged = m_defined_in[s][w] & out[w];
+					if (s != 0 && merged != m_defined_in[s][w])
+					{
+						m_defined_in[s][w] = merged;
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+}
+
+
+// Forward interval analysis. Every line keeps the join of the states flowing
+// into it. Lines more than one path leads to are widened once they have changed
+// often enough, every loop has one of those. Branches right after the
+// comparison that computes their condition narrow its operands on each edge.
+template <typename V>
+void Optimizer<V>::ranges()
+{
+	const Range full{ std::numeric_limits<T>::min(), std::numeric_limits<T>::max() };
+
+	// Execution entering the program counts as one more path into the first line
+	m_predecessors.assign(m_code.size(), 0);
+	if (!m_code.empty())
+	{
+		m_predecessors[0]++;
+	}
+
+	for (const Line &line : m_code)
+	{
+		for (size_t s : line.successors)
+		{
+			m_predecessors[s]++;
+		}
+	}
+
+	m_ranges.assign(m_code.size(), State());
+	m_reached.assign(m_code.size(), 0);
+	if (m_code.empty())
+	{
+		return;
+	}
+
+	// Variables that aren't assigned yet can't be read without an error, so
+	// any value will do for them
+	const State entry(m_names.size(), full);
+	m_ranges[0] = entry;
+	m_reached[0] = 1;
+
+	std::vector<size_t> updates(m_code.size(), 0);
+	std::vector<std::pair<size_t, State>> out;
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (size_t i = 0; i < m_code.size(); i++)
+		{
+			if (!m_reached[i])
+			{
+				continue;
+			}
+
+			out.clear();
+			transfer(i, m_ranges[i], out);
+			for (const auto &edge : out)
+			{
+				changed = join(edge.first, edge.second, updates[edge.first]) || changed;
+			}
+		}
+	}
+
+	// Recomputing every state from the ones before it only ever shrinks them
+	// now, and stays an over-approximation of what the program can do
+	for (size_t pass = 0; pass < narrow_passes; pass++)
+	{
+		std::vector<State> ranges(m_code.size());
+		std::vector<uint8_t> reached(m_code.size(), 0);
+		ranges[0] = entry;
+		reached[0] = 1;
+
+		for (size_t i = 0; i < m_code.size(); i++)
+		{
+			if (!m_reached[i])
+			{
+				continue;
+			}
+
+			out.clear();
+			transfer(i, m_ranges[i], out);
+			for (const auto &edge : out)
+			{
+				State &state = ranges[edge.first];
+				if (!reached[edge.first])
+				{
+					state = edge.second;
+					reached[edge.first] = 1;
+					continue;
+				}
+
+				for (size_t v = 0; v < state.size(); v++)
+				{
+					state[v].lo = std::min(state[v].lo, edge.second[v].lo);
+					state[v].hi = std::max(state[v].hi, edge.second[v].hi);
+				}
+			}
+		}
+
+		m_ranges = std::move(ranges);
+		m_reached = std::move(reached);
+	}
+}
+
+
+template <typename V>
+void Optimizer<V>::transfer(size_t index, const State &in, std::vector<std::pair<size_t, State>> &out) const
+{
+	const Range full{ std::numeric_limits<T>::min(), std::numeric_limits<T>::max() };
+	const Line &line = m_code[index];
+
+	if (line.op == Lexer::Token::JUMPT || line.op == Lexer::Token::JUMPF)
+	{
+		auto edge = [&](size_t to, bool nonzero) {
+			State state = in;
+			if (refine(index, nonzero, state))
+			{
+				out.emplace_back(to, std::move(state));
+			}
+		};
+
+		// Falling through means JUMPT saw a zero and JUMPF didn't
+		if (index + 1 < m_code.size())
+		{
+			edge(index + 1, line.op == Lexer::Token::JUMPF);
+		}
+
+		if (line.jump != none)
+		{
+			edge(line.jump, line.op == Lexer::Token::JUMPT);
+		}
+
+		return;
+	}
+
+	State state = in;
+	switch (line.op)
+	{
+	case Lexer::Token::ASSIGN:
+		state[line.def] = evaluate(in, line.args[0]);
+		break;
+
+	case Lexer::Token::ADD:
+	case Lexer::Token::SUB:
+	case Lexer::Token::MULTIPLY:
+		arithmetic(line.op, evaluate(in, line.args[0]), evaluate(in, line.args[1]), state[line.def]);
+		break;
+
+	case Lexer::Token::LT:
+	case Lexer::Token::GT:
+	case Lexer::Token::LTE:
+	case Lexer::Token::GTE:
+	case Lexer::Token::EQ:
+		state[line.def] = compare(line.op, evaluate(in, line.args[0]), evaluate(in, line.args[1]));
+		break;
+
+	// READ, SUM and GET store values nothing is known about
+	default:
+		if (line.def != none)
+		{
+			state[line.def] = full;
+		}
+		break;
+	}
+
+	for (size_t s : line.successors)
+	{
+		out.emplace_back(s, state);
+	}
+}
+
+
+template <typename V>
+bool Optimizer<V>::join(size_t index, const State &state, size_t &updates)
+{
+	if (!m_reached[index])
+	{
+		m_ranges[index] = state;
+		m_reached[index] = 1;
+		return true;
+	}
+
+	const bool widen = m_predecessors[index] > 1 && updates >= widen_after;
+
+	bool changed = false;
+	State &current = m_ranges[index];
+	for (size_t v = 0; v < current.size(); v++)
+	{
+		if (state[v].lo < current[v].lo)
+		{
+			current[v].lo = widen ? std::numeric_limits<T>::min() : state[v].lo;
+			changed = true;
+		}
+
+		if (state[v].hi > current[v].hi)
+		{
+			current[v].hi = widen ? std::numeric_limits<T>::max() : state[v].hi;
+			changed = true;
+		}
+	}
+
+	if (changed)
+	{
+		updates++;
+	}
+
+	return changed;
+}
+
+
+// Narrows state to the edge of the branch at index where its condition is
+// (non)zero. Returns false when that edge can never be taken.
+template <typename V>
+bool Optimizer<V>::refine(size_t index, bool nonzero, State &state) const
+{
+	const Arg &condition = m_code[index].args[0];
+
+	Range c = evaluate(state, condition);
+	if (nonzero)
+	{
+		if (c.lo == 0)
+		{
+			c.lo++;
+		}
+
+		if (c.hi == 0)
+		{
+			c.hi--;
+		}
+	}
+	else if (c.lo <= 0 && c.hi >= 0)
+	{
+		c = Range{ 0, 0 };
+	}
+	else
+	{
+		return false;
+	}
+
+	if (c.lo > c.hi)
+	{
+		return false;
+	}
+
+	if (condition.id != none)
+	{
+		state[condition.id] = c;
+	}
+
+	if (!guarded(index))
+	{
+		return true;
+	}
+
+	const Line &cmp = m_code[index - 1];
+	Range a = evaluate(state, cmp.args[0]);
+	Range b = evaluate(state, cmp.args[1]);
+	if (!relate(cmp.op, nonzero, a, b))
+	{
+		return false;
+	}
+
+	if (cmp.args[0].id != none)
+	{
+		state[cmp.args[0].id] = a;
+	}
+
+	if (cmp.args[1].id != none)
+	{
+		state[cmp.args[1].id] = b;
+	}
+
+	return true;
+}
+
+
+template <typename V>
+typename Optimizer<V>::Range Optimizer<V>::evaluate(const State &state, const Arg &arg) const
+{
+	return arg.id == none ? Range{ arg.value, arg.value } : state[arg.id];
+}
+
+
+// The branch at index tests the result of the comparison right before it, and
+// nothing else jumps in between, so the comparison's operands still hold the
+// values it compared
+template <typename V>
+bool Optimizer<V>::guarded(size_t index) const
+{
+	if (index == 0 || m_predecessors[index] != 1)
+	{
+		return false;
+	}
+
+	const Line &cmp = m_code[index - 1];
+	switch (cmp.op)
+	{
+	case Lexer::Token::LT:
+	case Lexer::Token::GT:
+	case Lexer::Token::LTE:
+	case Lexer::Token::GTE:
+	case Lexer::Token::EQ:
+		break;
+
+	default:
+		return false;
+	}
+
+	const size_t condition = m_code[index].args[0].id;
+	return condition != none && condition == cmp.def && cmp.args[0].id != cmp.def && cmp.args[1].id != cmp.def;
+}
+
+
+// Uses the ranges to fold what they decide. Only lines whose operands are all
+// definitely assigned and whose literals fit are touched, anything else has an
+// error to report.
+template <typename V>
+void Optimizer<V>::fold()
+{
+	for (size_t i = 0; i < m_code.size(); i++)
+	{
+		Line &line = m_code[i];
+		if (!m_reached[i] || !line.fits)
+		{
+			continue;
+		}
+
+		bool defined = true;
+		for (size_t u : line.uses)
+		{
+			defined = defined && test(m_defined_in[i], u);
+		}
+
+		if (!defined)
+		{
+			continue;
+		}
+
+		const State &in = m_ranges[i];
+		switch (line.op)
+		{
+		case Lexer::Token::ADD:
+		case Lexer::Token::SUB:
+		case Lexer::Token::MULTIPLY:
+			{
+				Range r;
+				if (V::checked && arithmetic(line.op, evaluate(in, line.args[0]), evaluate(in, line.args[1]), r))
+				{
+					m_unchecked.push_back(i);
+					line.removable = true;
+				}
+
+				break;
+			}
+
+		case Lexer::Token::LT:
+		case Lexer::Token::GT:
+		case Lexer::Token::LTE:
+		case Lexer::Token::GTE:
+		case Lexer::Token::EQ:
+			{
+				const Range r = compare(line.op, evaluate(in, line.args[0]), evaluate(in, line.args[1]));
+				if (r.lo != r.hi)
+				{
+					break;
+				}
+
+				m_rewrites.emplace_back(i, "=," + m_names[line.def] + "," + std::to_string(r.lo));
+				m_report.folded_compares++;
+
+				line.op = Lexer::Token::ASSIGN;
+				line.args.assign(1, Arg{ none, r.lo });
+				line.uses.clear();
+				break;
+			}
+
+		case Lexer::Token::JUMPT:
+		case Lexer::Token::JUMPF:
+			{
+				const Range c = evaluate(in, line.args[0]);
+				const bool zero = c.lo == 0 && c.hi == 0;
+				const bool nonzero = c.lo > 0 || c.hi < 0;
+				if (!zero && !nonzero)
+				{
+					break;
+				}
+
+				// Jumps out of the program are errors, those stay
+				const bool taken = nonzero == (line.op == Lexer::Token::JUMPT);
+				if (taken && line.jump == none)
+				{
+					break;
+				}
+
+				m_report.folded_branches++;
+				line.uses.clear();
+				line.successors.clear();
+
+				if (taken)
+				{
+					m_rewrites.emplace_back(i, "JUMP," + std::to_string(line.jump + 1));
+					line.op = Lexer::Token::JUMP;
+					line.successors.push_back(line.jump);
+				}
+				else
+				{
+					line.op = Lexer::Token::NOP;
+					line.dead = true;
+					m_dead.push_back(i);
+					if (i + 1 < m_code.size())
+					{
+						line.successors.push_back(i + 1);
+					}
+				}
+
+				break;
+			}
+
+		default:
+			break;
+		}
+	}
+}
+
+
+// Bounds of op over all values in a and b. Returns false when the result may
+// not fit the value type, r is then the whole range of the type.
+template <typename V>
+bool Optimizer<V>::arithmetic(Lexer::Token op, Range a, Range b, Range &r)
+{
+	typedef CheckedValue<int64_t> Wide;
+
+	int64_t c[4];
+	bool ok = true;
+	switch (op)
+	{
+	case Lexer::Token::ADD:
+		ok = Wide::add(a.lo, b.lo, c[0]) && Wide::add(a.hi, b.hi, c[1]);
+		c[2] = c[0];
+		c[3] = c[1];
+		break;
+
+	case Lexer::Token::SUB:
+		ok = Wide::sub(a.lo, b.hi, c[0]) && Wide::sub(a.hi, b.lo, c[1]);
+		c[2] = c[0];
+		c[3] = c[1];
+		break;
+
+	default:
+		ok = Wide::mul(a.lo, b.lo, c[0]) && Wide::mul(a.lo, b.hi, c[1]) &&
+			Wide::mul(a.hi, b.lo, c[2]) && Wide::mul(a.hi, b.hi, c[3]);
+		break;
+	}
+
+	const int64_t lo = ok ? *std::min_element(c, c + 4) : 0;
+	const int64_t hi = ok ? *std::max_element(c, c + 4) : 0;
+	if (!ok || lo < std::numeric_limits<T>::min() || hi > std::numeric_limits<T>::max())
+	{
+		r = Range{ std::numeric_limits<T>::min(), std::numeric_limits<T>::max() };
+		return false;
+	}
+
+	r = Range{ static_cast<T>(lo), static_cast<T>(hi) };
+	return true;
+}
+
+
+// [1, 1] or [0, 0] when the outcome doesn't depend on the values, [0, 1] otherwise
+template <typename V>
+typename Optimizer<V>::Range Optimizer<V>::compare(Lexer::Token op, Range a, Range b)
+{
+	bool always = false, never = false;
+	switch (op)
+	{
+	case Lexer::Token::LT: always = a.hi < b.lo; never = a.lo >= b.hi; break;
+	case Lexer::Token::GT: always = a.lo > b.hi; never = a.hi <= b.lo; break;
+	case Lexer::Token::LTE: always = a.hi <= b.lo; never = a.lo > b.hi; break;
+	case Lexer::Token::GTE: always = a.lo >= b.hi; never = a.hi < b.lo; break;
+	default:
+		always = a.lo == a.hi && b.lo == b.hi && a.lo == b.lo;
+		never = a.hi < b.lo || b.hi < a.lo;
+		break;
+	}
+
+	return Range{ T(always ? 1 : 0), T(never ? 0 : 1) };
+}
+
+
+// Narrows a and b to the values for which a op b holds (or doesn't). Returns
+// false when no such values exist.
+template <typename V>
+bool Optimizer<V>::relate(Lexer::Token op, bool holds, Range &a, Range &b)
+{
+	// x < y
+	auto less = [](Range &x, Range &y) -> bool {
+		if (y.hi == std::numeric_limits<T>::min() || x.lo == std::numeric_limits<T>::max())
+		{
+			return false;
+		}
+
+		x.hi = std::min<T>(x.hi, y.hi - 1);
+		y.lo = std::max<T>(y.lo, x.lo + 1);
+		return true;
+	};
+
+	// x <= y
+	auto lessEqual = [](Range &x, Range &y) -> bool {
+		x.hi = std::min(x.hi, y.hi);
+		y.lo = std::max(y.lo, x.lo);
+		return true;
+	};
+
+	// x != y, only a single value can be cut off the end of a range
+	auto differ = [](Range &x, Range &y) -> bool {
+		if (y.lo == y.hi)
+		{
+			if (x.lo == x.hi && x.lo == y.lo)
+			{
+				return false;
+			}
+
+			if (x.lo == y.lo)
+			{
+				x.lo++;
+			}
+			else if (x.hi == y.lo)
+			{
+				x.hi--;
+			}
+		}
+
+		return true;
+	};
+
+	bool ok = true;
+	switch (op)
+	{
+	case Lexer::Token::LT: ok = holds ? less(a, b) : lessEqual(b, a); break;
+	case Lexer::Token::GT: ok = holds ? less(b, a) : lessEqual(a, b); break;
+	case Lexer::Token::LTE: ok = holds ? lessEqual(a, b) : less(b, a); break;
+	case Lexer::Token::GTE: ok = holds ? lessEqual(b, a) : less(a, b); break;
+	default:
+		if (holds)
+		{
+			a.lo = b.lo = std::max(a.lo, b.lo);
+			a.hi = b.hi = std::min(a.hi, b.hi);
+		}
+		else
+		{
+			ok = differ(a, b) && differ(b, a);
+		}
+		break;
+	}
+
+	return ok && a.lo <= a.hi && b.lo <= b.hi;
+}
+
+
+// Backward "may" analysis: a variable is live after a line when some path from
+// there reads it before assigning it
+template <typename V>
+void Optimizer<V>::liveness()
+{
+	const size_t words = (m_names.size() + 63) / 64;
+	m_live_out.assign(m_code.size(), Bits(words, 0));
+	std::vector<Bits> live_in(m_code.size(), Bits(words, 0));
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (size_t i = m_code.size(); i-- > 0;)
+		{
+			const Line &line = m_code[i];
+
+			Bits out(words, 0);
+			for (size_t s : line.successors)
+			{
+				for (size_t w = 0; w < words; w++)
+				{
+					out[w] |= live_in[s][w];
+				}
+			}
+
+			Bits in = out;
+			if (!line.dead)
+			{
+				if (line.def != none)
+				{
+					reset(in, line.def);
+				}
+
+				for (size_t u : line.uses)
+				{
+					set(in, u);
+				}
+			}
+
+			if (in != live_in[i])
+			{
+				live_in[i] = std::move(in);
+				changed = true;
+			}
+
+			m_live_out[i] = std::move(out);
+		}
+	}
+}
+
+
+template <typename V>
+bool Optimizer<V>::removeDeadStores()
+{
+	bool removed = false;
+	for (size_t i = 0; i < m_code.size(); i++)
+	{
+		Line &line = m_code[i];
+		if (line.dead || !line.removable || test(m_live_out[i], line.def))
+		{
+			continue;
+		}
+
+		// Reading an undefined variable is an error the program has to keep reporting
+		bool defined = true;
+		for (size_t u : line.uses)
+		{
+			defined = defined && test(m_defined_in[i], u);
+		}
+
+		if (defined)
+		{
+			line.dead = true;
+			m_dead.push_back(i);
+			removed = true;
+		}
+	}
+
+	return removed;
+}
+
+
+// Two variables interfere when one is assigned while the other is live. Each
+// variable gets the lowest slot none of its interfering variables has.
+template <typename V>
+void Optimizer<V>::packSlots()
+{
+	const size_t count = m_names.size();
+	const size_t words = (count + 63) / 64;
+	std::vector<Bits> interferes(count, Bits(words, 0));
+
+	for (size_t i = 0; i < m_code.size(); i++)
+	{
+		const Line &line = m_code[i];
+		if (line.dead || line.def == none)
+		{
+			continue;
+		}
+
+		for (size_t w = 0; w < words; w++)
+		{
+			interferes[line.def][w] |= m_live_out[i][w];
+		}
+	}
+
+	// A variable that may be read before it's assigned has to keep a slot of its
+	// own, any other variable stored there would hide the error
+	for (size_t i = 0; i < m_code.size(); i++)
+	{
+		for (size_t u : m_code[i].uses)
+		{
+			if (!test(m_defined_in[i], u))
+			{
+				interferes[u].assign(words, ~uint64_t(0));
+			}
+		}
+	}
+
+	for (size_t a = 0; a < count; a++)
+	{
+		reset(interferes[a], a);
+		for (size_t b = 0; b < count; b++)
+		{
+			if (test(interferes[a], b))
+			{
+				set(interferes[b], a);
+			}
+		}
+	}
+
+	m_slots.assign(count, none);
+	m_slot_count = 0;
+	for (size_t a = 0; a < count; a++)
+	{
+		std::vector<bool> taken(m_slot_count, false);
+		for (size_t b = 0; b < a; b++)
+		{
+			if (test(interferes[a], b))
+			{
+				taken[m_slots[b]] = true;
+			}
+		}
+
+		size_t slot = 0;
+		while (slot < m_slot_count && taken[slot])
+		{
+			slot++;
+		}
+
+		m_slots[a] = slot;
+		m_slot_count = std::max(m_slot_count, slot + 1);
+	}
+}
+
+
+template class Optimizer<Int32Value>;
+template class Optimizer<Int64Value>;
+template class Optimizer<CheckedInt64Value>;
\ No newline at end of file
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "instruction.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <utility>
+#include <cstdint>
+
+
+// What the optimizer did to a program, all counts are in lines
+struct OptimizationReport
+{
+	size_t lines{ 0 };
+
+	// Turned into NOP: dead stores and branches that are never taken
+	size_t eliminated{ 0 };
+
+	// JUMPT/JUMPF with a fixed outcome (the never taken ones are eliminated too)
+	size_t folded_branches{ 0 };
+	// Comparisons with a fixed outcome, turned into assignments
+	size_t folded_compares{ 0 };
+	// Checked arithmetic that can't overflow
+	size_t unchecked{ 0 };
+
+	size_t variables{ 0 };
+	size_t slots{ 0 };
+};
+
+
+// Whole-program analyses over the source lines, run once before execution when
+// optimization is enabled. They need the complete program, so streamed input
+// can't be optimized.
+//
+// Range analysis keeps an interval for every variable at every line. Branches
+// and comparisons whose outcome it can tell are folded, and checked arithmetic
+// that can't overflow is reported so the check can be skipped.
+//
+// Liveness tells for every line which variables may still be read later on.
+// Variables that are never live at the same time share one storage slot, and
+// stores whose value is never read are dropped when that can't hide an error
+// (all operands definitely assigned, no overflow possible). Only what the
+// program itself reads is kept: after the run, variables it doesn't read again
+// may be missing or hold the value of another variable.
+template <typename V>
+class Optimizer
+{
+public:
+	typedef typename V::type T;
+
+	explicit Optimizer(const ProgramLines &lines);
+
+	void run();
+
+	// Lines whose store is never read, to be executed as NOP
+	const std::vector<size_t> &deadLines() const { return m_dead; }
+	// Lines to be replaced with the given text (folded branches and comparisons)
+	const std::vector<std::pair<size_t, std::string>> &rewrites() const { return m_rewrites; }
+	// Arithmetic lines that can't overflow
+	const std::vector<size_t> &uncheckedLines() const { return m_unchecked; }
+
+	const OptimizationReport &report() const { return m_report; }
+
+	size_t variableCount() const { return m_names.size(); }
+	const std::string &variableName(size_t id) const { return m_names[id]; }
+	size_t slotOf(size_t id) const { return m_slots[id]; }
+	size_t slotCount() const { return m_slot_count; }
+
+private:
+	static constexpr size_t none = static_cast<size_t>(-1);
+
+	// One bit per variable
+	typedef std::vector<uint64_t> Bits;
+
+	// Variable id, or none for a literal
+	struct Arg
+	{
+		size_t id{ none };
+		T value{ 0 };
+	};
+
+	struct Line
+	{
+		Lexer::Token op{ Lexer::Token::EOL };
+		std::vector<Arg> args;
+
+		std::vector<size_t> uses;
+		size_t def{ none };
+		std::vector<size_t> successors;
+		size_t jump{ none };
+
+		// All literals can be represented by the value type
+		bool fits{ true };
+		// Nothing but the store could go wrong, as long as the operands are defined
+		bool removable{ false };
+		bool dead{ false };
+	};
+
+	// Closed interval of the values a variable may hold
+	struct Range
+	{
+		T lo, hi;
+	};
+
+	// One range per variable, empty for lines that aren't reached
+	typedef std::vector<Range> State;
+
+	bool decode(size_t index, Line &line);
+	size_t variable(std::string_view name);
+	bool operand(Lexer &p, Line &line);
+	bool target(Lexer &p, Line &line);
+
+	void ranges();
+	void transfer(size_t index, const State &in, std::vector<std::pair<size_t, State>> &out) const;
+	bool join(size_t index, const State &state, size_t &updates);
+	bool refine(size_t index, bool nonzero, State &state) const;
+	Range evaluate(const State &state, const Arg &arg) const;
+	bool guarded(size_t index) const;
+	void fold();
+
+	static bool arithmetic(Lexer::Token op, Range a, Range b, Range &r);
+	static Range compare(Lexer::Token op, Range a, Range b);
+	static bool relate(Lexer::Token op, bool holds, Range &a, Range &b);
+
+	void liveness();
+	void definiteAssignment();
+	bool removeDeadStores();
+	void packSlots();
+
+	const ProgramLines &m_lines;
+	std::vector<Line> m_code;
+
+	std::map<std::string, size_t, std::less<>> m_ids;
+	std::vector<std::string> m_names;
+
+	std::vector<Bits> m_live_out;
+	std::vector<Bits> m_defined_in;
+	std::vector<State> m_ranges;
+	std::vector<uint8_t> m_reached;
+	std::vector<size_t> m_predecessors;
+
+	std::vector<size_t> m_dead;
+	std::vector<std::pair<size_t, std::string>> m_rewrites;
+	std::vector<size_t> m_unchecked;
+	std::vector<size_t> m_slots;
+	size_t m_slot_count{ 0 };
+
+	OptimizationReport m_report;
+};
\ No newline at end of file
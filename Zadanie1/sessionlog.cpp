@@ -0,0 +1,111 @@
+#include "sessionlog.hpp"
+
+#include <fstream>
+#include <algorithm>
+
+
+namespace
+{
+	const char MAGIC[4] = { 'Z', '1', 'L', 'G' };
+
+	void writeVarint(std::ostream &out, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.put(static_cast<char>((value & 0x7f) | 0x80));
+			value >>= 7;
+		}
+
+		out.put(static_cast<char>(value));
+	}
+
+	bool readVarint(std::istream &in, uint64_t &value)
+	{
+		value = 0;
+		for (unsigned shift = 0; shift < 64; shift += 7)
+		{
+			const int c = in.get();
+			if (c == std::char_traits<char>::eof())
+			{
+				return false;
+			}
+
+			value |= static_cast<uint64_t>(c & 0x7f) << shift;
+			if (!(c & 0x80))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
+
+
+bool SessionLog::save(const std::string &filename) const
+{
+	std::ofstream out(filename, std::ios::binary);
+	return out.is_open() && write(out);
+}
+
+
+bool SessionLog::load(const std::string &filename)
+{
+	std::ifstream in(filename, std::ios::binary);
+	return in.is_open() && read(in);
+}
+
+
+bool SessionLog::write(std::ostream &out) const
+{
+	out.write(MAGIC, sizeof(MAGIC));
+	for (const Entry &e : m_entries)
+	{
+		out.put(static_cast<char>(e.kind));
+		writeVarint(out, e.line);
+
+		// Zigzag keeps small negative numbers small
+		writeVarint(out, (static_cast<uint64_t>(e.value) << 1) ^ static_cast<uint64_t>(e.value >> 63));
+	}
+
+	return static_cast<bool>(out);
+}
+
+
+bool SessionLog::read(std::istream &in)
+{
+	m_entries.clear();
+	m_position = 0;
+
+	char magic[sizeof(MAGIC)];
+	if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), MAGIC))
+	{
+		return false;
+	}
+
+	int kind;
+	while ((kind = in.get()) != std::char_traits<char>::eof())
+	{
+		uint64_t line, value;
+		if ((kind != READ && kind != WRITE) || !readVarint(in, line) || !readVarint(in, value))
+		{
+			return false;
+		}
+
+		append(static_cast<Kind>(kind), static_cast<size_t>(line), static_cast<int64_t>((value >> 1) ^ (0 - (value & 1))));
+	}
+
+	return true;
+}
+
+
+void SessionLog::append(Kind kind, size_t line, int64_t value)
+{
+	m_entries.push_back(Entry{ kind, line, value });
+}
+
+
+const SessionLog::Entry *SessionLog::next()
+{
+	return m_position < m_entries.size() ? &m_entries[m_position++] : nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+
+// Every value a run read or wrote, in order, with the line that did it.
+// Recording a real session and replaying it later gives benchmarks the same
+// input as production and catches any change in what the program writes.
+//
+// On disk: the magic "Z1LG", then one record per value. A record is a kind
+// byte, the line as a LEB128 varint and the value as a zigzag LEB128 varint,
+// so small numbers take a byte or two.
+class SessionLog
+{
+public:
+	enum Kind : uint8_t
+	{
+		READ = 'R',
+		WRITE = 'W'
+	};
+
+	struct Entry
+	{
+		Kind kind;
+		size_t line;
+		int64_t value;
+	};
+
+	bool save(const std::string &filename) const;
+	bool load(const std::string &filename);
+	bool write(std::ostream &out) const;
+	bool read(std::istream &in);
+
+	void append(Kind kind, size_t line, int64_t value);
+
+	// Replay side, entries are consumed in the order they were recorded
+	const Entry *next();
+	void rewind() { m_position = 0; }
+	size_t remaining() const { return m_entries.size() - m_position; }
+
+	size_t size() const { return m_entries.size(); }
+	const Entry &operator[](size_t i) const { return m_entries[i]; }
+
+	static const char *kindName(Kind kind) { return kind == READ ? "READ" : "WRITE"; }
+
+private:
+	std::vector<Entry> m_entries;
+	size_t m_position{ 0 };
+};
\ No newline at end of file
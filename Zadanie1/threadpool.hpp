@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+
+// Fixed number of workers taking jobs from one queue. Jobs still queued when
+// the pool is destroyed are run before the workers exit.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(size_t threads)
+	{
+		if (threads == 0)
+		{
+			threads = 1;
+		}
+
+		for (size_t i = 0; i < threads; i++)
+		{
+			m_workers.emplace_back([this] { work(); });
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+
+		m_condition.notify_all();
+		for (std::thread &worker : m_workers)
+		{
+			worker.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	void post(std::function<void()> job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobs.push(std::move(job));
+		}
+
+		m_condition.notify_one();
+	}
+
+private:
+	void work()
+	{
+		for (;;)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+				if (m_jobs.empty())
+				{
+					return;
+				}
+
+				job = std::move(m_jobs.front());
+				m_jobs.pop();
+			}
+
+			job();
+		}
+	}
+
+	std::vector<std::thread> m_workers;
+	std::queue<std::function<void()>> m_jobs;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stopping{ false };
+};
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+
+// Value types the interpreter can be instantiated with. Each one defines the
+// storage type and how arithmetic behaves; every operation returns false when
+// the result can't be represented, which only the checked types ever do.
+
+// Two's complement wrap-around, same as the hardware does
+template <typename T>
+struct WrappingValue
+{
+	typedef T type;
+	static const bool checked = false;
+
+	static bool fromLiteral(long long literal, T &r) { r = static_cast<T>(literal); return true; }
+
+	// Done in unsigned so the wrap-around is well defined
+	static bool add(T a, T b, T &r) { r = static_cast<T>(static_cast<U>(a) + static_cast<U>(b)); return true; }
+	static bool sub(T a, T b, T &r) { r = static_cast<T>(static_cast<U>(a) - static_cast<U>(b)); return true; }
+	static bool mul(T a, T b, T &r) { r = static_cast<T>(static_cast<U>(a) * static_cast<U>(b)); return true; }
+
+private:
+	typedef typename std::make_unsigned<T>::type U;
+};
+
+
+// Arithmetic that refuses to overflow
+template <typename T>
+struct CheckedValue
+{
+	typedef T type;
+	static const bool checked = true;
+
+	static bool fromLiteral(long long literal, T &r)
+	{
+		if (literal < min() || literal > max())
+		{
+			return false;
+		}
+
+		r = static_cast<T>(literal);
+		return true;
+	}
+
+	static bool add(T a, T b, T &r)
+	{
+		if ((b > 0 && a > max() - b) || (b < 0 && a < min() - b))
+		{
+			return false;
+		}
+
+		r = a + b;
+		return true;
+	}
+
+	static bool sub(T a, T b, T &r)
+	{
+		if ((b < 0 && a > max() + b) || (b > 0 && a < min() + b))
+		{
+			return false;
+		}
+
+		r = a - b;
+		return true;
+	}
+
+	static bool mul(T a, T b, T &r)
+	{
+		if (a != 0 && b != 0)
+		{
+			if (a > 0 ? (b > 0 ? a > max() / b : b < min() / a)
+			          : (b > 0 ? a < min() / b : a < max() / b))
+			{
+				return false;
+			}
+		}
+
+		r = a * b;
+		return true;
+	}
+
+private:
+	static constexpr T min() { return std::numeric_limits<T>::min(); }
+	static constexpr T max() { return std::numeric_limits<T>::max(); }
+};
+
+
+typedef WrappingValue<int32_t> Int32Value;
+typedef WrappingValue<int64_t> Int64Value;
+typedef CheckedValue<int64_t> CheckedInt64Value;
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <memory_resource>
+#include <cstdint>
+
+
+// Variable storage shared by both execution tiers. Every variable name gets a
+// stable slot index the first time it is seen, the plain interpreter looks
+// variables up by name and compiled blocks address the slots directly.
+template <typename T>
+class Variables
+{
+public:
+	explicit Variables(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+		m_slots{ resource },
+		m_names{ resource },
+		m_values{ resource },
+		m_defined{ resource }
+	{
+		;
+	}
+
+	size_t slot(std::string_view name)
+	{
+		auto it = m_slots.find(name);
+		if (it != m_slots.end())
+		{
+			return it->second;
+		}
+
+		const size_t index = m_names.size();
+		m_slots.emplace(name, index);
+		m_names.emplace_back(name);
+		m_values.push_back(0);
+		m_defined.push_back(0);
+		return index;
+	}
+
+	// Slot of a name that has one already, without adding it
+	bool find(std::string_view name, size_t &index) const
+	{
+		auto it = m_slots.find(name);
+		if (it == m_slots.end())
+		{
+			return false;
+		}
+
+		index = it->second;
+		return true;
+	}
+
+	// Puts name into the given slot, several names may share one (see optimizer.hpp)
+	void bind(std::string_view name, size_t index)
+	{
+		if (index >= m_names.size())
+		{
+			m_names.resize(index + 1);
+			m_values.resize(index + 1, 0);
+			m_defined.resize(index + 1, 0);
+		}
+
+		if (m_names[index].empty())
+		{
+			m_names[index] = name;
+		}
+
+		auto it = m_slots.find(name);
+		if (it != m_slots.end())
+		{
+			it->second = index;
+		}
+		else
+		{
+			m_slots.emplace(name, index);
+		}
+	}
+
+	bool get(std::string_view name, T &value) const
+	{
+		auto it = m_slots.find(name);
+		if (it == m_slots.end() || !m_defined[it->second])
+		{
+			return false;
+		}
+
+		value = m_values[it->second];
+		return true;
+	}
+
+	void set(std::string_view name, T value)
+	{
+		const size_t index = slot(name);
+		m_values[index] = value;
+		m_defined[index] = 1;
+	}
+
+	// Forgets every value, the slots stay because compiled code refers to them
+	void clear()
+	{
+		std::fill(m_values.begin(), m_values.end(), T(0));
+		std::fill(m_defined.begin(), m_defined.end(), uint8_t(0));
+	}
+
+	// A slot exists as soon as a name is referenced, but the variable only exists
+	// once something was assigned to it
+	bool defined(size_t index) const { return m_defined[index] != 0; }
+	const std::pmr::string &name(size_t index) const { return m_names[index]; }
+	size_t size() const { return m_names.size(); }
+
+	T *values() { return m_values.data(); }
+	uint8_t *definedFlags() { return m_defined.data(); }
+	const T *values() const { return m_values.data(); }
+	const uint8_t *definedFlags() const { return m_defined.data(); }
+
+private:
+	// std::less<> allows lookups by string_view without building a string
+	std::pmr::map<std::pmr::string, size_t, std::less<>> m_slots;
+	std::pmr::vector<std::pmr::string> m_names;
+	std::pmr::vector<T> m_values;
+	std::pmr::vector<uint8_t> m_defined;
+};
+
+
+// Arrays live in their own namespace, a scalar and an array can share a name
+template <typename T>
+using ArrayMap = std::pmr::map<std::pmr::string, std::pmr::vector<T>, std::less<>>;
@@ -0,0 +1,394 @@
+#ifdef _BENCHMARK
+
+#include "fautils.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <thread>
+
+
+// Benchmark build: minimizes random DFAs of growing size, determinizes NFAs
+// that blow up into big DFAs, measures how fast DFAs match, one string or a
+// batch at a time, and prints one JSON document with the results so they can
+// be compared between commits.
+
+namespace
+{
+	struct Benchmark
+	{
+		std::string name;
+		DFiniteAutomaton dfa;
+	};
+
+	struct Result
+	{
+		size_t states{ 0 };
+		double ms{ 0 };
+	};
+
+	DFiniteAutomaton emptyDfa(size_t symbols)
+	{
+		std::set<std::string> alphabet;
+		for (size_t a = 0; a < symbols; a++)
+		{
+			alphabet.insert(std::string(1, static_cast<char>('a' + a)));
+		}
+
+		DFiniteAutomaton dfa;
+		dfa.setAlphabet(alphabet);
+		return dfa;
+	}
+
+	// Every state goes somewhere random on most symbols, a quarter of them are final
+	DFiniteAutomaton randomDfa(size_t states, size_t symbols, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		DFiniteAutomaton dfa = emptyDfa(symbols);
+		for (size_t s = 0; s < states; s++)
+		{
+			dfa.addState((s == 0 ? State::Type::INITIAL : State::Type::NONE) | (rng() % 4 == 0 ? State::Type::FINAL : State::Type::NONE));
+		}
+
+		for (FiniteAutomaton::StateId s = 0; s < states; s++)
+		{
+			for (FiniteAutomaton::SymbolId a = 1; a <= symbols; a++)
+			{
+				if (rng() % 10)
+				{
+					dfa.addTransition(s, a, static_cast<FiniteAutomaton::StateId>(rng() % states));
+				}
+			}
+		}
+
+		dfa.compact();
+		return dfa;
+	}
+
+	// A random DFA of states / copies states with every state copied `copies`
+	// times, transitions go to a random copy of the right target. Minimizing
+	// has to merge the copies back together.
+	DFiniteAutomaton copiedDfa(size_t states, size_t symbols, size_t copies, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		const size_t base = states / copies;
+		std::vector<FiniteAutomaton::StateId> next(base * symbols);
+		std::vector<uint8_t> final(base);
+		for (size_t s = 0; s < base; s++)
+		{
+			final[s] = rng() % 4 == 0;
+			for (size_t a = 0; a < symbols; a++)
+			{
+				next[s * symbols + a] = static_cast<FiniteAutomaton::StateId>(rng() % base);
+			}
+		}
+
+		// State s is copy s / base of base state s % base
+		DFiniteAutomaton dfa = emptyDfa(symbols);
+		for (size_t s = 0; s < base * copies; s++)
+		{
+			dfa.addState((s == 0 ? State::Type::INITIAL : State::Type::NONE) | (final[s % base] ? State::Type::FINAL : State::Type::NONE));
+		}
+
+		for (size_t s = 0; s < base * copies; s++)
+		{
+			for (size_t a = 0; a < symbols; a++)
+			{
+				const size_t copy = rng() % copies;
+				dfa.addTransition(static_cast<FiniteAutomaton::StateId>(s), static_cast<FiniteAutomaton::SymbolId>(a + 1),
+					static_cast<FiniteAutomaton::StateId>(copy * base + next[(s % base) * symbols + a]));
+			}
+		}
+
+		dfa.compact();
+		return dfa;
+	}
+
+	// (a|b)*a(a|b)^n, the DFA has to remember the last n + 1 characters
+	NDFiniteAutomaton lastCharacters(size_t n)
+	{
+		NDFiniteAutomaton nfa;
+		nfa.setAlphabet({ "", "a", "b" });
+		for (size_t s = 0; s < n + 2; s++)
+		{
+			nfa.addState((s == 0 ? State::Type::INITIAL : State::Type::NONE) | (s == n + 1 ? State::Type::FINAL : State::Type::NONE));
+		}
+
+		nfa.addTransition(0, 1, 0);
+		nfa.addTransition(0, 2, 0);
+		nfa.addTransition(0, 1, 1);
+		for (FiniteAutomaton::StateId s = 1; s <= n; s++)
+		{
+			nfa.addTransition(s, 1, s + 1);
+			nfa.addTransition(s, 2, s + 1);
+		}
+
+		nfa.compact();
+		return nfa;
+	}
+
+	Result determinize(const NDFiniteAutomaton &nfa, size_t threads, size_t repeat)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		Result best;
+		for (size_t i = 0; i < repeat; i++)
+		{
+			DFiniteAutomaton dfa;
+			const Clock::time_point start = Clock::now();
+			FAUtils::nfa_to_dfa(nfa, dfa, threads);
+			const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			if (i == 0 || ms < best.ms)
+			{
+				best.ms = ms;
+				best.states = dfa.getStateCount();
+			}
+		}
+
+		return best;
+	}
+
+	// Best of `repeat` runs over the whole input, states is how many strings were
+	// accepted. Strings go one by one through accept(), or all in one batch.
+	Result match(const DFiniteAutomaton &dfa, const std::vector<std::string> &input, bool batch, size_t repeat)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		Result best;
+		std::vector<uint64_t> accepted;
+		for (size_t i = 0; i < repeat; i++)
+		{
+			const Clock::time_point start = Clock::now();
+			if (batch)
+			{
+				dfa.accept(input, accepted);
+			}
+			else
+			{
+				accepted.assign((input.size() + 63) / 64, 0);
+				for (size_t k = 0; k < input.size(); k++)
+				{
+					accepted[k / 64] |= uint64_t(dfa.accept(input[k])) << (k % 64);
+				}
+			}
+			const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			if (i == 0 || ms < best.ms)
+			{
+				best.ms = ms;
+				best.states = 0;
+				for (uint64_t word : accepted)
+				{
+					best.states += std::bitset<64>(word).count();
+				}
+			}
+		}
+
+		return best;
+	}
+
+	// Best of `repeat` runs, the minimum is the least noisy estimate
+	Result run(const Benchmark &benchmark, size_t repeat)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		Result best;
+		for (size_t i = 0; i < repeat; i++)
+		{
+			DFiniteAutomaton minimal;
+			const Clock::time_point start = Clock::now();
+			FAUtils::minimize(benchmark.dfa, minimal);
+			const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			if (i == 0 || ms < best.ms)
+			{
+				best.ms = ms;
+				best.states = minimal.getStateCount();
+			}
+		}
+
+		return best;
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	size_t repeat = 3;
+	size_t threads = std::max<size_t>(std::thread::hardware_concurrency(), 2);
+	std::string filter;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg(argv[i]);
+		if ((arg == "--repeat" || arg == "--threads" || arg == "--filter") && i + 1 < argc)
+		{
+			const std::string value(argv[++i]);
+			if (arg == "--filter")
+			{
+				filter = value;
+			}
+			else
+			{
+				(arg == "--repeat" ? repeat : threads) = std::strtoull(value.c_str(), nullptr, 10);
+			}
+		}
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--repeat N] [--threads N] [--filter TEXT]\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	const struct
+	{
+		size_t states;
+		size_t symbols;
+	} sizes[] = { { 1000, 2 }, { 10000, 2 }, { 100000, 2 }, { 100000, 26 }, { 1000000, 2 } };
+
+	std::vector<Benchmark> benchmarks;
+	for (const auto &size : sizes)
+	{
+		const std::string suffix = "_" + std::to_string(size.states) + "x" + std::to_string(size.symbols);
+		if (filter.empty() || ("random" + suffix).find(filter) != std::string::npos)
+		{
+			benchmarks.push_back(Benchmark{ "random" + suffix, randomDfa(size.states, size.symbols, 1) });
+		}
+
+		if (filter.empty() || ("copies" + suffix).find(filter) != std::string::npos)
+		{
+			benchmarks.push_back(Benchmark{ "copies" + suffix, copiedDfa(size.states, size.symbols, 100, 2) });
+		}
+	}
+
+	std::cout << "{\n  \"repeat\": " << repeat << ",\n  \"results\": [";
+	for (size_t i = 0; i < benchmarks.size(); i++)
+	{
+		const Benchmark &benchmark = benchmarks[i];
+		const Result result = run(benchmark, repeat);
+
+		size_t transitions = 0;
+		for (FiniteAutomaton::StateId s = 0; s < benchmark.dfa.getStateCount(); s++)
+		{
+			transitions += benchmark.dfa.getEdges(s).size();
+		}
+
+		std::cout << (i ? "," : "") << "\n    { \"name\": \"" << benchmark.name << "\""
+			<< ", \"states\": " << benchmark.dfa.getStateCount()
+			<< ", \"transitions\": " << transitions
+			<< ", \"minimal_states\": " << result.states
+			<< ", \"minimize_ms\": " << result.ms
+			<< ", \"ns_per_transition\": " << (transitions ? result.ms * 1e6 / transitions : 0)
+			<< " }";
+	}
+	std::cout << "\n  ],\n  \"threads\": " << threads << ",\n  \"subsets\": [";
+
+	// Serial and threaded subset construction of the same NFA
+	bool first = true;
+	for (size_t n : { 12, 16, 19 })
+	{
+		const std::string name = "last_" + std::to_string(n + 1);
+		if (!filter.empty() && name.find(filter) == std::string::npos)
+		{
+			continue;
+		}
+
+		const NDFiniteAutomaton nfa = lastCharacters(n);
+		const Result serial = determinize(nfa, 1, repeat);
+		const Result parallel = determinize(nfa, threads, repeat);
+
+		std::cout << (first ? "" : ",") << "\n    { \"name\": \"" << name << "\""
+			<< ", \"nfa_states\": " << nfa.getStateCount()
+			<< ", \"dfa_states\": " << serial.states
+			<< ", \"serial_ms\": " << serial.ms
+			<< ", \"parallel_ms\": " << parallel.ms
+			<< ", \"speedup\": " << (parallel.ms > 0 ? serial.ms / parallel.ms : 0)
+			<< " }";
+		first = false;
+	}
+	std::cout << "\n  ],\n  \"accept\": [";
+
+	// accept() over 1 MB of random strings, the DFAs are too big to stay in cache after n = 16 or so
+	std::vector<std::string> input(1000);
+	std::mt19937 rng(3);
+	for (std::string &s : input)
+	{
+		for (size_t c = 0; c < 1000; c++)
+		{
+			s += "ab"[rng() % 2];
+		}
+	}
+
+	first = true;
+	for (size_t n : { 4, 12, 19 })
+	{
+		const std::string name = "accept_last_" + std::to_string(n + 1);
+		if (!filter.empty() && name.find(filter) == std::string::npos)
+		{
+			continue;
+		}
+
+		DFiniteAutomaton dfa;
+		FAUtils::nfa_to_dfa(lastCharacters(n), dfa);
+		const Result result = match(dfa, input, false, repeat);
+
+		std::cout << (first ? "" : ",") << "\n    { \"name\": \"" << name << "\""
+			<< ", \"dfa_states\": " << dfa.getStateCount()
+			<< ", \"accepted\": " << result.states
+			<< ", \"ms\": " << result.ms
+			<< ", \"mb_per_s\": " << (result.ms > 0 ? input.size() * input[0].size() / (result.ms * 1e3) : 0)
+			<< " }";
+		first = false;
+	}
+	std::cout << "\n  ],\n  \"batch\": [";
+
+	// A million short strings, one at a time and interleaved
+	std::vector<std::string> strings(1000000);
+	size_t bytes = 0;
+	for (std::string &s : strings)
+	{
+		for (size_t len = 8 + rng() % 25; len > 0; len--)
+		{
+			s += "ab"[rng() % 2];
+		}
+
+		bytes += s.size();
+	}
+
+	first = true;
+	for (size_t n : { 4, 12, 19 })
+	{
+		const std::string name = "batch_last_" + std::to_string(n + 1);
+		if (!filter.empty() && name.find(filter) == std::string::npos)
+		{
+			continue;
+		}
+
+		DFiniteAutomaton dfa;
+		FAUtils::nfa_to_dfa(lastCharacters(n), dfa);
+		const Result single = match(dfa, strings, false, repeat);
+		const Result batch = match(dfa, strings, true, repeat);
+
+		std::cout << (first ? "" : ",") << "\n    { \"name\": \"" << name << "\""
+			<< ", \"dfa_states\": " << dfa.getStateCount()
+			<< ", \"strings\": " << strings.size()
+			<< ", \"bytes\": " << bytes
+			<< ", \"accepted\": " << batch.states
+			<< ", \"single_ms\": " << single.ms
+			<< ", \"batch_ms\": " << batch.ms
+			<< ", \"speedup\": " << (batch.ms > 0 ? single.ms / batch.ms : 0)
+			<< " }";
+		first = false;
+	}
+	std::cout << "\n  ]\n}\n";
+
+	return EXIT_SUCCESS;
+}
+
+#endif // _BENCHMARK
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "finiteautomaton.hpp"
+
+
+// Runs the NFA itself, with the set of active states kept in a few machine
+// words. States are Glushkov style positions: every transition into a
+// position reads the same byte class, so one step is
+//
+//     active = follow(active) & reads[byte class]
+//
+// follow() of a whole set comes from tables indexed by one byte of the set at
+// a time, so a step costs 8 lookups per word whatever the set holds. Nothing
+// is determinized, building it is about as cheap as the NFA is small.
+//
+// Positions are the (target, byte class) pairs of the NFA's transitions plus
+// the start, epsilon closures are folded into follow. Up to 64 positions fit
+// one word, up to max_positions are kept in SSE2/AVX2 registers. Bigger NFAs
+// still work, but follow() is then built state by state and their tables would
+// grow with the square of the size, LazyDFA is the better fit for them.
+//
+// Immutable once built, accept() can be called from any number of threads.
+class BitNFA
+{
+public:
+	static const size_t max_positions = 512;
+
+	// If the NFA is small enough for the fixed width tables
+	static bool fits(const NDFiniteAutomaton &nfa);
+
+	explicit BitNFA(const NDFiniteAutomaton &nfa);
+
+	bool accept(const std::string &s) const;
+
+	size_t getPositionCount() const { return m_positions; }
+
+private:
+	// W is the number of words, 0 for NFAs too big for the tables
+	template <size_t W>
+	bool run(const std::string &s) const;
+
+	std::array<uint8_t, 256> m_byte_classes;
+	size_t m_class_count;
+	size_t m_positions;
+	size_t m_words;
+
+	// follow() of each position, and which positions read each byte class
+	std::vector<uint64_t> m_follow;
+	std::vector<uint64_t> m_reads;
+	std::vector<uint64_t> m_final;
+
+	// m_tables[((w * 8 + k) * 256 + b) * m_words..] is follow() of the positions
+	// in byte k of word w when that byte is b. Empty for NFAs that don't fit.
+	std::vector<uint64_t> m_tables;
+};
\ No newline at end of file
@@ -5,5 +5,14 @@
 
 namespace FAUtils
 {
-	bool nfa_to_dfa(const NDFiniteAutomaton &nfa, DFiniteAutomaton &dfa);
+	// With more than one thread, subsets are explored by all of them at once and
+	// the DFA is renumbered afterwards, so it comes out the same either way
+	bool nfa_to_dfa(const NDFiniteAutomaton &nfa, DFiniteAutomaton &dfa, size_t threads = 1);
+	bool is_dfa(const FiniteAutomaton &fa);
+
+	// Hopcroft's partition refinement. States that can't be reached or can't
+	// reach a final state are dropped, so the result is partial like the DFAs
+	// nfa_to_dfa makes, with states numbered breadth first and labelled q<id>.
+	// Fails when dfa isn't deterministic or doesn't have exactly one initial state.
+	bool minimize(const DFiniteAutomaton &dfa, DFiniteAutomaton &minimal);
 }
\ No newline at end of file
@@ -1,8 +1,18 @@
 #pragma once
 
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <map>
 #include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+class Matcher;
 
 
 // This is a bit over-complicated for what it does, but eh :)
@@ -40,14 +50,75 @@ struct State
 
 class FiniteAutomaton
 {
+public:
+	// States and symbols are numbered from 0 in the order they were added
+	typedef uint32_t StateId;
+	typedef uint32_t SymbolId;
+
+	// Empty symbol, every automaton interns it first
+	static const SymbolId epsilon = 0;
+
+	struct Edge
+	{
+		SymbolId symbol;
+		StateId to;
+
+		bool operator<(const Edge &rhs) const { return symbol < rhs.symbol || (symbol == rhs.symbol && to < rhs.to); }
+		bool operator==(const Edge &rhs) const { return symbol == rhs.symbol && to == rhs.to; }
+	};
+
+	// Transitions leaving one state, sorted by symbol and then by target
+	struct Edges
+	{
+		const Edge *first;
+		const Edge *last;
+
+		const Edge *begin() const { return first; }
+		const Edge *end() const { return last; }
+		size_t size() const { return static_cast<size_t>(last - first); }
+		bool empty() const { return first == last; }
+	};
+
 protected:
 	std::set<std::string> m_alphabet;
-	
-	// q0: State, ..
-	std::map<std::string, State> m_states;
 
-	// q0: { a: { q1, q2 }, b: { q3 } } 
-	std::map<std::string, std::map<std::string, std::set<std::string>>> m_state_table;
+	// Labels only matter when reading and writing files (and for looking states
+	// up by name), everything else goes by id
+	std::vector<State> m_states;
+	std::vector<std::string> m_labels;
+	std::unordered_map<std::string, StateId> m_state_ids;
+
+	std::vector<std::string> m_symbols;
+	std::unordered_map<std::string, SymbolId> m_symbol_ids;
+
+	// Transitions in CSR form, state s owns m_edges[m_offsets[s]] up to m_edges[m_offsets[s + 1]].
+	// New transitions wait in m_pending until the next lookup merges them in.
+	mutable std::vector<uint32_t> m_offsets;
+	mutable std::vector<Edge> m_edges;
+	mutable std::vector<std::pair<StateId, Edge>> m_pending;
+
+	// Compiled form of the automaton accept() runs on, built on first use and
+	// dropped whenever the automaton changes
+	mutable std::shared_ptr<const Matcher> m_matcher;
+
+	// Held while the Matcher is built, which compacts the transitions. Copies
+	// of the automaton get a mutex of their own.
+	struct BuildMutex
+	{
+		std::mutex mutex;
+
+		BuildMutex() { ; }
+		BuildMutex(const BuildMutex &) { ; }
+		BuildMutex &operator=(const BuildMutex &) { return *this; }
+	};
+	mutable BuildMutex m_build;
+
+	// Epsilon closures, one bitset row per strongly connected component of the
+	// epsilon edges, state s uses row m_closure_of[s]. Built on first use.
+	mutable std::vector<uint64_t> m_closures;
+	mutable std::vector<uint32_t> m_closure_of;
+
+	void closeEpsilon() const;
 
 	FiniteAutomaton(const std::set<std::string> &alphabet);
 
@@ -76,22 +147,62 @@ public:
 	[transition_n]
 	<EOL>
 	*/
+
 	Status read(const std::string &filename);
 	Status write(const std::string &filename) const;
-	bool accept(const std::string &s);
 
+	// TODO: This should be only in DFiniteAutomaton
+	bool accept(const std::string &s) const;
+	// Bit i of accepted is set when strings[i] is accepted, see Matcher
+	void accept(const std::vector<std::string> &strings, std::vector<uint64_t> &accepted) const;
+
+	// The Matcher accept() uses. Threads can keep it and match with it on their
+	// own, it stays valid even after the automaton is changed or destroyed.
+	// Threads sharing the automaton may call compile() and accept() at the same
+	// time, one of them builds the Matcher while the others wait.
+	std::shared_ptr<const Matcher> compile() const;
+
+	// States reached through epsilon transitions are also added to done
 	std::set<std::string> closure(const std::set<std::string> &states, std::set<std::string> &done) const;
+	// bits |= closure of every state in bits, rows are StateBits::words(getStateCount()) long
+	void closure(uint64_t *bits) const;
+	const uint64_t *getClosure(StateId id) const;
 	std::set<std::string> transitions(const std::set<std::string> &from, const std::string &symbol) const;
 
+	// New states are labelled q<id>
+	StateId addState(uint8_t type);
 	bool addState(const std::string &label, uint8_t type, bool mod = false);
-	void addSymbol(const std::string &symbol);
+	SymbolId addSymbol(const std::string &symbol);
+	void addTransition(StateId from, SymbolId symbol, StateId to);
 	bool addTransition(const std::string &from, const std::string &symbol, const std::string &to);
 
+	bool findState(const std::string &label, StateId &id) const;
+	bool findSymbol(const std::string &symbol, SymbolId &id) const;
+
+	// Merges transitions added since the last lookup. Lookups do this on their own,
+	// so threads sharing an automaton have to call it before they start, unless
+	// they only use compile() and accept().
+	void compact() const;
+
+	Edges getEdges(StateId from) const;
+	Edges getEdges(StateId from, SymbolId symbol) const;
+
+	// Splits all 256 bytes into classes that every state treats the same way (same
+	// targets in the same states) and returns the number of classes. Classes are
+	// numbered in the order of their smallest byte. Only symbols that are a single
+	// character stand for a byte, longer ones can't be matched by accept anyway.
+	size_t byteClasses(std::array<uint8_t, 256> &classes) const;
+
 	const std::set<std::string> &getAlphabet() const { return m_alphabet; }
-	const std::map<std::string, State> &getStates() const { return m_states; }
-	const std::map<std::string, std::map<std::string, std::set<std::string>>> &getStateTable() const { return m_state_table; }
+	const std::vector<State> &getStates() const { return m_states; }
+	const State &getState(StateId id) const { return m_states[id]; }
+	const State &getState(const std::string &label) const { return m_states[m_state_ids.at(label)]; }
+	const std::string &getLabel(StateId id) const { return m_labels[id]; }
+	const std::vector<std::string> &getSymbols() const { return m_symbols; }
+	const std::string &getSymbol(SymbolId id) const { return m_symbols[id]; }
+	size_t getStateCount() const { return m_states.size(); }
 
-	void setAlphabet(const std::set<std::string> &alphabet) { m_alphabet = alphabet; }
+	void setAlphabet(const std::set<std::string> &alphabet);
 
 #ifdef _TESTS
 	std::set<std::string> getStateTransitions(const std::string &st) const;
@@ -104,7 +215,7 @@ class NDFiniteAutomaton : public FiniteAutomaton
 public:
 	// This is a little hack because when we read automaton from a file
 	// "epsilon" (empty) symbol is not actually defined, so we just assume it exists
-	NDFiniteAutomaton() : FiniteAutomaton({ "" })
+	NDFiniteAutomaton() : FiniteAutomaton(std::set<std::string>{ "" })
 	{
 		;
 	}
@@ -114,7 +225,7 @@ public:
 class DFiniteAutomaton : public FiniteAutomaton
 {
 public:
-	DFiniteAutomaton() : FiniteAutomaton({ })
+	DFiniteAutomaton() : FiniteAutomaton(std::set<std::string>{ })
 	{
 		;
 	}
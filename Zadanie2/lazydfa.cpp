@@ -0,0 +1,163 @@
+#include <algorithm>
+
+#include "lazydfa.hpp"
+#include "statebits.hpp"
+
+
+const size_t LazyDFA::default_memory_limit;
+const uint32_t LazyDFA::unknown;
+const uint32_t LazyDFA::dead;
+
+
+LazyDFA::LazyDFA(const NDFiniteAutomaton &nfa, size_t memory_limit) :
+	m_class_count{ nfa.byteClasses(m_byte_classes) },
+	m_moves(nfa, classSymbols(nfa, m_byte_classes), m_class_count),
+	m_subsets(m_moves.words),
+	m_scratch(m_moves.words, 0)
+{
+	// One more state costs its transitions, its set and the table entry pointing at it.
+	// Two states are the least that can work, where it's at and where it's going.
+	const size_t state_bytes = m_class_count * sizeof(uint32_t) + 1 + m_moves.words * sizeof(uint64_t) + 2 * sizeof(uint64_t);
+	m_capacity = std::min<size_t>(std::max<size_t>(memory_limit / state_bytes, 2), dead - 1);
+	m_chunks.resize((m_capacity + chunk_size - 1) / chunk_size);
+
+	bool full;
+	add(m_moves.initial.data(), full);
+}
+
+
+bool LazyDFA::accept(const std::string &s) const
+{
+	std::shared_lock<std::shared_mutex> matching(m_matching);
+
+	// The initial state is always 0, flushes add it first
+	uint32_t state = 0;
+	for (char c : s)
+	{
+		const size_t byte_class = m_byte_classes[static_cast<uint8_t>(c)];
+		uint32_t next = transition(state, byte_class).load(std::memory_order_acquire);
+		if (next == unknown)
+		{
+			next = step(state, byte_class, matching);
+		}
+
+		if (next == dead)
+		{
+			return false;
+		}
+
+		state = next - 1;
+	}
+
+	return isFinal(state);
+}
+
+
+size_t LazyDFA::getStateCount() const
+{
+	std::lock_guard<std::mutex> adding(m_adding);
+	return m_subsets.size();
+}
+
+
+uint32_t LazyDFA::step(uint32_t state, size_t byte_class, std::shared_lock<std::shared_mutex> &matching) const
+{
+	std::unique_lock<std::mutex> adding(m_adding);
+
+	// Somebody else may have got here first
+	uint32_t next = transition(state, byte_class).load(std::memory_order_acquire);
+	if (next != unknown)
+	{
+		return next;
+	}
+
+	std::fill(m_scratch.begin(), m_scratch.end(), 0);
+	m_moves.step(m_subsets.get(state), byte_class, m_scratch.data());
+	if (!StateBits::any(m_scratch.data(), m_scratch.size()))
+	{
+		transition(state, byte_class).store(dead, std::memory_order_release);
+		return dead;
+	}
+
+	bool full;
+	next = add(m_scratch.data(), full);
+	if (!full)
+	{
+		transition(state, byte_class).store(next, std::memory_order_release);
+		return next;
+	}
+
+	// Out of room. Where this thread is going is all it needs to carry on, so it
+	// keeps that, lets go of the cache and flushes it once no thread is matching.
+	const std::vector<uint64_t> target(m_scratch);
+	do
+	{
+		const size_t flushes = m_flushes;
+		adding.unlock();
+		matching.unlock();
+		{
+			std::unique_lock<std::shared_mutex> flushing(m_matching);
+			if (m_flushes == flushes)
+			{
+				flush();
+			}
+		}
+
+		matching.lock();
+		adding.lock();
+		next = add(target.data(), full);
+	} while (full);
+
+	return next;
+}
+
+
+uint32_t LazyDFA::add(const uint64_t *bits, bool &full) const
+{
+	const uint64_t hash = StateBits::hash(bits, m_moves.words);
+
+	uint32_t id;
+	full = false;
+	if (m_subsets.find(bits, hash, id))
+	{
+		return id + 1;
+	}
+
+	if (m_subsets.size() >= m_capacity)
+	{
+		full = true;
+		return unknown;
+	}
+
+	bool added;
+	id = m_subsets.insert(bits, hash, added);
+
+	std::unique_ptr<Chunk> &chunk = m_chunks[id >> chunk_bits];
+	if (!chunk)
+	{
+		chunk.reset(new Chunk);
+		chunk->next.reset(new std::atomic<uint32_t>[chunk_size * m_class_count]());
+	}
+
+	chunk->final[id & (chunk_size - 1)] = m_moves.type(bits) == State::Type::FINAL;
+	return id + 1;
+}
+
+
+void LazyDFA::flush() const
+{
+	// Chunks stay allocated, only the transitions that were used are cleared
+	for (uint32_t id = 0; id < m_subsets.size(); id++)
+	{
+		for (size_t c = 0; c < m_class_count; c++)
+		{
+			transition(id, c).store(unknown, std::memory_order_relaxed);
+		}
+	}
+
+	m_subsets.clear();
+
+	bool full;
+	add(m_moves.initial.data(), full);
+	m_flushes++;
+}
\ No newline at end of file
@@ -1,19 +1,49 @@
 #include <iostream>
+#include <cstdio>
+#include <vector>
+#include <map>
+#include <random>
 
 #include "fautils.hpp"
+#include "lazydfa.hpp"
+#include "bitnfa.hpp"
+#include "matcher.hpp"
 
 
-#ifndef _TESTS
+// The benchmark build brings its own main (bench.cpp)
+#if !defined(_TESTS) && !defined(_BENCHMARK)
 
 int main(int argc, char **argv)
 {
-	if (argc < 3)
+	// Options can go anywhere on the command line
+	bool minimize = false, lazy = false;
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; i++)
 	{
-		std::cerr << "Usage: " << argv[0] << " <in_nfa> <out_dfa>\n";
+		const std::string arg(argv[i]);
+		if (arg == "--minimize")
+		{
+			minimize = true;
+		}
+		else if (arg == "--lazy")
+		{
+			lazy = true;
+		}
+		else
+		{
+			args.push_back(arg);
+		}
+	}
+
+	// A lazy DFA is never built as a whole, so there's no DFA to write
+	if (args.size() < (lazy ? 1 : 2))
+	{
+		std::cerr << "Usage: " << argv[0] << " [--minimize] <in_nfa> <out_dfa>\n";
+		std::cerr << "       " << argv[0] << " --lazy <in_nfa>\n";
 		return EXIT_FAILURE;
 	}
 
-	std::string in_nfa(argv[1]), out_dfa(argv[2]);
+	std::string in_nfa(args[0]), out_dfa(lazy ? std::string() : args[1]);
 
 	NDFiniteAutomaton nfa;
 	if (nfa.read(in_nfa) != FiniteAutomaton::Status::OK)
@@ -25,15 +55,40 @@ int main(int argc, char **argv)
 	std::cout << "[+] NFA was read from file \"" << in_nfa << "\"\n";
 
 	DFiniteAutomaton dfa;
-	FAUtils::nfa_to_dfa(nfa, dfa);
-	
-	if (dfa.write(out_dfa) != FiniteAutomaton::Status::OK)
+
+	// Small NFAs are run as they are, bigger ones get a lazy DFA
+	std::unique_ptr<BitNFA> bit_nfa;
+	std::unique_ptr<LazyDFA> lazy_dfa;
+	if (lazy && BitNFA::fits(nfa))
 	{
-		std::cerr << "Failed to write DFA to \"" << out_dfa << "\"\n";
-		return EXIT_FAILURE;
+		bit_nfa.reset(new BitNFA(nfa));
+		std::cout << "[+] Matching with a bit-parallel NFA of " << bit_nfa->getPositionCount() << " positions\n";
+	}
+	else if (lazy)
+	{
+		lazy_dfa.reset(new LazyDFA(nfa));
+		std::cout << "[+] Matching with a lazy DFA, states are made as the input needs them\n";
 	}
+	else
+	{
+		FAUtils::nfa_to_dfa(nfa, dfa);
 
-	std::cout << "[+] DFA converted from NFA was written to \"" << out_dfa << "\"\n";
+		if (minimize)
+		{
+			DFiniteAutomaton minimal;
+			FAUtils::minimize(dfa, minimal);
+			std::cout << "[+] DFA minimized from " << dfa.getStateCount() << " to " << minimal.getStateCount() << " states\n";
+			dfa = minimal;
+		}
+
+		if (dfa.write(out_dfa) != FiniteAutomaton::Status::OK)
+		{
+			std::cerr << "Failed to write DFA to \"" << out_dfa << "\"\n";
+			return EXIT_FAILURE;
+		}
+
+		std::cout << "[+] DFA converted from NFA was written to \"" << out_dfa << "\"\n";
+	}
 
 	std::string str;
 	bool valid = false;
@@ -52,7 +107,7 @@ int main(int argc, char **argv)
 			}
 		} while (!valid);
 
-		if (dfa.accept(str))
+		if (bit_nfa ? bit_nfa->accept(str) : lazy ? lazy_dfa->accept(str) : dfa.accept(str))
 		{
 			std::cout << "ACCEPT\n";
 		}
@@ -65,7 +120,7 @@ int main(int argc, char **argv)
 	return EXIT_SUCCESS;
 }
 
-#else
+#elif defined(_TESTS)
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
@@ -77,8 +132,8 @@ TEST_CASE("Load 1_nka.txt", "[load]")
 	REQUIRE(fa.read("tests/1_nka.txt") == FiniteAutomaton::Status::OK);
 	REQUIRE(fa.getAlphabet().size() == 3);
 	REQUIRE(fa.getStates().size() == 2);
-	REQUIRE(fa.getStates().at("q0").type == (State::Type::INITIAL | State::Type::FINAL));
-	REQUIRE(fa.getStates().at("q1").type == State::Type::NONE);
+	REQUIRE(fa.getState("q0").type == (State::Type::INITIAL | State::Type::FINAL));
+	REQUIRE(fa.getState("q1").type == State::Type::NONE);
 	REQUIRE(fa.getAlphabet().count("a"));
 	REQUIRE(fa.getAlphabet().count("b"));
 	REQUIRE(fa.getAlphabet().count(""));
@@ -100,9 +155,9 @@ TEST_CASE("Load 2_nka.txt", "[load]")
 	REQUIRE(fa.read("tests/2_nka.txt") == FiniteAutomaton::Status::OK);
 	REQUIRE(fa.getAlphabet().size() == 3);
 	REQUIRE(fa.getStates().size() == 3);
-	REQUIRE(fa.getStates().at("q0").type == (State::Type::INITIAL | State::Type::FINAL));
-	REQUIRE(fa.getStates().at("q1").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q2").isFinal());
+	REQUIRE(fa.getState("q0").type == (State::Type::INITIAL | State::Type::FINAL));
+	REQUIRE(fa.getState("q1").type == State::Type::NONE);
+	REQUIRE(fa.getState("q2").isFinal());
 	REQUIRE(fa.getAlphabet().count("a"));
 	REQUIRE(fa.getAlphabet().count("b"));
 	REQUIRE(fa.getAlphabet().count(""));
@@ -127,10 +182,10 @@ TEST_CASE("Load 3_nka.txt", "[load]")
 	REQUIRE(fa.read("tests/3_nka.txt") == FiniteAutomaton::Status::OK);
 	REQUIRE(fa.getAlphabet().size() == 3);
 	REQUIRE(fa.getStates().size() == 4);
-	REQUIRE(fa.getStates().at("q0").isInitial());
-	REQUIRE(fa.getStates().at("q1").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q2").isFinal());
-	REQUIRE(fa.getStates().at("qf").isFinal());
+	REQUIRE(fa.getState("q0").isInitial());
+	REQUIRE(fa.getState("q1").type == State::Type::NONE);
+	REQUIRE(fa.getState("q2").isFinal());
+	REQUIRE(fa.getState("qf").isFinal());
 	REQUIRE(fa.getAlphabet().count("a"));
 	REQUIRE(fa.getAlphabet().count("b"));
 	REQUIRE(fa.getAlphabet().count(""));
@@ -156,17 +211,17 @@ TEST_CASE("Load 4_nka.txt", "[load]")
 	REQUIRE(fa.read("tests/4_nka.txt") == FiniteAutomaton::Status::OK);
 	REQUIRE(fa.getAlphabet().size() == 4);
 	REQUIRE(fa.getStates().size() == 11);
-	REQUIRE(fa.getStates().at("q0").isInitial());
-	REQUIRE(fa.getStates().at("q1").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q2").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q3").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q4").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q5").isFinal());
-	REQUIRE(fa.getStates().at("q6").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q7").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q8").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q9").isFinal());
-	REQUIRE(fa.getStates().at("q10").isFinal());
+	REQUIRE(fa.getState("q0").isInitial());
+	REQUIRE(fa.getState("q1").type == State::Type::NONE);
+	REQUIRE(fa.getState("q2").type == State::Type::NONE);
+	REQUIRE(fa.getState("q3").type == State::Type::NONE);
+	REQUIRE(fa.getState("q4").type == State::Type::NONE);
+	REQUIRE(fa.getState("q5").isFinal());
+	REQUIRE(fa.getState("q6").type == State::Type::NONE);
+	REQUIRE(fa.getState("q7").type == State::Type::NONE);
+	REQUIRE(fa.getState("q8").type == State::Type::NONE);
+	REQUIRE(fa.getState("q9").isFinal());
+	REQUIRE(fa.getState("q10").isFinal());
 	REQUIRE(fa.getAlphabet().count("a"));
 	REQUIRE(fa.getAlphabet().count("b"));
 	REQUIRE(fa.getAlphabet().count("c"));
@@ -216,22 +271,22 @@ TEST_CASE("Load 5_nka.txt", "[load]")
 	REQUIRE(fa.read("tests/5_nka.txt") == FiniteAutomaton::Status::OK);
 	REQUIRE(fa.getAlphabet().size() == 4);
 	REQUIRE(fa.getStates().size() == 16);
-	REQUIRE(fa.getStates().at("q1").isInitial());
-	REQUIRE(fa.getStates().at("q2").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q3").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q4").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q5").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q6").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q7").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q8").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q9").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q10").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q11").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q12").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q13").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q14").isFinal());
-	REQUIRE(fa.getStates().at("q15").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q16").isFinal());
+	REQUIRE(fa.getState("q1").isInitial());
+	REQUIRE(fa.getState("q2").type == State::Type::NONE);
+	REQUIRE(fa.getState("q3").type == State::Type::NONE);
+	REQUIRE(fa.getState("q4").type == State::Type::NONE);
+	REQUIRE(fa.getState("q5").type == State::Type::NONE);
+	REQUIRE(fa.getState("q6").type == State::Type::NONE);
+	REQUIRE(fa.getState("q7").type == State::Type::NONE);
+	REQUIRE(fa.getState("q8").type == State::Type::NONE);
+	REQUIRE(fa.getState("q9").type == State::Type::NONE);
+	REQUIRE(fa.getState("q10").type == State::Type::NONE);
+	REQUIRE(fa.getState("q11").type == State::Type::NONE);
+	REQUIRE(fa.getState("q12").type == State::Type::NONE);
+	REQUIRE(fa.getState("q13").type == State::Type::NONE);
+	REQUIRE(fa.getState("q14").isFinal());
+	REQUIRE(fa.getState("q15").type == State::Type::NONE);
+	REQUIRE(fa.getState("q16").isFinal());
 	REQUIRE(fa.getAlphabet().count("a"));
 	REQUIRE(fa.getAlphabet().count("b"));
 	REQUIRE(fa.getAlphabet().count("c"));
@@ -298,11 +353,11 @@ TEST_CASE("Load cviko_nka.txt", "[load]")
 	REQUIRE(fa.read("tests/cviko_nka.txt") == FiniteAutomaton::Status::OK);
 	REQUIRE(fa.getAlphabet().size() == 3);
 	REQUIRE(fa.getStates().size() == 5);
-	REQUIRE(fa.getStates().at("q0").isInitial());
-	REQUIRE(fa.getStates().at("q1").isFinal());
-	REQUIRE(fa.getStates().at("q2").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q3").type == State::Type::NONE);
-	REQUIRE(fa.getStates().at("q4").isFinal());
+	REQUIRE(fa.getState("q0").isInitial());
+	REQUIRE(fa.getState("q1").isFinal());
+	REQUIRE(fa.getState("q2").type == State::Type::NONE);
+	REQUIRE(fa.getState("q3").type == State::Type::NONE);
+	REQUIRE(fa.getState("q4").isFinal());
 	REQUIRE(fa.getAlphabet().count("a"));
 	REQUIRE(fa.getAlphabet().count("b"));
 	REQUIRE(fa.getAlphabet().count(""));
@@ -342,6 +397,58 @@ TEST_CASE("Closure cviko_nka.txt", "[closure]")
 	REQUIRE(fa.closure({ "q1", "q2", "q3" }, d6) == std::set<std::string>{ "q0", "q1", "q2", "q3" });
 }
 
+TEST_CASE("Closure closure_loop_nka.txt", "[closure]")
+{
+	NDFiniteAutomaton fa;
+
+	REQUIRE(fa.read("tests/closure_loop_nka.txt") == FiniteAutomaton::Status::OK);
+	std::set<std::string> d1, d2, d3;
+	REQUIRE(fa.closure({ "q0" }, d1) == std::set<std::string>{ "q0", "q1", "q2", "q3", "q7" });
+	REQUIRE(d1 == std::set<std::string>{ "q1", "q2", "q3", "q7" });
+	REQUIRE(fa.closure({ "q6" }, d2) == std::set<std::string>{ "q1", "q2", "q3", "q6", "q7" });
+	REQUIRE(fa.closure({ "q4", "q8" }, d3) == std::set<std::string>{ "q4", "q5", "q8" });
+
+	// q1 and q2 loop into each other, so they share their closure
+	FiniteAutomaton::StateId q1, q2;
+	REQUIRE(fa.findState("q1", q1));
+	REQUIRE(fa.findState("q2", q2));
+	REQUIRE(fa.getClosure(q1) == fa.getClosure(q2));
+
+	uint64_t bits = uint64_t(1) << q2;
+	fa.closure(&bits);
+	REQUIRE(bits == *fa.getClosure(q1));
+}
+
+TEST_CASE("Closure of a long epsilon cycle", "[closure]")
+{
+	NDFiniteAutomaton fa;
+
+	const FiniteAutomaton::StateId count = 5000;
+	for (FiniteAutomaton::StateId i = 0; i < count; i++)
+	{
+		fa.addState(State::Type::NONE);
+	}
+
+	// 0 -> 1 -> .. -> 3999 -> 0, and a chain up to 4999 hanging off 2000
+	for (FiniteAutomaton::StateId i = 0; i < 4000; i++)
+	{
+		fa.addTransition(i, FiniteAutomaton::epsilon, (i + 1) % 4000);
+	}
+
+	for (FiniteAutomaton::StateId i = 4000; i + 1 < count; i++)
+	{
+		fa.addTransition(i, FiniteAutomaton::epsilon, i + 1);
+	}
+
+	fa.addTransition(2000, FiniteAutomaton::epsilon, 4000);
+
+	std::set<std::string> done;
+	REQUIRE(fa.closure({ "q0" }, done).size() == count);
+	REQUIRE(fa.closure({ "q4500" }, done).size() == 500);
+	REQUIRE(fa.getClosure(0) == fa.getClosure(3999));
+	REQUIRE(fa.getClosure(4000) != fa.getClosure(4001));
+}
+
 TEST_CASE("Transitions cviko_nka.txt", "[closure]")
 {
 	NDFiniteAutomaton fa;
@@ -359,6 +466,25 @@ TEST_CASE("Transitions cviko_nka.txt", "[closure]")
 	REQUIRE(fa.transitions({ "q0", "q1", "q2", "q3" }, "b") == std::set<std::string>{ "q2", "q3", "q4" });
 }
 
+TEST_CASE("Write 5_nka.txt", "[load]")
+{
+	NDFiniteAutomaton fa, written;
+
+	REQUIRE(fa.read("tests/5_nka.txt") == FiniteAutomaton::Status::OK);
+	REQUIRE(fa.write("5_nka_written.txt") == FiniteAutomaton::Status::OK);
+	REQUIRE(written.read("5_nka_written.txt") == FiniteAutomaton::Status::OK);
+	std::remove("5_nka_written.txt");
+
+	REQUIRE(written.getAlphabet() == fa.getAlphabet());
+	REQUIRE(written.getStates().size() == fa.getStates().size());
+	for (FiniteAutomaton::StateId id = 0; id < fa.getStateCount(); id++)
+	{
+		const std::string &label = fa.getLabel(id);
+		REQUIRE(written.getState(label).type == fa.getState(id).type);
+		REQUIRE(written.getStateTransitions(label) == fa.getStateTransitions(label));
+	}
+}
+
 TEST_CASE("Convert 1_nka.txt", "[convert]")
 {
 	NDFiniteAutomaton nka;
@@ -616,4 +742,228 @@ TEST_CASE("Accept closure_loop.txt", "[accept]")
 	REQUIRE(!dka_test.accept("babababaac"));
 }
 
+TEST_CASE("Accept through a compiled matcher", "[accept]")
+{
+	DFiniteAutomaton empty;
+	REQUIRE(!empty.accept(""));
+	REQUIRE(!empty.accept("a"));
+
+	DFiniteAutomaton dka;
+	REQUIRE(dka.read("tests/closure_loop_dka.txt") == FiniteAutomaton::Status::OK);
+
+	// Built once and kept while the automaton stays the same
+	const std::shared_ptr<const Matcher> matcher = dka.compile();
+	REQUIRE(matcher == dka.compile());
+	REQUIRE(matcher->getStateCount() == dka.getStateCount());
+	REQUIRE(matcher->accept("babababac"));
+	REQUIRE(!matcher->accept("babababaac"));
+	REQUIRE(!matcher->accept(std::string("ba\0c", 4)));
+
+	// A change makes a new one, the old one still matches what it was made from
+	const FiniteAutomaton::StateId to = dka.addState(State::Type::FINAL);
+	dka.addTransition(0, dka.addSymbol("d"), to);
+
+	REQUIRE(matcher != dka.compile());
+	REQUIRE(dka.accept("d"));
+	REQUIRE(!matcher->accept("d"));
+	REQUIRE(matcher->accept("c") == dka.accept("c"));
+}
+
+TEST_CASE("Accept a batch of strings", "[accept]")
+{
+	// Nothing to start from rejects everything
+	DFiniteAutomaton empty;
+	std::vector<uint64_t> accepted;
+	empty.accept({ "", "a" }, accepted);
+	REQUIRE(accepted == std::vector<uint64_t>{ 0 });
+
+	std::mt19937 rng(50);
+	for (int round = 0; round < 100; round++)
+	{
+		const size_t states = 1 + rng() % 20, symbols = 1 + rng() % 3;
+
+		DFiniteAutomaton dka;
+		for (size_t s = 0; s < states; s++)
+		{
+			dka.addState((s == 0 ? State::Type::INITIAL : State::Type::NONE) | (rng() % 3 == 0 ? State::Type::FINAL : State::Type::NONE));
+		}
+
+		for (FiniteAutomaton::StateId s = 0; s < states; s++)
+		{
+			for (size_t a = 0; a < symbols; a++)
+			{
+				if (rng() % 5)
+				{
+					dka.addTransition(s, dka.addSymbol(std::string(1, static_cast<char>('a' + a))), static_cast<FiniteAutomaton::StateId>(rng() % states));
+				}
+			}
+		}
+
+		// Fewer strings than lanes, exactly as many, and plenty. Empty strings and
+		// bytes the automaton has no symbol for are mixed in.
+		const size_t counts[] = { 0, 1, Matcher::lanes - 1, Matcher::lanes, Matcher::lanes + 1, 500 };
+		std::vector<std::string> strings(counts[round % 6]);
+		for (std::string &s : strings)
+		{
+			for (size_t len = rng() % 20; len > 0; len--)
+			{
+				s += static_cast<char>('a' + rng() % (symbols + 1));
+			}
+		}
+
+		dka.accept(strings, accepted);
+		REQUIRE(accepted.size() == (strings.size() + 63) / 64);
+
+		bool same = true;
+		for (size_t i = 0; i < strings.size(); i++)
+		{
+			same = same && ((accepted[i / 64] >> (i % 64)) & 1) == dka.accept(strings[i]);
+		}
+
+		REQUIRE(same);
+	}
+}
+
+// Moore's refinement over every pair of blocks, slow but easy to trust. Counts
+// the states of the minimal partial DFA: reachable ones that can reach a final state.
+size_t mooreStates(const DFiniteAutomaton &dfa, size_t symbols)
+{
+	const size_t n = dfa.getStateCount();
+	std::vector<std::vector<int>> next(n + 1, std::vector<int>(symbols, static_cast<int>(n)));
+	for (FiniteAutomaton::StateId s = 0; s < n; s++)
+	{
+		for (const FiniteAutomaton::Edge &e : dfa.getEdges(s))
+		{
+			next[s][e.symbol - 1] = static_cast<int>(e.to);
+		}
+	}
+
+	std::vector<int> block(n + 1, 0), reachable(n + 1, 0);
+	for (FiniteAutomaton::StateId s = 0; s < n; s++)
+	{
+		block[s] = dfa.getState(s).isFinal();
+		reachable[s] = dfa.getState(s).isInitial();
+	}
+
+	for (bool changed = true; changed; )
+	{
+		changed = false;
+		for (size_t s = 0; s <= n; s++)
+		{
+			for (size_t a = 0; a < symbols && reachable[s]; a++)
+			{
+				changed = changed || !reachable[next[s][a]];
+				reachable[next[s][a]] = 1;
+			}
+		}
+
+		std::map<std::vector<int>, int> ids;
+		std::vector<int> refined(n + 1);
+		for (size_t s = 0; s <= n; s++)
+		{
+			std::vector<int> signature{ block[s] };
+			for (size_t a = 0; a < symbols; a++)
+			{
+				signature.push_back(block[next[s][a]]);
+			}
+
+			refined[s] = ids.insert(std::make_pair(signature, static_cast<int>(ids.size()))).first->second;
+		}
+
+		changed = changed || std::set<int>(block.begin(), block.end()).size() != ids.size();
+		block = refined;
+	}
+
+	std::set<int> live;
+	for (size_t s = 0; s < n; s++)
+	{
+		if (reachable[s] && block[s] != block[n])
+		{
+			live.insert(block[s]);
+		}
+	}
+
+	return std::max<size_t>(live.size(), 1);
+}
+
+TEST_CASE("Minimize samples", "[minimize]")
+{
+	for (const char *name : { "1", "2", "3", "4", "5", "cviko", "closure_loop" })
+	{
+		DFiniteAutomaton dka, minimal, again;
+		REQUIRE(dka.read(std::string("tests/") + name + "_dka.txt") == FiniteAutomaton::Status::OK);
+		REQUIRE(FAUtils::minimize(dka, minimal));
+		REQUIRE(minimal.getStateCount() == mooreStates(dka, dka.getSymbols().size() - 1));
+		REQUIRE(FAUtils::minimize(minimal, again));
+		REQUIRE(again.getStateCount() == minimal.getStateCount());
+	}
+
+	NDFiniteAutomaton nka;
+	DFiniteAutomaton dka, minimal;
+	REQUIRE(nka.read("tests/closure_loop_nka.txt") == FiniteAutomaton::Status::OK);
+	REQUIRE(FAUtils::nfa_to_dfa(nka, dka));
+	REQUIRE(FAUtils::minimize(dka, minimal));
+	REQUIRE(minimal.getStateCount() < dka.getStateCount());
+	REQUIRE(minimal.accept("babababac"));
+	REQUIRE(!minimal.accept("babababaac"));
+
+	// Not deterministic
+	DFiniteAutomaton nondeterministic, unused;
+	nondeterministic.setAlphabet({ "a" });
+	nondeterministic.addState("p", State::Type::INITIAL);
+	nondeterministic.addState("q", State::Type::FINAL);
+	nondeterministic.addTransition("p", "a", "p");
+	nondeterministic.addTransition("p", "a", "q");
+	REQUIRE(!FAUtils::minimize(nondeterministic, unused));
+}
+
+TEST_CASE("Minimize random DFAs", "[minimize]")
+{
+	std::mt19937 rng(45);
+	for (int round = 0; round < 200; round++)
+	{
+		const size_t states = 1 + rng() % 40, symbols = 1 + rng() % 3;
+
+		DFiniteAutomaton dka;
+		std::set<std::string> alphabet;
+		for (size_t a = 0; a < symbols; a++)
+		{
+			alphabet.insert(std::string(1, static_cast<char>('a' + a)));
+		}
+
+		dka.setAlphabet(alphabet);
+		for (size_t s = 0; s < states; s++)
+		{
+			dka.addState((s == 0 ? State::Type::INITIAL : State::Type::NONE) | (rng() % 4 == 0 ? State::Type::FINAL : State::Type::NONE));
+		}
+
+		// Few distinct targets make plenty of equivalent states, some transitions are left out
+		for (FiniteAutomaton::StateId s = 0; s < states; s++)
+		{
+			for (FiniteAutomaton::SymbolId a = 1; a <= symbols; a++)
+			{
+				if (rng() % 5)
+				{
+					dka.addTransition(s, a, static_cast<FiniteAutomaton::StateId>(rng() % states));
+				}
+			}
+		}
+
+		DFiniteAutomaton minimal;
+		REQUIRE(FAUtils::minimize(dka, minimal));
+		REQUIRE(minimal.getStateCount() == mooreStates(dka, symbols));
+
+		for (int k = 0; k < 50; k++)
+		{
+			std::string s;
+			for (size_t len = rng() % 12; len > 0; len--)
+			{
+				s += static_cast<char>('a' + rng() % symbols);
+			}
+
+			REQUIRE(minimal.accept(s) == dka.accept(s));
+		}
+	}
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include <algorithm>
+
+#include "matcher.hpp"
+#include "statebits.hpp"
+
+
+const size_t Matcher::lanes;
+
+
+Matcher::Matcher(const FiniteAutomaton &fa) :
+	m_class_count{ fa.byteClasses(m_byte_classes) },
+	m_states{ fa.getStateCount() }
+{
+	const size_t width = m_class_count;
+	m_dead = static_cast<uint32_t>(m_states * width);
+	m_start = m_dead;
+	m_table.assign(m_dead + width, m_dead);
+	m_final.assign(StateBits::words(m_states + 1), 0);
+
+	for (FiniteAutomaton::StateId id = 0; id < m_states; id++)
+	{
+		if (fa.getState(id).isFinal())
+		{
+			StateBits::set(m_final.data(), id);
+		}
+
+		if (fa.getState(id).isInitial() && m_start == m_dead)
+		{
+			m_start = static_cast<uint32_t>(id * width);
+		}
+
+		for (const FiniteAutomaton::Edge &e : fa.getEdges(id))
+		{
+			const std::string &symbol = fa.getSymbol(e.symbol);
+			uint32_t &next = m_table[id * width + m_byte_classes[static_cast<unsigned char>(symbol[0])]];
+			if (symbol.size() == 1 && next == m_dead)
+			{
+				next = static_cast<uint32_t>(e.to * width);
+			}
+		}
+	}
+}
+
+
+bool Matcher::accept(const char *data, size_t size) const
+{
+	const uint32_t *table = m_table.data();
+	const uint8_t *classes = m_byte_classes.data();
+
+	uint32_t state = m_start;
+	for (size_t i = 0; i < size; i++)
+	{
+		state = table[state + classes[static_cast<unsigned char>(data[i])]];
+		if (state == m_dead)
+		{
+			// There's no transition from current state to new state using this symbol
+			return false;
+		}
+	}
+
+	return StateBits::test(m_final.data(), state / m_class_count);
+}
+
+
+void Matcher::accept(const std::string *strings, size_t count, uint64_t *accepted) const
+{
+	std::fill(accepted, accepted + StateBits::words(count), 0);
+
+	const uint32_t *table = m_table.data();
+	const uint8_t *classes = m_byte_classes.data();
+
+	const unsigned char *at[lanes], *end[lanes];
+	uint32_t state[lanes];
+	size_t index[lanes];
+
+	// Every lane walks a string of its own, a lane that's done takes the next one.
+	// Once they run out the lanes are packed down to the ones still going.
+	size_t active = 0, next = 0;
+	const auto start = [&](size_t l) {
+		const std::string &s = strings[next];
+		at[l] = reinterpret_cast<const unsigned char *>(s.data());
+		end[l] = at[l] + s.size();
+		state[l] = m_start;
+		index[l] = next++;
+	};
+
+	for (; active < lanes && next < count; active++)
+	{
+		start(active);
+	}
+
+	while (active)
+	{
+		for (size_t l = 0; l < active; )
+		{
+			if (at[l] != end[l] && state[l] != m_dead)
+			{
+				state[l] = table[state[l] + classes[*at[l]++]];
+				l++;
+				continue;
+			}
+
+			if (StateBits::test(m_final.data(), state[l] / m_class_count))
+			{
+				StateBits::set(accepted, index[l]);
+			}
+
+			if (next < count)
+			{
+				start(l);
+			}
+			else
+			{
+				active--;
+				at[l] = at[active];
+				end[l] = end[active];
+				state[l] = state[active];
+				index[l] = index[active];
+			}
+		}
+	}
+}
\ No newline at end of file
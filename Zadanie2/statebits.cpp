@@ -0,0 +1,84 @@
+#include <cstring>
+
+#include "statebits.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define STATE_BITS_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STATE_BITS_SSE2
+#endif
+
+
+void StateBits::unite(uint64_t *dst, const uint64_t *src, size_t words)
+{
+	size_t w = 0;
+
+#if defined(STATE_BITS_AVX2)
+	for (; w + 4 <= words; w += 4)
+	{
+		const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + w));
+		const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + w));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + w), _mm256_or_si256(a, b));
+	}
+#elif defined(STATE_BITS_SSE2)
+	for (; w + 2 <= words; w += 2)
+	{
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + w));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + w));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + w), _mm_or_si128(a, b));
+	}
+#endif
+
+	for (; w < words; w++)
+	{
+		dst[w] |= src[w];
+	}
+}
+
+
+bool StateBits::any(const uint64_t *bits, size_t words)
+{
+	uint64_t all = 0;
+	for (size_t w = 0; w < words; w++)
+	{
+		all |= bits[w];
+	}
+
+	return all != 0;
+}
+
+
+bool StateBits::intersects(const uint64_t *a, const uint64_t *b, size_t words)
+{
+	for (size_t w = 0; w < words; w++)
+	{
+		if (a[w] & b[w])
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+bool StateBits::equal(const uint64_t *a, const uint64_t *b, size_t words)
+{
+	return std::memcmp(a, b, words * sizeof(uint64_t)) == 0;
+}
+
+
+uint64_t StateBits::hash(const uint64_t *bits, size_t words)
+{
+	// Multiply-xorshift over the words, enough to spread sets that differ in a single bit
+	uint64_t h = 0x9e3779b97f4a7c15ull ^ words;
+	for (size_t w = 0; w < words; w++)
+	{
+		h = (h ^ bits[w]) * 0xff51afd7ed558ccdull;
+		h ^= h >> 32;
+	}
+
+	return h;
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+// Sets of state ids as plain arrays of 64-bit words, state i is bit i % 64 of
+// word i / 64. Sets of one automaton all have the same number of words, so many
+// of them can share one buffer and these helpers just take pointers.
+namespace StateBits
+{
+	inline size_t words(size_t states) { return (states + 63) / 64; }
+
+	inline void set(uint64_t *bits, size_t i) { bits[i / 64] |= uint64_t(1) << (i % 64); }
+	inline bool test(const uint64_t *bits, size_t i) { return (bits[i / 64] >> (i % 64)) & 1; }
+
+	inline unsigned lowest(uint64_t word)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanForward64(&index, word);
+		return static_cast<unsigned>(index);
+#elif defined(_MSC_VER)
+		unsigned long index;
+		if (_BitScanForward(&index, static_cast<unsigned long>(word)))
+		{
+			return static_cast<unsigned>(index);
+		}
+
+		_BitScanForward(&index, static_cast<unsigned long>(word >> 32));
+		return static_cast<unsigned>(index) + 32;
+#else
+		return static_cast<unsigned>(__builtin_ctzll(word));
+#endif
+	}
+
+	// dst |= src
+	void unite(uint64_t *dst, const uint64_t *src, size_t words);
+
+	bool any(const uint64_t *bits, size_t words);
+	bool intersects(const uint64_t *a, const uint64_t *b, size_t words);
+	bool equal(const uint64_t *a, const uint64_t *b, size_t words);
+	uint64_t hash(const uint64_t *bits, size_t words);
+
+	// Calls f(i) for every state in the set, in increasing order
+	template <typename F>
+	void forEach(const uint64_t *bits, size_t words, F f)
+	{
+		for (size_t w = 0; w < words; w++)
+		{
+			for (uint64_t word = bits[w]; word; word &= word - 1)
+			{
+				f(w * 64 + lowest(word));
+			}
+		}
+	}
+}
\ No newline at end of file
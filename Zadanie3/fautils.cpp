@@ -1,76 +1,595 @@
 #include <algorithm>
-#include <queue>
-#include <fstream>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "fautils.hpp"
-#include "utils.hpp"
+#include "statebits.hpp"
+#include "subsets.hpp"
 
 
-bool FAUtils::nfa_to_dfa(const NDFiniteAutomaton &nfa, DFiniteAutomaton &dfa)
+namespace
 {
-	std::set<std::string> initial_states, final_states;
-	for (const auto &p : nfa.getStates())
+	// SubsetTable split into shards by the top bits of the hash, each behind its
+	// own lock. Ids come from one counter, so they're dense but in no particular order.
+	class SharedSubsetTable
 	{
-		if (p.second.isInitial())
+	public:
+		explicit SharedSubsetTable(size_t words) :
+			m_words{ words },
+			m_next{ 0 }
 		{
-			initial_states.insert(p.first);
+			for (size_t i = 0; i < shard_count; i++)
+			{
+				m_shards.emplace_back(new Shard(words));
+			}
+		}
+
+		uint32_t insert(const uint64_t *bits, bool &added)
+		{
+			const uint64_t hash = StateBits::hash(bits, m_words);
+			Shard &shard = *m_shards[hash >> (64 - shard_bits)];
+
+			std::lock_guard<std::mutex> lock(shard.lock);
+			const uint32_t local = shard.table.insert(bits, hash, added);
+			if (added)
+			{
+				shard.ids.push_back(m_next++);
+			}
+
+			return shard.ids[local];
+		}
+
+		size_t size() const { return m_next; }
+
+	private:
+		static const size_t shard_bits = 6;
+		static const size_t shard_count = size_t(1) << shard_bits;
+
+		struct Shard
+		{
+			std::mutex lock;
+			SubsetTable table;
+			std::vector<uint32_t> ids;
+
+			explicit Shard(size_t words) : table(words) { ; }
+		};
+
+		size_t m_words;
+		std::atomic<uint32_t> m_next;
+		std::vector<std::unique_ptr<Shard>> m_shards;
+	};
+
+
+	// Subsets waiting to be explored, with their ids. Threads take them in
+	// batches and put back what they found before finishing the batch, so the
+	// work is done once the list is empty and no thread is holding a batch.
+	class SharedWorklist
+	{
+	public:
+		explicit SharedWorklist(size_t words) :
+			m_words{ words }
+		{
+			;
 		}
 
-		if (p.second.isFinal())
+		void push(const std::vector<uint32_t> &ids, const std::vector<uint64_t> &sets)
 		{
-			final_states.insert(p.first);
+			if (ids.empty())
+			{
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_ids.insert(m_ids.end(), ids.begin(), ids.end());
+			m_sets.insert(m_sets.end(), sets.begin(), sets.end());
+			m_ready.notify_all();
+		}
+
+		// Waits while other threads may still add something, false when there's nothing left
+		bool pop(size_t max, std::vector<uint32_t> &ids, std::vector<uint64_t> &sets)
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_ready.wait(lock, [this] { return !m_ids.empty() || !m_busy; });
+			if (m_ids.empty())
+			{
+				return false;
+			}
+
+			const size_t count = std::min(max, m_ids.size());
+			ids.assign(m_ids.end() - count, m_ids.end());
+			sets.assign(m_sets.end() - count * m_words, m_sets.end());
+			m_ids.resize(m_ids.size() - count);
+			m_sets.resize(m_sets.size() - count * m_words);
+			m_busy++;
+			return true;
+		}
+
+		void finish()
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (!--m_busy && m_ids.empty())
+			{
+				m_ready.notify_all();
+			}
+		}
+
+	private:
+		size_t m_words;
+		size_t m_busy{ 0 };
+		std::vector<uint32_t> m_ids;
+		std::vector<uint64_t> m_sets;
+		std::mutex m_lock;
+		std::condition_variable m_ready;
+	};
+
+
+	struct Transition
+	{
+		uint32_t from;
+		uint32_t symbol;
+		uint32_t to;
+	};
+
+	// Explores every subset reachable from the initial one and returns the
+	// types of the DFA states and the transitions between them, numbered the
+	// way SharedSubsetTable handed out ids (the initial subset is 0)
+	void exploreParallel(const SubsetMoves &moves, size_t threads, std::vector<uint8_t> &types, std::vector<Transition> &transitions)
+	{
+		const size_t words = moves.words;
+		SharedSubsetTable subsets(words);
+		SharedWorklist worklist(words);
+
+		bool added;
+		subsets.insert(moves.initial.data(), added);
+		worklist.push({ 0 }, moves.initial);
+
+		// Every thread keeps what it finds to itself until the end
+		std::vector<std::vector<Transition>> found_transitions(threads);
+		std::vector<std::vector<std::pair<uint32_t, uint8_t>>> found_types(threads);
+		found_types[0].push_back(std::make_pair(0, static_cast<uint8_t>(State::Type::INITIAL | moves.type(moves.initial.data()))));
+
+		auto work = [&](size_t thread) {
+			std::vector<uint32_t> ids, new_ids;
+			std::vector<uint64_t> sets, new_sets;
+			std::vector<uint64_t> next(moves.symbols * words, 0);
+			std::vector<uint8_t> touched(moves.symbols, 0);
+			while (worklist.pop(64, ids, sets))
+			{
+				for (size_t i = 0; i < ids.size(); i++)
+				{
+					moves.step(sets.data() + i * words, next.data(), touched.data());
+					for (size_t k = 0; k < moves.symbols; k++)
+					{
+						if (!touched[k])
+						{
+							continue;
+						}
+
+						uint64_t *bits = next.data() + k * words;
+						bool is_new;
+						const uint32_t to = subsets.insert(bits, is_new);
+						if (is_new)
+						{
+							new_ids.push_back(to);
+							new_sets.insert(new_sets.end(), bits, bits + words);
+							found_types[thread].push_back(std::make_pair(to, moves.type(bits)));
+						}
+
+						found_transitions[thread].push_back(Transition{ ids[i], static_cast<uint32_t>(k), to });
+
+						std::fill(bits, bits + words, 0);
+						touched[k] = 0;
+					}
+				}
+
+				worklist.push(new_ids, new_sets);
+				new_ids.clear();
+				new_sets.clear();
+				worklist.finish();
+			}
+		};
+
+		std::vector<std::thread> pool;
+		for (size_t t = 1; t < threads; t++)
+		{
+			pool.emplace_back(work, t);
+		}
+
+		work(0);
+		for (std::thread &t : pool)
+		{
+			t.join();
+		}
+
+		types.assign(subsets.size(), State::Type::NONE);
+		transitions.clear();
+		for (size_t t = 0; t < threads; t++)
+		{
+			for (const auto &p : found_types[t])
+			{
+				types[p.first] = p.second;
+			}
+
+			transitions.insert(transitions.end(), found_transitions[t].begin(), found_transitions[t].end());
 		}
 	}
+}
+
 
+bool FAUtils::nfa_to_dfa(const NDFiniteAutomaton &nfa, DFiniteAutomaton &dfa, size_t threads)
+{
 	// We don't care about epsilon because closure
 	std::set<std::string> alphabet = nfa.getAlphabet();
 	alphabet.erase("");
 
 	dfa.setAlphabet(alphabet);
 
-	std::set<std::string> initial_done;
-	const std::set<std::string> closed_initial = nfa.closure(initial_states, initial_done);
+	// Symbols are handled in alphabet order, which is the order DFA states get discovered in
+	std::vector<FiniteAutomaton::SymbolId> dfa_symbols;
+	std::vector<size_t> symbol_index(nfa.getSymbols().size(), SIZE_MAX);
+	for (const std::string &symbol : alphabet)
+	{
+		FiniteAutomaton::SymbolId id;
+		if (nfa.findSymbol(symbol, id))
+		{
+			symbol_index[id] = dfa_symbols.size();
+		}
+
+		dfa_symbols.push_back(dfa.addSymbol(symbol));
+	}
+
+	const SubsetMoves moves(nfa, symbol_index, dfa_symbols.size());
+	const size_t words = moves.words;
 
-	uint8_t type = State::Type::INITIAL;
-	if (std::any_of(closed_initial.begin(), closed_initial.end(), [nfa](const std::string &s) { return nfa.getStates().at(s).isFinal(); }))
+	// DFA states are numbered in the order they're found, breadth first
+	const FiniteAutomaton::StateId base = static_cast<FiniteAutomaton::StateId>(dfa.getStateCount());
+	if (threads > 1)
 	{
-		type |= State::Type::FINAL;
+		std::vector<uint8_t> types;
+		std::vector<Transition> transitions;
+		exploreParallel(moves, threads, types, transitions);
+
+		// Threads number states in whatever order they get to them. Each state's
+		// transitions were all found by one thread, in symbol order, and sorting
+		// by source keeps them that way, so a breadth first walk from the initial
+		// state gives the same numbers the serial version does.
+		std::stable_sort(transitions.begin(), transitions.end(), [](const Transition &a, const Transition &b) { return a.from < b.from; });
+
+		std::vector<size_t> first(types.size() + 1, 0);
+		for (const Transition &t : transitions)
+		{
+			first[t.from + 1]++;
+		}
+
+		for (size_t s = 0; s < types.size(); s++)
+		{
+			first[s + 1] += first[s];
+		}
+
+		const uint32_t none = UINT32_MAX;
+		std::vector<uint32_t> number(types.size(), none), order{ 0 };
+		number[0] = 0;
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			for (size_t e = first[order[i]]; e < first[order[i] + 1]; e++)
+			{
+				if (number[transitions[e].to] == none)
+				{
+					number[transitions[e].to] = static_cast<uint32_t>(order.size());
+					order.push_back(transitions[e].to);
+				}
+			}
+		}
+
+		for (uint32_t s : order)
+		{
+			dfa.addState(types[s]);
+		}
+
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			for (size_t e = first[order[i]]; e < first[order[i] + 1]; e++)
+			{
+				dfa.addTransition(base + static_cast<FiniteAutomaton::StateId>(i), dfa_symbols[transitions[e].symbol], base + number[transitions[e].to]);
+			}
+		}
+
+		return FAUtils::is_dfa(dfa);
 	}
 
-	dfa.addState(Utils::join(closed_initial, ""), type);
+	SubsetTable subsets(words);
 
-	std::queue<std::set<std::string>> q;
-	q.push(closed_initial);
+	bool added;
+	subsets.insert(moves.initial.data(), added);
+	dfa.addState(State::Type::INITIAL | moves.type(moves.initial.data()));
 
-	while (!q.empty())
+	std::vector<uint64_t> next(dfa_symbols.size() * words, 0);
+	std::vector<uint8_t> touched(dfa_symbols.size(), 0);
+	for (uint32_t from = 0; from < subsets.size(); from++)
 	{
-		std::set<std::string> from = q.front();
-		const std::string from_str = Utils::join(from, "");
-		q.pop();
+		moves.step(subsets.get(from), next.data(), touched.data());
+		for (size_t k = 0; k < dfa_symbols.size(); k++)
+		{
+			if (!touched[k])
+			{
+				continue;
+			}
 
-		for (const std::string &symbol : alphabet)
+			uint64_t *bits = next.data() + k * words;
+			const uint32_t to = subsets.insert(bits, added);
+			if (added)
+			{
+				dfa.addState(moves.type(bits));
+			}
+
+			dfa.addTransition(base + from, dfa_symbols[k], base + to);
+
+			std::fill(bits, bits + words, 0);
+			touched[k] = 0;
+		}
+	}
+
+	return FAUtils::is_dfa(dfa);
+}
+
+bool FAUtils::minimize(const DFiniteAutomaton &dfa, DFiniteAutomaton &minimal)
+{
+	if (!FAUtils::is_dfa(dfa))
+	{
+		return false;
+	}
+
+	size_t initials = 0;
+	FiniteAutomaton::StateId initial = 0;
+	for (FiniteAutomaton::StateId id = 0; id < dfa.getStateCount(); id++)
+	{
+		if (dfa.getState(id).isInitial())
+		{
+			initial = id;
+			initials++;
+		}
+	}
+
+	if (initials != 1)
+	{
+		return false;
+	}
+
+	std::set<std::string> alphabet = dfa.getAlphabet();
+	alphabet.erase("");
+
+	minimal.setAlphabet(alphabet);
+
+	std::vector<FiniteAutomaton::SymbolId> minimal_symbols;
+	std::vector<size_t> symbol_index(dfa.getSymbols().size(), SIZE_MAX);
+	for (const std::string &symbol : alphabet)
+	{
+		FiniteAutomaton::SymbolId id;
+		if (dfa.findSymbol(symbol, id))
+		{
+			symbol_index[id] = minimal_symbols.size();
+		}
+
+		minimal_symbols.push_back(minimal.addSymbol(symbol));
+	}
+
+	// Reachable states are renumbered breadth first from 0, and a sink state
+	// after them completes the DFA. It's there even when nothing goes to it,
+	// because whatever ends up in its block is what gets dropped at the end.
+	const uint32_t none = UINT32_MAX;
+	const size_t k = minimal_symbols.size();
+	std::vector<uint32_t> number(dfa.getStateCount(), none);
+	std::vector<FiniteAutomaton::StateId> reached{ initial };
+	number[initial] = 0;
+	for (size_t i = 0; i < reached.size(); i++)
+	{
+		for (const FiniteAutomaton::Edge &e : dfa.getEdges(reached[i]))
+		{
+			if (symbol_index[e.symbol] != SIZE_MAX && number[e.to] == none)
+			{
+				number[e.to] = static_cast<uint32_t>(reached.size());
+				reached.push_back(e.to);
+			}
+		}
+	}
+
+	const size_t n = reached.size() + 1;
+	const uint32_t sink = static_cast<uint32_t>(n - 1);
+	std::vector<uint32_t> delta(n * k, sink);
+	for (size_t i = 0; i < reached.size(); i++)
+	{
+		for (const FiniteAutomaton::Edge &e : dfa.getEdges(reached[i]))
+		{
+			if (symbol_index[e.symbol] != SIZE_MAX)
+			{
+				delta[i * k + symbol_index[e.symbol]] = number[e.to];
+			}
+		}
+	}
+
+	// Where each state is entered from on each symbol, sources[offsets[a * n + t]..] for symbol a and target t
+	std::vector<uint32_t> offsets(k * n + 1, 0), sources(n * k);
+	for (size_t s = 0; s < n; s++)
+	{
+		for (size_t a = 0; a < k; a++)
+		{
+			offsets[a * n + delta[s * k + a] + 1]++;
+		}
+	}
+
+	for (size_t i = 0; i < k * n; i++)
+	{
+		offsets[i + 1] += offsets[i];
+	}
+
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t s = 0; s < n; s++)
+	{
+		for (size_t a = 0; a < k; a++)
+		{
+			sources[fill[a * n + delta[s * k + a]]++] = static_cast<uint32_t>(s);
+		}
+	}
+
+	// Blocks are ranges of elements, block b is elements[first[b]..end[b]). States
+	// marked by the current splitter are moved to the front of their block.
+	std::vector<uint32_t> elements, location(n), block_of(n, 0);
+	std::vector<uint32_t> first, end, marked;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		const size_t start = elements.size();
+		for (size_t i = 0; i < reached.size(); i++)
 		{
-			std::set<std::string> done;
-			const std::set<std::string> to = nfa.closure(nfa.transitions(from, symbol), done);
+			if (dfa.getState(reached[i]).isFinal() == (pass == 0))
+			{
+				elements.push_back(static_cast<uint32_t>(i));
+			}
+		}
+
+		if (pass == 1)
+		{
+			elements.push_back(sink);
+		}
+
+		if (elements.size() > start)
+		{
+			for (size_t i = start; i < elements.size(); i++)
+			{
+				location[elements[i]] = static_cast<uint32_t>(i);
+				block_of[elements[i]] = static_cast<uint32_t>(first.size());
+			}
+
+			first.push_back(static_cast<uint32_t>(start));
+			end.push_back(static_cast<uint32_t>(elements.size()));
+			marked.push_back(0);
+		}
+	}
+
+	// The smaller half of every split goes on the worklist, whether the block it
+	// came from is still waiting there or not, which keeps it O(k n log n)
+	std::vector<uint32_t> worklist, splitter, touched;
+	if (first.size() == 2)
+	{
+		worklist.push_back(end[0] - first[0] <= end[1] - first[1] ? 0 : 1);
+	}
+
+	while (!worklist.empty())
+	{
+		const uint32_t b = worklist.back();
+		worklist.pop_back();
+
+		// Splits below can move states around inside b
+		splitter.assign(elements.begin() + first[b], elements.begin() + end[b]);
+		for (size_t a = 0; a < k; a++)
+		{
+			for (uint32_t t : splitter)
+			{
+				for (uint32_t i = offsets[a * n + t]; i < offsets[a * n + t + 1]; i++)
+				{
+					const uint32_t p = sources[i];
+					const uint32_t pb = block_of[p];
+					const uint32_t boundary = first[pb] + marked[pb];
+					if (location[p] < boundary)
+					{
+						continue;
+					}
+
+					if (!marked[pb])
+					{
+						touched.push_back(pb);
+					}
 
-			uint8_t type = State::Type::NONE;
-			if (std::any_of(to.begin(), to.end(), [nfa](const std::string &s) { return nfa.getStates().at(s).isFinal(); }))
+					const uint32_t other = elements[boundary];
+					std::swap(elements[location[p]], elements[boundary]);
+					location[other] = location[p];
+					location[p] = boundary;
+					marked[pb]++;
+				}
+			}
+
+			for (uint32_t pb : touched)
 			{
-				type |= State::Type::FINAL;
+				const uint32_t size = end[pb] - first[pb];
+				const uint32_t count = marked[pb];
+				marked[pb] = 0;
+				if (count == size)
+				{
+					continue;
+				}
+
+				const uint32_t nb = static_cast<uint32_t>(first.size());
+				if (count * 2 <= size)
+				{
+					first.push_back(first[pb]);
+					end.push_back(first[pb] + count);
+					first[pb] += count;
+				}
+				else
+				{
+					first.push_back(first[pb] + count);
+					end.push_back(end[pb]);
+					end[pb] = first[pb] + count;
+				}
+
+				marked.push_back(0);
+				for (uint32_t i = first[nb]; i < end[nb]; i++)
+				{
+					block_of[elements[i]] = nb;
+				}
+
+				worklist.push_back(nb);
 			}
 
-			const std::string to_str = Utils::join(to, "");
+			touched.clear();
+		}
+	}
 
-			if (!to.empty() && dfa.addState(to_str, type))
+	// Blocks become states in the order they're found from the initial one.
+	// The sink's block holds every state that can't reach a final one.
+	const uint32_t dead = block_of[sink];
+	std::vector<uint32_t> id(first.size(), none), order{ block_of[0] };
+	id[block_of[0]] = 0;
+	for (size_t i = 0; i < order.size() && order[0] != dead; i++)
+	{
+		const uint32_t s = elements[first[order[i]]];
+		for (size_t a = 0; a < k; a++)
+		{
+			const uint32_t to = block_of[delta[s * k + a]];
+			if (to != dead && id[to] == none)
 			{
-				q.push(to);
+				id[to] = static_cast<uint32_t>(order.size());
+				order.push_back(to);
 			}
+		}
+	}
 
-			dfa.addTransition(from_str, symbol, to_str);
+	const FiniteAutomaton::StateId base = static_cast<FiniteAutomaton::StateId>(minimal.getStateCount());
+	for (uint32_t block : order)
+	{
+		const uint32_t s = elements[first[block]];
+		const bool final = s != sink && dfa.getState(reached[s]).isFinal();
+		minimal.addState((block == order[0] ? State::Type::INITIAL : State::Type::NONE) | (final ? State::Type::FINAL : State::Type::NONE));
+	}
+
+	for (size_t i = 0; i < order.size() && order[0] != dead; i++)
+	{
+		const uint32_t s = elements[first[order[i]]];
+		for (size_t a = 0; a < k; a++)
+		{
+			const uint32_t to = block_of[delta[s * k + a]];
+			if (to != dead)
+			{
+				minimal.addTransition(base + static_cast<FiniteAutomaton::StateId>(i), minimal_symbols[a], base + id[to]);
+			}
 		}
 	}
 
-	return FAUtils::is_dfa(dfa);
+	return true;
 }
 
 bool FAUtils::is_dfa(const FiniteAutomaton &fa)
@@ -81,17 +600,18 @@ bool FAUtils::is_dfa(const FiniteAutomaton &fa)
 	// destination set is 1)
 	//
 	// Also that "reading an input symbol is required for each state transition"
-	for (const auto & p : fa.getStateTable())
+	for (FiniteAutomaton::StateId id = 0; id < fa.getStateCount(); id++)
 	{
-		if (p.second.count(""))
+		const FiniteAutomaton::Edges row = fa.getEdges(id);
+		for (const FiniteAutomaton::Edge *e = row.begin(); e != row.end(); e++)
 		{
-			// Automaton has to read an input symbol in order to be deterministic
-			return false;
-		}
+			if (e->symbol == FiniteAutomaton::epsilon)
+			{
+				// Automaton has to read an input symbol in order to be deterministic
+				return false;
+			}
 
-		for (const auto & t : p.second)
-		{
-			if (t.second.size() > 1)
+			if (e + 1 != row.end() && e[1].symbol == e->symbol)
 			{
 				return false;
 			}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "finiteautomaton.hpp"
+#include "subsets.hpp"
+
+
+// Matches like the DFA nfa_to_dfa would make, but only builds the states the
+// input actually gets to, one transition at a time. Patterns whose full DFA is
+// far too big, like (a|b)*a(a|b)(a|b)..(a|b), only cost as much as the strings
+// they're run on. The states are a cache: once it holds as many as fit in the
+// memory limit it's thrown away and started over.
+//
+// accept() can be called from any number of threads at once, they all share
+// the cache. Known transitions are followed without locking. Adding a state
+// takes a mutex, and a flush waits until no thread is matching.
+class LazyDFA
+{
+public:
+	static const size_t default_memory_limit = size_t(32) << 20;
+
+	// The NFA is only read here, it doesn't have to outlive the LazyDFA
+	explicit LazyDFA(const NDFiniteAutomaton &nfa, size_t memory_limit = default_memory_limit);
+
+	bool accept(const std::string &s) const;
+
+	// States cached right now, and how many states fit
+	size_t getStateCount() const;
+	size_t getCapacity() const { return m_capacity; }
+	size_t getFlushCount() const { return m_flushes; }
+
+private:
+	// Transitions hold the target + 1, 0 is one that hasn't been looked at yet
+	static const uint32_t unknown = 0;
+	static const uint32_t dead = UINT32_MAX;
+
+	static const size_t chunk_bits = 8;
+	static const size_t chunk_size = size_t(1) << chunk_bits;
+
+	// States live in chunks that are never moved, so threads following
+	// transitions don't care if another one is adding states meanwhile
+	struct Chunk
+	{
+		std::unique_ptr<std::atomic<uint32_t>[]> next;
+		uint8_t final[chunk_size];
+	};
+
+	std::atomic<uint32_t> &transition(uint32_t state, size_t byte_class) const
+	{
+		return m_chunks[state >> chunk_bits]->next[(state & (chunk_size - 1)) * m_class_count + byte_class];
+	}
+
+	bool isFinal(uint32_t state) const { return m_chunks[state >> chunk_bits]->final[state & (chunk_size - 1)] != 0; }
+
+	uint32_t step(uint32_t state, size_t byte_class, std::shared_lock<std::shared_mutex> &matching) const;
+
+	// Id + 1 of the state for the set, which is added if there's room
+	uint32_t add(const uint64_t *bits, bool &full) const;
+	void flush() const;
+
+	std::array<uint8_t, 256> m_byte_classes;
+	size_t m_class_count;
+	SubsetMoves m_moves;
+	size_t m_capacity;
+
+	// Held shared by every accept(), and exclusively by a flush
+	mutable std::shared_mutex m_matching;
+
+	// Everything below is only changed while holding m_adding
+	mutable std::mutex m_adding;
+	mutable SubsetTable m_subsets;
+	mutable std::vector<std::unique_ptr<Chunk>> m_chunks;
+	mutable std::vector<uint64_t> m_scratch;
+	mutable std::atomic<size_t> m_flushes{ 0 };
+};
\ No newline at end of file
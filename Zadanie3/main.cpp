@@ -1,21 +1,50 @@
 #include <iostream>
+#include <algorithm>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #include "regexp.hpp"
 #include "fautils.hpp"
 #include "regexpbuilder.hpp"
+#include "lazydfa.hpp"
+#include "bitnfa.hpp"
 
 
 #ifndef _TESTS
 
 int main(int argc, char **argv)
 {
-	if (argc < 4)
+	// Options can go anywhere on the command line
+	bool minimize = false, lazy = false;
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; i++)
 	{
-		std::cerr << "Usage: " << argv[0] << " <in_nfa> <final_nfa> <out_dfa>\n";
+		const std::string arg(argv[i]);
+		if (arg == "--minimize")
+		{
+			minimize = true;
+		}
+		else if (arg == "--lazy")
+		{
+			lazy = true;
+		}
+		else
+		{
+			args.push_back(arg);
+		}
+	}
+
+	// A lazy DFA is never built as a whole, so there's no DFA to write
+	if (args.size() < (lazy ? 2 : 3))
+	{
+		std::cerr << "Usage: " << argv[0] << " [--minimize] <in_nfa> <final_nfa> <out_dfa>\n";
+		std::cerr << "       " << argv[0] << " --lazy <in_nfa> <final_nfa>\n";
 		return EXIT_FAILURE;
 	}
 
-	std::string in_expressions(argv[1]), final_nfa(argv[2]), out_dfa(argv[3]);
+	std::string in_expressions(args[0]), final_nfa(args[1]), out_dfa(lazy ? std::string() : args[2]);
 
 	RegExpBuilder reb;
 	RegExpBuilder::Status status = reb.load(in_expressions);
@@ -45,23 +74,48 @@ int main(int argc, char **argv)
 	std::cout << "[+] NFA from final regexp written to \"" << final_nfa << "\"\n";
 
 	DFiniteAutomaton dfa;
-	if (FAUtils::nfa_to_dfa(nfa, dfa))
+
+	// Small NFAs are run as they are, bigger ones get a lazy DFA
+	std::unique_ptr<BitNFA> bit_nfa;
+	std::unique_ptr<LazyDFA> lazy_dfa;
+	if (lazy && BitNFA::fits(nfa))
 	{
-		std::cout << "[+] Final NFA converted to DFA\n";
+		bit_nfa.reset(new BitNFA(nfa));
+		std::cout << "[+] Matching with a bit-parallel NFA of " << bit_nfa->getPositionCount() << " positions\n";
 	}
-	else
+	else if (lazy)
 	{
-		std::cerr << "Failed to convert final NFA to DFA\n";
-		return EXIT_FAILURE;
+		lazy_dfa.reset(new LazyDFA(nfa));
+		std::cout << "[+] Matching with a lazy DFA, states are made as the input needs them\n";
 	}
-
-	if (dfa.write(out_dfa) != FiniteAutomaton::Status::OK)
+	else
 	{
-		std::cerr << "Failed to write DFA to \"" << out_dfa << "\"\n";
-		return EXIT_FAILURE;
-	}
+		if (FAUtils::nfa_to_dfa(nfa, dfa))
+		{
+			std::cout << "[+] Final NFA converted to DFA\n";
+		}
+		else
+		{
+			std::cerr << "Failed to convert final NFA to DFA\n";
+			return EXIT_FAILURE;
+		}
+
+		if (minimize)
+		{
+			DFiniteAutomaton minimal;
+			FAUtils::minimize(dfa, minimal);
+			std::cout << "[+] DFA minimized from " << dfa.getStateCount() << " to " << minimal.getStateCount() << " states\n";
+			dfa = minimal;
+		}
+
+		if (dfa.write(out_dfa) != FiniteAutomaton::Status::OK)
+		{
+			std::cerr << "Failed to write DFA to \"" << out_dfa << "\"\n";
+			return EXIT_FAILURE;
+		}
 
-	std::cout << "[+] DFA written to \"" << out_dfa << "\"\n";
+		std::cout << "[+] DFA written to \"" << out_dfa << "\"\n";
+	}
 
 	while (true)
 	{
@@ -70,7 +124,7 @@ int main(int argc, char **argv)
 		std::string str;
 		std::getline(std::cin, str);
 
-		if (dfa.accept(str))
+		if (bit_nfa ? bit_nfa->accept(str) : lazy ? lazy_dfa->accept(str) : dfa.accept(str))
 		{
 			std::cout << "ACCEPT\n";
 		}
@@ -105,10 +159,10 @@ TEST_CASE("Concatenation ab")
 	REQUIRE(!FAUtils::is_dfa(nfa));
 
 	REQUIRE(nfa.getStates().size() == 4);
-	REQUIRE(nfa.getStates().at("q0").isInitial());
-	REQUIRE(nfa.getStates().at("q1").type == State::Type::NONE);
-	REQUIRE(nfa.getStates().at("q2").type == State::Type::NONE);
-	REQUIRE(nfa.getStates().at("q3").isFinal());
+	REQUIRE(nfa.getState("q0").isInitial());
+	REQUIRE(nfa.getState("q1").type == State::Type::NONE);
+	REQUIRE(nfa.getState("q2").type == State::Type::NONE);
+	REQUIRE(nfa.getState("q3").isFinal());
 
 	auto q0 = nfa.getStateTransitions("q0");
 	REQUIRE(q0.size() == 1);
@@ -137,11 +191,11 @@ TEST_CASE("Union a|b")
 	REQUIRE(!FAUtils::is_dfa(nfa));
 
 	REQUIRE(nfa.getStates().size() == 5);
-	REQUIRE(nfa.getStates().at("q4").isInitial());
-	REQUIRE(nfa.getStates().at("q0").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q1").isFinal());
-	REQUIRE(nfa.getStates().at("q2").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q3").isFinal());
+	REQUIRE(nfa.getState("q4").isInitial());
+	REQUIRE(nfa.getState("q0").type == State::NONE);
+	REQUIRE(nfa.getState("q1").isFinal());
+	REQUIRE(nfa.getState("q2").type == State::NONE);
+	REQUIRE(nfa.getState("q3").isFinal());
 
 	auto q4 = nfa.getStateTransitions("q4");
 	REQUIRE(q4.size() == 2);
@@ -188,15 +242,15 @@ TEST_CASE("Union + concatenation (ab|ba)")
 	REQUIRE(!FAUtils::is_dfa(nfa));
 
 	REQUIRE(nfa.getStates().size() == 9);
-	REQUIRE(nfa.getStates().at("q8").isInitial());
-	REQUIRE(nfa.getStates().at("q0").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q1").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q2").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q3").isFinal());
-	REQUIRE(nfa.getStates().at("q4").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q5").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q6").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q7").isFinal());
+	REQUIRE(nfa.getState("q8").isInitial());
+	REQUIRE(nfa.getState("q0").type == State::NONE);
+	REQUIRE(nfa.getState("q1").type == State::NONE);
+	REQUIRE(nfa.getState("q2").type == State::NONE);
+	REQUIRE(nfa.getState("q3").isFinal());
+	REQUIRE(nfa.getState("q4").type == State::NONE);
+	REQUIRE(nfa.getState("q5").type == State::NONE);
+	REQUIRE(nfa.getState("q6").type == State::NONE);
+	REQUIRE(nfa.getState("q7").isFinal());
 
 	auto q8 = nfa.getStateTransitions("q8");
 	REQUIRE(q8.size() == 2);
@@ -242,9 +296,9 @@ TEST_CASE("Iteration a*")
 	REQUIRE(!FAUtils::is_dfa(nfa));
 
 	REQUIRE(nfa.getStates().size() == 3);
-	REQUIRE(nfa.getStates().at("q2").isInitial());
-	REQUIRE(nfa.getStates().at("q0").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q1").isFinal());
+	REQUIRE(nfa.getState("q2").isInitial());
+	REQUIRE(nfa.getState("q0").type == State::NONE);
+	REQUIRE(nfa.getState("q1").isFinal());
 
 	auto q0 = nfa.getStateTransitions("q0");
 	REQUIRE(q0.size() == 1);
@@ -276,11 +330,11 @@ TEST_CASE("Iteration + concat ab*")
 	REQUIRE(!FAUtils::is_dfa(nfa));
 
 	REQUIRE(nfa.getStates().size() == 5);
-	REQUIRE(nfa.getStates().at("q0").isInitial());
-	REQUIRE(nfa.getStates().at("q1").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q2").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q4").isFinal());
-	REQUIRE(nfa.getStates().at("q3").isFinal());
+	REQUIRE(nfa.getState("q0").isInitial());
+	REQUIRE(nfa.getState("q1").type == State::NONE);
+	REQUIRE(nfa.getState("q2").type == State::NONE);
+	REQUIRE(nfa.getState("q4").isFinal());
+	REQUIRE(nfa.getState("q3").isFinal());
 
 	auto q0 = nfa.getStateTransitions("q0");
 	REQUIRE(q0.size() == 1);
@@ -316,11 +370,11 @@ TEST_CASE("Iteration + concat a*b")
 	REQUIRE(!FAUtils::is_dfa(nfa));
 
 	REQUIRE(nfa.getStates().size() == 5);
-	REQUIRE(nfa.getStates().at("q2").isInitial());
-	REQUIRE(nfa.getStates().at("q0").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q1").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q3").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q4").isFinal());
+	REQUIRE(nfa.getState("q2").isInitial());
+	REQUIRE(nfa.getState("q0").type == State::NONE);
+	REQUIRE(nfa.getState("q1").type == State::NONE);
+	REQUIRE(nfa.getState("q3").type == State::NONE);
+	REQUIRE(nfa.getState("q4").isFinal());
 
 	auto q0 = nfa.getStateTransitions("q0");
 	REQUIRE(q0.size() == 1);
@@ -358,11 +412,11 @@ TEST_CASE("Iteration + concat (ab)*")
 	REQUIRE(!FAUtils::is_dfa(nfa));
 
 	REQUIRE(nfa.getStates().size() == 5);
-	REQUIRE(nfa.getStates().at("q4").isInitial());
-	REQUIRE(nfa.getStates().at("q0").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q1").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q2").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q3").isFinal());
+	REQUIRE(nfa.getState("q4").isInitial());
+	REQUIRE(nfa.getState("q0").type == State::NONE);
+	REQUIRE(nfa.getState("q1").type == State::NONE);
+	REQUIRE(nfa.getState("q2").type == State::NONE);
+	REQUIRE(nfa.getState("q3").isFinal());
 
 	auto q0 = nfa.getStateTransitions("q0");
 	REQUIRE(q0.size() == 1);
@@ -402,12 +456,12 @@ TEST_CASE("Iteration + union (a|b)*")
 	REQUIRE(!FAUtils::is_dfa(nfa));
 
 	REQUIRE(nfa.getStates().size() == 6);
-	REQUIRE(nfa.getStates().at("q5").isInitial());
-	REQUIRE(nfa.getStates().at("q0").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q1").isFinal());
-	REQUIRE(nfa.getStates().at("q2").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q3").isFinal());
-	REQUIRE(nfa.getStates().at("q4").type == State::NONE);
+	REQUIRE(nfa.getState("q5").isInitial());
+	REQUIRE(nfa.getState("q0").type == State::NONE);
+	REQUIRE(nfa.getState("q1").isFinal());
+	REQUIRE(nfa.getState("q2").type == State::NONE);
+	REQUIRE(nfa.getState("q3").isFinal());
+	REQUIRE(nfa.getState("q4").type == State::NONE);
 
 	auto q5 = nfa.getStateTransitions("q5");
 	REQUIRE(q5.size() == 1);
@@ -617,11 +671,11 @@ TEST_CASE("Builder 1.txt -- aa*")
 	DFiniteAutomaton dfa;
 
 	REQUIRE(nfa.getStates().size() == 5);
-	REQUIRE(nfa.getStates().at("q0").isInitial());
-	REQUIRE(nfa.getStates().at("q1").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q2").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q4").isFinal());
-	REQUIRE(nfa.getStates().at("q3").isFinal());
+	REQUIRE(nfa.getState("q0").isInitial());
+	REQUIRE(nfa.getState("q1").type == State::NONE);
+	REQUIRE(nfa.getState("q2").type == State::NONE);
+	REQUIRE(nfa.getState("q4").isFinal());
+	REQUIRE(nfa.getState("q3").isFinal());
 
 	auto q0 = nfa.getStateTransitions("q0");
 	REQUIRE(q0.size() == 1);
@@ -655,12 +709,12 @@ TEST_CASE("Builder 2.txt -- E|ab")
 	REQUIRE(!FAUtils::is_dfa(nfa));
 
 	REQUIRE(nfa.getStates().size() == 6);
-	REQUIRE(nfa.getStates().at("q5").isInitial());
-	REQUIRE(nfa.getStates().at("q1").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q2").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q3").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q4").isFinal());
-	REQUIRE(nfa.getStates().at("q0").isFinal());
+	REQUIRE(nfa.getState("q5").isInitial());
+	REQUIRE(nfa.getState("q1").type == State::NONE);
+	REQUIRE(nfa.getState("q2").type == State::NONE);
+	REQUIRE(nfa.getState("q3").type == State::NONE);
+	REQUIRE(nfa.getState("q4").isFinal());
+	REQUIRE(nfa.getState("q0").isFinal());
 
 	auto q0 = nfa.getStateTransitions("q0");
 	REQUIRE(q0.size() == 0);
@@ -697,12 +751,12 @@ TEST_CASE("Builder 3.txt -- (a|b)*")
 	REQUIRE(!FAUtils::is_dfa(nfa));
 
 	REQUIRE(nfa.getStates().size() == 6);
-	REQUIRE(nfa.getStates().at("q5").isInitial());
-	REQUIRE(nfa.getStates().at("q0").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q1").isFinal());
-	REQUIRE(nfa.getStates().at("q2").type == State::NONE);
-	REQUIRE(nfa.getStates().at("q3").isFinal());
-	REQUIRE(nfa.getStates().at("q4").type == State::NONE);
+	REQUIRE(nfa.getState("q5").isInitial());
+	REQUIRE(nfa.getState("q0").type == State::NONE);
+	REQUIRE(nfa.getState("q1").isFinal());
+	REQUIRE(nfa.getState("q2").type == State::NONE);
+	REQUIRE(nfa.getState("q3").isFinal());
+	REQUIRE(nfa.getState("q4").type == State::NONE);
 
 	auto q5 = nfa.getStateTransitions("q5");
 	REQUIRE(q5.size() == 1);
@@ -771,4 +825,428 @@ TEST_CASE("Builder 5.txt -- ((acb)*|E)a*b")
 	REQUIRE(!dfa.accept("acbaaabbb"));
 }
 
+TEST_CASE("Automaton ids and edges")
+{
+	NDFiniteAutomaton nfa;
+	const FiniteAutomaton::StateId q0 = nfa.addState(State::INITIAL);
+	const FiniteAutomaton::StateId q1 = nfa.addState(State::FINAL);
+	REQUIRE(q0 == 0);
+	REQUIRE(q1 == 1);
+	REQUIRE(nfa.getLabel(q1) == "q1");
+	REQUIRE(nfa.getState("q1").isFinal());
+	REQUIRE(!nfa.addState("q1", State::NONE));
+
+	const FiniteAutomaton::SymbolId b = nfa.addSymbol("b");
+	const FiniteAutomaton::SymbolId a = nfa.addSymbol("a");
+	REQUIRE(nfa.addSymbol("b") == b);
+	REQUIRE(nfa.getSymbol(FiniteAutomaton::epsilon).empty());
+
+	// Rows come out sorted by symbol and target, without duplicates
+	nfa.addTransition(q0, b, q1);
+	nfa.addTransition(q0, a, q1);
+	nfa.addTransition(q0, a, q0);
+	REQUIRE(nfa.addTransition("q0", "a", "q1"));
+	REQUIRE(!nfa.addTransition("q0", "c", "q1"));
+	REQUIRE(!nfa.addTransition("q0", "a", "q2"));
+
+	FiniteAutomaton::Edges row = nfa.getEdges(q0);
+	REQUIRE(row.size() == 3);
+	REQUIRE(row.begin()[0] == (FiniteAutomaton::Edge{ b, q1 }));
+	REQUIRE(row.begin()[1] == (FiniteAutomaton::Edge{ a, q0 }));
+	REQUIRE(row.begin()[2] == (FiniteAutomaton::Edge{ a, q1 }));
+	REQUIRE(nfa.getEdges(q0, a).size() == 2);
+	REQUIRE(nfa.getEdges(q1).empty());
+
+	// Transitions and states added after a lookup are merged into the rows
+	const FiniteAutomaton::StateId q2 = nfa.addState(State::NONE);
+	nfa.addTransition(q1, FiniteAutomaton::epsilon, q2);
+	nfa.addTransition(q0, b, q2);
+	REQUIRE(nfa.getEdges(q0, b).size() == 2);
+	REQUIRE(nfa.getEdges(q1, FiniteAutomaton::epsilon).begin()->to == q2);
+	REQUIRE(nfa.getEdges(q2).empty());
+
+	std::set<std::string> done;
+	REQUIRE(nfa.closure({ "q1" }, done) == std::set<std::string>{ "q1", "q2" });
+	REQUIRE(nfa.transitions({ "q0" }, "a") == std::set<std::string>{ "q0", "q1" });
+}
+
+TEST_CASE("Byte classes (a|b)*c")
+{
+	DFiniteAutomaton dfa;
+	const FiniteAutomaton::StateId q0 = dfa.addState(State::INITIAL);
+	const FiniteAutomaton::StateId q1 = dfa.addState(State::FINAL);
+	dfa.addTransition(q0, dfa.addSymbol("a"), q0);
+	dfa.addTransition(q0, dfa.addSymbol("b"), q0);
+	dfa.addTransition(q0, dfa.addSymbol("c"), q1);
+
+	// a and b go to the same states everywhere, every other byte goes nowhere
+	std::array<uint8_t, 256> classes;
+	REQUIRE(dfa.byteClasses(classes) == 3);
+	REQUIRE(classes[0] == 0);
+	REQUIRE(classes['a'] == 1);
+	REQUIRE(classes['b'] == 1);
+	REQUIRE(classes['c'] == 2);
+	REQUIRE(classes['d'] == 0);
+	REQUIRE(classes[0xff] == 0);
+
+	REQUIRE(dfa.accept("abbac"));
+	REQUIRE(dfa.accept("c"));
+	REQUIRE(!dfa.accept("abd"));
+	REQUIRE(!dfa.accept("ab\xff"));
+	REQUIRE(!dfa.accept(""));
+
+	// The table is built again after the automaton changes
+	dfa.addTransition(q1, dfa.addSymbol("b"), q1);
+	REQUIRE(dfa.byteClasses(classes) == 4);
+	REQUIRE(classes['a'] != classes['b']);
+	REQUIRE(dfa.accept("abcbb"));
+	REQUIRE(!dfa.accept("abcab"));
+
+	dfa.addState("q0", State::INITIAL | State::FINAL, true);
+	REQUIRE(dfa.accept(""));
+}
+
+TEST_CASE("Matcher built by racing threads")
+{
+	// Nothing is compacted yet, the first accept() on every thread builds the
+	// Matcher. A long chain (a^n, b starts over) makes the build take a while.
+	const size_t length = 2000;
+	DFiniteAutomaton dfa;
+	const FiniteAutomaton::SymbolId a = dfa.addSymbol("a"), b = dfa.addSymbol("b");
+	FiniteAutomaton::StateId first = dfa.addState(State::INITIAL), last = first;
+	for (size_t i = 0; i < length; i++)
+	{
+		const FiniteAutomaton::StateId next = dfa.addState(i + 1 == length ? State::FINAL : 0);
+		dfa.addTransition(last, a, next);
+		dfa.addTransition(last, b, first);
+		last = next;
+	}
+
+	std::atomic<bool> go{ false };
+	std::atomic<size_t> wrong{ 0 };
+	std::vector<std::thread> threads;
+	for (unsigned t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&dfa, &go, &wrong, length] {
+			while (!go)
+			{
+				std::this_thread::yield();
+			}
+
+			wrong += !dfa.accept("ab" + std::string(length, 'a')) + dfa.accept(std::string(length - 1, 'a'));
+		});
+	}
+
+	go = true;
+	for (std::thread &t : threads)
+	{
+		t.join();
+	}
+
+	REQUIRE(wrong == 0);
+	REQUIRE(dfa.compile() == dfa.compile());
+}
+
+// Reference answer straight from the NFA, one set of state labels at a time
+bool nfaAccepts(const NDFiniteAutomaton &nfa, const std::string &s)
+{
+	std::set<std::string> current;
+	for (FiniteAutomaton::StateId id = 0; id < nfa.getStateCount(); id++)
+	{
+		if (nfa.getState(id).isInitial())
+		{
+			current.insert(nfa.getLabel(id));
+		}
+	}
+
+	std::set<std::string> done;
+	current = nfa.closure(current, done);
+	for (char c : s)
+	{
+		std::set<std::string> next_done;
+		current = nfa.closure(nfa.transitions(current, std::string(1, c)), next_done);
+	}
+
+	return std::any_of(current.begin(), current.end(), [&nfa](const std::string &label) { return nfa.getState(label).isFinal(); });
+}
+
+TEST_CASE("Subset construction")
+{
+	// A long word makes an NFA with thousands of states
+	std::string word;
+	for (size_t i = 0; i < 1000; i++)
+	{
+		word += "abc"[i % 3 == 2 ? 2 : i % 2];
+	}
+
+	RegExp r(word.substr(0, 1));
+	for (size_t i = 1; i < word.size(); i++)
+	{
+		RegExp next(word.substr(i, 1));
+		r = r + next;
+	}
+
+	const NDFiniteAutomaton &nfa = r.getAutomaton();
+	REQUIRE(nfa.getStateCount() == 2000);
+
+	DFiniteAutomaton dfa;
+	REQUIRE(FAUtils::nfa_to_dfa(nfa, dfa));
+	REQUIRE(dfa.getStateCount() == 1001);
+	REQUIRE(dfa.accept(word));
+	REQUIRE(!dfa.accept(word.substr(1)));
+	REQUIRE(!dfa.accept(word + "a"));
+
+	// Random expressions against the NFA itself, numbering is the same every time
+	// and with any number of threads
+	std::mt19937 rng(7);
+	for (int round = 0; round < 100; round++)
+	{
+		std::vector<RegExp> pool{ RegExp("a"), RegExp("b"), RegExp("c"), RegExp("") };
+		for (int op = 0; op < 12; op++)
+		{
+			RegExp &x = pool[rng() % pool.size()];
+			RegExp &y = pool[rng() % pool.size()];
+			switch (rng() % 3)
+			{
+			case 0: pool.push_back(x + y); break;
+			case 1: pool.push_back(x | y); break;
+			default: pool.push_back(*x); break;
+			}
+		}
+
+		const NDFiniteAutomaton &random = pool.back().getAutomaton();
+		DFiniteAutomaton d1, d2;
+		REQUIRE(FAUtils::nfa_to_dfa(random, d1));
+		REQUIRE(FAUtils::nfa_to_dfa(random, d2, 1 + round % 4));
+		REQUIRE(d1.getStateCount() == d2.getStateCount());
+		for (FiniteAutomaton::StateId id = 0; id < d1.getStateCount(); id++)
+		{
+			REQUIRE(d1.getState(id).type == d2.getState(id).type);
+			REQUIRE(std::equal(d1.getEdges(id).begin(), d1.getEdges(id).end(), d2.getEdges(id).begin(), d2.getEdges(id).end()));
+		}
+
+		for (int k = 0; k < 30; k++)
+		{
+			std::string s;
+			for (size_t len = rng() % 8; len > 0; len--)
+			{
+				s += "abc"[rng() % 3];
+			}
+
+			REQUIRE(d1.accept(s) == nfaAccepts(random, s));
+		}
+	}
+}
+
+TEST_CASE("Subset construction with threads")
+{
+	// (a|b)*a(a|b)^12 needs a DFA state for every possible last 13 characters
+	RegExp a("a"), b("b");
+	RegExp ab = a | b;
+	RegExp r = *ab;
+	r = r + a;
+	for (int i = 0; i < 12; i++)
+	{
+		r = r + ab;
+	}
+
+	DFiniteAutomaton serial, parallel;
+	REQUIRE(FAUtils::nfa_to_dfa(r.getAutomaton(), serial));
+	REQUIRE(FAUtils::nfa_to_dfa(r.getAutomaton(), parallel, 8));
+	REQUIRE(serial.getStateCount() == 8193);
+	REQUIRE(parallel.getStateCount() == serial.getStateCount());
+
+	bool same = true;
+	for (FiniteAutomaton::StateId id = 0; id < serial.getStateCount(); id++)
+	{
+		same = same && serial.getState(id).type == parallel.getState(id).type &&
+			std::equal(serial.getEdges(id).begin(), serial.getEdges(id).end(), parallel.getEdges(id).begin(), parallel.getEdges(id).end());
+	}
+
+	REQUIRE(same);
+	REQUIRE(parallel.accept("abbbbbbbbbbbb"));
+	REQUIRE(!parallel.accept("babbbbbbbbbbb"));
+}
+
+// (a|b)*a(a|b)^n, true when the character n + 1 from the end is an a
+RegExp lastCharacters(int n)
+{
+	RegExp a("a"), b("b");
+	RegExp ab = a | b;
+	RegExp r = *ab;
+	r = r + a;
+	for (int i = 0; i < n; i++)
+	{
+		r = r + ab;
+	}
+
+	return r;
+}
+
+TEST_CASE("Lazy DFA")
+{
+	// Same answers as the eager DFA, with plenty of room and with barely any
+	std::mt19937 rng(47);
+	for (int round = 0; round < 50; round++)
+	{
+		std::vector<RegExp> pool{ RegExp("a"), RegExp("b"), RegExp("c"), RegExp("") };
+		for (int op = 0; op < 12; op++)
+		{
+			RegExp &x = pool[rng() % pool.size()];
+			RegExp &y = pool[rng() % pool.size()];
+			switch (rng() % 3)
+			{
+			case 0: pool.push_back(x + y); break;
+			case 1: pool.push_back(x | y); break;
+			default: pool.push_back(*x); break;
+			}
+		}
+
+		DFiniteAutomaton dfa;
+		REQUIRE(FAUtils::nfa_to_dfa(pool.back().getAutomaton(), dfa));
+		const LazyDFA roomy(pool.back().getAutomaton()), cramped(pool.back().getAutomaton(), 0);
+		REQUIRE(cramped.getCapacity() == 2);
+
+		for (int k = 0; k < 30; k++)
+		{
+			std::string s;
+			for (size_t len = rng() % 8; len > 0; len--)
+			{
+				s += "abcd"[rng() % 4];
+			}
+
+			REQUIRE(roomy.accept(s) == dfa.accept(s));
+			REQUIRE(cramped.accept(s) == dfa.accept(s));
+		}
+	}
+
+	// The full DFA would have 2^21 states
+	RegExp r = lastCharacters(20);
+	const LazyDFA lazy(r.getAutomaton(), 64 << 10);
+	bool same = true;
+	for (int k = 0; k < 2000; k++)
+	{
+		std::string s;
+		for (size_t len = 21 + rng() % 20; len > 0; len--)
+		{
+			s += "ab"[rng() % 2];
+		}
+
+		same = same && lazy.accept(s) == (s[s.size() - 21] == 'a');
+	}
+
+	REQUIRE(same);
+	REQUIRE(lazy.getFlushCount() > 0);
+	REQUIRE(lazy.getStateCount() <= lazy.getCapacity());
+}
+
+TEST_CASE("Lazy DFA shared between threads")
+{
+	// Small enough that the threads keep flushing under each other
+	RegExp r = lastCharacters(10);
+	const LazyDFA lazy(r.getAutomaton(), 16 << 10);
+
+	std::atomic<size_t> wrong{ 0 };
+	std::vector<std::thread> threads;
+	for (unsigned t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&lazy, &wrong, t] {
+			std::mt19937 rng(t);
+			for (int k = 0; k < 3000; k++)
+			{
+				std::string s;
+				for (size_t len = 11 + rng() % 30; len > 0; len--)
+				{
+					s += "ab"[rng() % 2];
+				}
+
+				if (lazy.accept(s) != (s[s.size() - 11] == 'a'))
+				{
+					wrong++;
+				}
+			}
+		});
+	}
+
+	for (std::thread &t : threads)
+	{
+		t.join();
+	}
+
+	REQUIRE(wrong == 0);
+	REQUIRE(lazy.getFlushCount() > 0);
+}
+
+TEST_CASE("Bit-parallel NFA")
+{
+	// Same answers as the DFA, bytes outside the alphabet included
+	std::mt19937 rng(48);
+	for (int round = 0; round < 50; round++)
+	{
+		std::vector<RegExp> pool{ RegExp("a"), RegExp("b"), RegExp("c"), RegExp("") };
+		for (int op = 0; op < 12; op++)
+		{
+			RegExp &x = pool[rng() % pool.size()];
+			RegExp &y = pool[rng() % pool.size()];
+			switch (rng() % 3)
+			{
+			case 0: pool.push_back(x + y); break;
+			case 1: pool.push_back(x | y); break;
+			default: pool.push_back(*x); break;
+			}
+		}
+
+		DFiniteAutomaton dfa;
+		REQUIRE(FAUtils::nfa_to_dfa(pool.back().getAutomaton(), dfa));
+		REQUIRE(BitNFA::fits(pool.back().getAutomaton()));
+		const BitNFA bits(pool.back().getAutomaton());
+
+		for (int k = 0; k < 30; k++)
+		{
+			std::string s;
+			for (size_t len = rng() % 8; len > 0; len--)
+			{
+				s += "abcd"[rng() % 4];
+			}
+
+			REQUIRE(bits.accept(s) == dfa.accept(s));
+		}
+	}
+
+	// One word, two, four, eight, and too many positions for the tables. Each
+	// a and b of the expression is a position of its own, plus the start.
+	const struct
+	{
+		int n;
+		size_t positions;
+		bool fits;
+	} sizes[] = { { 20, 44, true }, { 40, 84, true }, { 100, 204, true }, { 200, 404, true }, { 300, 604, false } };
+
+	for (const auto &size : sizes)
+	{
+		RegExp r = lastCharacters(size.n);
+		REQUIRE(BitNFA::fits(r.getAutomaton()) == size.fits);
+
+		const BitNFA bits(r.getAutomaton());
+		REQUIRE(bits.getPositionCount() == size.positions);
+		REQUIRE(!bits.accept(""));
+		REQUIRE(!bits.accept(std::string(size.n + 1, 'b')));
+		REQUIRE(!bits.accept("a" + std::string(size.n, 'c')));
+
+		bool same = true;
+		for (int k = 0; k < 200; k++)
+		{
+			std::string s;
+			for (size_t len = size.n + 1 + rng() % 50; len > 0; len--)
+			{
+				s += "ab"[rng() % 2];
+			}
+
+			same = same && bits.accept(s) == (s[s.size() - size.n - 1] == 'a');
+		}
+
+		REQUIRE(same);
+	}
+}
+
 #endif // _TESTS
\ No newline at end of file
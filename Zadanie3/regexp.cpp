@@ -1,6 +1,6 @@
 #include <iostream>
 #include <set>
-#include <map>
+#include <vector>
 
 #include "regexp.hpp"
 
@@ -35,101 +35,25 @@ RegExp RegExp::operator+(RegExp &rhs)
 {
 	RegExp ret;
 	NDFiniteAutomaton &new_nfa = ret.getAutomaton();
-
-	// Transfer left symbols to new automaton
-	for (const std::string & s : m_nfa.getAlphabet())
-	{
-		new_nfa.addSymbol(s);
-	}
+	new_nfa = NDFiniteAutomaton();
 
 	// Transfer left states to new automaton
 	// Remove final attribute from them
-	std::map<std::string, std::string> left_old_to_new;
-	std::set<std::string> left_final;
-	size_t left_counter = 0;
-
-	for (const auto &p : m_nfa.getStates())
-	{
-		uint8_t type = p.second.type;
-
-		std::string new_q = "q" + std::to_string(left_counter++);
-		left_old_to_new.insert(std::make_pair(p.first, new_q));
-
-		if (p.second.isFinal())
-		{
-			type ^= State::FINAL;
-			left_final.insert(new_q);
-		}
-
-		new_nfa.addState(new_q, type, true);
-	}
-
-	// Transfer left transitions to new automaton
-	for (const auto &p : m_nfa.getStateTable())
-	{
-		const std::string & from = left_old_to_new.at(p.first);
-		for (const auto &t : p.second)
-		{
-			const std::string &symbol = t.first;
-			for (const std::string &to : t.second)
-			{
-				new_nfa.addTransition(from, symbol, left_old_to_new.at(to));
-			}
-		}
-	}
-
-	const NDFiniteAutomaton &right_nfa = rhs.getAutomaton();
-	
-	// Transfer right symbols to new automaton
-	for (const std::string &s : right_nfa.getAlphabet())
-	{
-		new_nfa.addSymbol(s);
-	}
+	std::vector<FiniteAutomaton::StateId> left_final;
+	transfer(m_nfa, new_nfa, State::FINAL, left_final);
 
-	// Transfer right states to new automaton
+	// Transfer right states to new automaton, numbered after the left ones
 	// Remove initial attribute from them
-	// old_q: new_q
-	std::map<std::string, std::string> right_old_to_new;
-	std::set<std::string> right_initial;
-	size_t right_counter = left_counter;
-
-	for (const auto &p : right_nfa.getStates())
-	{
-		uint8_t type = p.second.type;
-
-		std::string new_q = "q" + std::to_string(right_counter++);
-		right_old_to_new.insert(std::make_pair(p.first, new_q));
-
-		if (p.second.isInitial())
-		{
-			type ^= State::INITIAL;
-			right_initial.insert(new_q);
-		}
-
-		new_nfa.addState(new_q, type);
-	}
-
-	// Transfer right transitions to new automaton
-	for (const auto &p : right_nfa.getStateTable())
-	{
-		const std::string &from = right_old_to_new.at(p.first);
-		for (const auto &t : p.second)
-		{
-			const std::string &symbol = t.first;
-			for (const std::string &to : t.second)
-			{
-				new_nfa.addTransition(from, symbol, right_old_to_new.at(to));
-			}
-		}
-	}
+	std::vector<FiniteAutomaton::StateId> right_initial;
+	transfer(rhs.getAutomaton(), new_nfa, State::INITIAL, right_initial);
 
 	// Concatenate left final states to right initial states
 	// AKA create epsilon transition between them
-	for (const std::string &lf : left_final)
+	for (FiniteAutomaton::StateId lf : left_final)
 	{
-		for (const std::string &ri : right_initial)
+		for (FiniteAutomaton::StateId ri : right_initial)
 		{
-			new_nfa.addTransition(lf, "", ri);
+			new_nfa.addTransition(lf, FiniteAutomaton::epsilon, ri);
 		}
 	}
 
@@ -141,100 +65,20 @@ RegExp RegExp::operator|(RegExp &rhs)
 {
 	RegExp ret;
 	NDFiniteAutomaton &new_nfa = ret.getAutomaton();
-	std::set<std::string> old_initial;
-
-	// Copy left alphabet
-	for (const std::string &s : m_nfa.getAlphabet())
-	{
-		new_nfa.addSymbol(s);
-	}
-
-	// Transfer left states
-	// Take left initial
-	std::map<std::string, std::string> left_old_to_new;
-	
-	size_t left_counter = 0;
-	for (const auto &p : m_nfa.getStates())
-	{
-		uint8_t type = p.second.type;
-
-		std::string new_q = "q" + std::to_string(left_counter++);
-		left_old_to_new.insert(std::make_pair(p.first, new_q));
-
-		if (p.second.isInitial())
-		{
-			type ^= State::INITIAL;
-			old_initial.insert(new_q);
-		}
-
-		new_nfa.addState(new_q, type, true);
-	}
-
-	// Transfer left transitions to new automaton
-	for (const auto &p : m_nfa.getStateTable())
-	{
-		const std::string &from = left_old_to_new.at(p.first);
-		for (const auto &t : p.second)
-		{
-			const std::string &symbol = t.first;
-			for (const std::string &to : t.second)
-			{
-				new_nfa.addTransition(from, symbol, left_old_to_new.at(to));
-			}
-		}
-	}
-
-	// Copy right alphabet
-	const NDFiniteAutomaton &right_nfa = rhs.getAutomaton();
-	
-	for (const std::string &s : right_nfa.getAlphabet())
-	{
-		new_nfa.addSymbol(s);
-	}
-
-	// Transfer right states to new automaton
-	// Take right initial -- rename every state
-	std::map<std::string, std::string> right_old_to_new;
-	size_t right_counter = left_counter;
-
-	for (const auto &p : right_nfa.getStates())
-	{
-		uint8_t type = p.second.type;
-
-		std::string new_q = "q" + std::to_string(right_counter++);
-		right_old_to_new.insert(std::make_pair(p.first, new_q));
-
-		if (p.second.isInitial())
-		{
-			type ^= State::INITIAL;
-			old_initial.insert(new_q);
-		}
-
-		new_nfa.addState(new_q, type);
-	}
+	new_nfa = NDFiniteAutomaton();
 
-	// Transfer right transitions to new automaton
-	for (const auto &p : right_nfa.getStateTable())
-	{
-		const std::string &from = right_old_to_new.at(p.first);
-		for (const auto &t : p.second)
-		{
-			const std::string &symbol = t.first;
-			for (const std::string &to : t.second)
-			{
-				new_nfa.addTransition(from, symbol, right_old_to_new.at(to));
-			}
-		}
-	}
+	// Transfer left and then right states, take their initial attribute
+	std::vector<FiniteAutomaton::StateId> old_initial;
+	transfer(m_nfa, new_nfa, State::INITIAL, old_initial);
+	transfer(rhs.getAutomaton(), new_nfa, State::INITIAL, old_initial);
 
 	// Create new initial state
 	// Create epsilon transitions from this state to old initial states
-	std::string new_initial = "q" + std::to_string(right_counter);
-	new_nfa.addState(new_initial, State::INITIAL);
-	
-	for (const std::string &oi : old_initial)
+	const FiniteAutomaton::StateId new_initial = new_nfa.addState(State::INITIAL);
+
+	for (FiniteAutomaton::StateId oi : old_initial)
 	{
-		new_nfa.addTransition(new_initial, "", oi);
+		new_nfa.addTransition(new_initial, FiniteAutomaton::epsilon, oi);
 	}
 
 	return ret;
@@ -245,63 +89,36 @@ RegExp RegExp::operator*(void)
 {
 	RegExp ret;
 	NDFiniteAutomaton &new_nfa = ret.getAutomaton();
+	new_nfa = NDFiniteAutomaton();
 
-	// Copy all symbols
-	new_nfa.setAlphabet(m_nfa.getAlphabet());
+	// Copy all states, symbols and transitions, states keep their numbers
+	// TO ASK: What if final state is also an initial state? Do we create an epsilon transition to itself? Huh..
+	std::vector<FiniteAutomaton::StateId> initials, finals;
+	transfer(m_nfa, new_nfa, State::INITIAL, initials);
 
-	std::set<std::string> initials, finals;
-
-	size_t state_counter = 0;
-	for (const auto &p : m_nfa.getStates())
+	for (FiniteAutomaton::StateId id = 0; id < new_nfa.getStateCount(); id++)
 	{
-		// TO ASK: What if final state is also an initial state? Do we create an epsilon transition to itself? Huh..
-		uint8_t type = p.second.type;
-
-		if (p.second.isInitial())
-		{
-			type ^= State::INITIAL;
-			initials.insert(p.first);
-		}
-		
-		if (p.second.isFinal())
+		if (new_nfa.getState(id).isFinal())
 		{
-			finals.insert(p.first);
-		}
-
-		new_nfa.addState(p.first, type, true);
-		++state_counter;
-	}
-
-	// Copy all transitions
-	for (const auto &p : m_nfa.getStateTable())
-	{
-		const std::string &from = p.first;
-		for (const auto &t : p.second)
-		{
-			const std::string &symbol = t.first;
-			for (const std::string &to : t.second)
-			{
-				new_nfa.addTransition(from, symbol, to);
-			}
+			finals.push_back(id);
 		}
 	}
 
 	// Make epsilon transitions from final states to former initial states
-	for (const std::string &f : finals)
+	for (FiniteAutomaton::StateId f : finals)
 	{
-		for (const std::string &i : initials)
+		for (FiniteAutomaton::StateId i : initials)
 		{
-			new_nfa.addTransition(f, "", i);
+			new_nfa.addTransition(f, FiniteAutomaton::epsilon, i);
 		}
 	}
 
 	// Create new initial + final state & create epsilon transitions from it to former initial states
-	std::string new_initial = "q" + std::to_string(state_counter);
-	new_nfa.addState(new_initial, State::INITIAL | State::FINAL);
+	const FiniteAutomaton::StateId new_initial = new_nfa.addState(State::INITIAL | State::FINAL);
 
-	for (const std::string &i : initials)
+	for (FiniteAutomaton::StateId i : initials)
 	{
-		new_nfa.addTransition(new_initial, "", i);
+		new_nfa.addTransition(new_initial, FiniteAutomaton::epsilon, i);
 	}
 
 	return ret;
@@ -321,7 +138,7 @@ bool RegExp::buildElementary(const std::set<std::string> &symbol)
 	if (symbol.empty())
 	{
 		// Literally nothing
-		m_nfa.addState("q0", State::INITIAL);
+		m_nfa.addState(State::INITIAL);
 		return true;
 	}
 
@@ -331,13 +148,49 @@ bool RegExp::buildElementary(const std::set<std::string> &symbol)
 	if (s.empty())
 	{
 		// Epsilon
-		m_nfa.addState("q0", State::INITIAL | State::FINAL);
+		m_nfa.addState(State::INITIAL | State::FINAL);
 		return true;
 	}
 
-	m_nfa.addState("q0", State::INITIAL);
-	m_nfa.addState("q1", State::FINAL);
-	m_nfa.addSymbol(s);
-	m_nfa.addTransition("q0", s, "q1");
+	const FiniteAutomaton::StateId q0 = m_nfa.addState(State::INITIAL);
+	const FiniteAutomaton::StateId q1 = m_nfa.addState(State::FINAL);
+	m_nfa.addTransition(q0, m_nfa.addSymbol(s), q1);
 	return true;
+}
+
+
+// Appends copies of all states of `from` to `to`, together with the symbols and
+// transitions between them. States that had `drop` in their type lose it and
+// are collected in `dropped`.
+void RegExp::transfer(const NDFiniteAutomaton &from, NDFiniteAutomaton &to, uint8_t drop, std::vector<FiniteAutomaton::StateId> &dropped)
+{
+	std::vector<FiniteAutomaton::SymbolId> symbols(from.getSymbols().size(), FiniteAutomaton::epsilon);
+	for (FiniteAutomaton::SymbolId s = 0; s < symbols.size(); s++)
+	{
+		if (from.getAlphabet().count(from.getSymbol(s)))
+		{
+			symbols[s] = to.addSymbol(from.getSymbol(s));
+		}
+	}
+
+	const FiniteAutomaton::StateId offset = static_cast<FiniteAutomaton::StateId>(to.getStateCount());
+	for (FiniteAutomaton::StateId id = 0; id < from.getStateCount(); id++)
+	{
+		uint8_t type = from.getState(id).type;
+		if (type & drop)
+		{
+			type ^= drop;
+			dropped.push_back(offset + id);
+		}
+
+		to.addState(type);
+	}
+
+	for (FiniteAutomaton::StateId id = 0; id < from.getStateCount(); id++)
+	{
+		for (const FiniteAutomaton::Edge &e : from.getEdges(id))
+		{
+			to.addTransition(offset + id, symbols[e.symbol], offset + e.to);
+		}
+	}
 }
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include "bitnfa.hpp"
+#include "statebits.hpp"
+#include "subsets.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BIT_NFA_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BIT_NFA_SSE2
+#endif
+
+
+namespace
+{
+	// (target, byte class) of every transition that reads a byte, numbered from
+	// 1 in the order they're first seen. Position 0 is the start.
+	typedef std::map<std::pair<FiniteAutomaton::StateId, size_t>, size_t> Positions;
+
+	Positions numberPositions(const NDFiniteAutomaton &nfa, const std::vector<size_t> &symbol_index)
+	{
+		Positions positions;
+		for (FiniteAutomaton::StateId s = 0; s < nfa.getStateCount(); s++)
+		{
+			for (const FiniteAutomaton::Edge &e : nfa.getEdges(s))
+			{
+				const size_t index = symbol_index[e.symbol];
+				if (index != SIZE_MAX)
+				{
+					positions.insert(std::make_pair(std::make_pair(e.to, index), positions.size() + 1));
+				}
+			}
+		}
+
+		return positions;
+	}
+
+	// dst |= src for rows of a known width, kept in vector registers where there are any
+	template <size_t W>
+	inline void uniteRow(uint64_t *dst, const uint64_t *src)
+	{
+		size_t w = 0;
+
+#if defined(BIT_NFA_AVX2)
+		for (; w + 4 <= W; w += 4)
+		{
+			const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + w));
+			const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + w));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + w), _mm256_or_si256(a, b));
+		}
+#endif
+#if defined(BIT_NFA_AVX2) || defined(BIT_NFA_SSE2)
+		for (; w + 2 <= W; w += 2)
+		{
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + w));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + w));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + w), _mm_or_si128(a, b));
+		}
+#endif
+
+		for (; w < W; w++)
+		{
+			dst[w] |= src[w];
+		}
+	}
+}
+
+
+const size_t BitNFA::max_positions;
+
+
+bool BitNFA::fits(const NDFiniteAutomaton &nfa)
+{
+	std::array<uint8_t, 256> classes;
+	nfa.byteClasses(classes);
+	return numberPositions(nfa, classSymbols(nfa, classes)).size() + 1 <= max_positions;
+}
+
+
+BitNFA::BitNFA(const NDFiniteAutomaton &nfa) :
+	m_class_count{ nfa.byteClasses(m_byte_classes) }
+{
+	const Positions positions = numberPositions(nfa, classSymbols(nfa, m_byte_classes));
+	m_positions = positions.size() + 1;
+
+	// The tables come in 1, 2, 4 or 8 words
+	m_words = StateBits::words(m_positions);
+	if (m_positions <= max_positions)
+	{
+		size_t words = 1;
+		while (words < m_words)
+		{
+			words *= 2;
+		}
+
+		m_words = words;
+	}
+
+	// Positions each NFA state goes on to, whatever the byte
+	const std::vector<size_t> symbol_index = classSymbols(nfa, m_byte_classes);
+	std::vector<uint64_t> out(nfa.getStateCount() * m_words, 0);
+	for (FiniteAutomaton::StateId s = 0; s < nfa.getStateCount(); s++)
+	{
+		for (const FiniteAutomaton::Edge &e : nfa.getEdges(s))
+		{
+			const size_t index = symbol_index[e.symbol];
+			if (index != SIZE_MAX)
+			{
+				StateBits::set(out.data() + s * m_words, positions.at(std::make_pair(e.to, index)));
+			}
+		}
+	}
+
+	m_follow.assign(m_positions * m_words, 0);
+	m_reads.assign(m_class_count * m_words, 0);
+	m_final.assign(m_words, 0);
+
+	// A position stands for the closure of where its transition goes
+	const size_t state_words = StateBits::words(nfa.getStateCount());
+	const auto add = [&](size_t position, const uint64_t *closure) {
+		StateBits::forEach(closure, state_words, [&](size_t s) {
+			StateBits::unite(m_follow.data() + position * m_words, out.data() + s * m_words, m_words);
+			if (nfa.getState(static_cast<FiniteAutomaton::StateId>(s)).isFinal())
+			{
+				StateBits::set(m_final.data(), position);
+			}
+		});
+	};
+
+	std::vector<uint64_t> start(state_words, 0);
+	for (FiniteAutomaton::StateId s = 0; s < nfa.getStateCount(); s++)
+	{
+		if (nfa.getState(s).isInitial())
+		{
+			StateBits::set(start.data(), s);
+		}
+	}
+
+	nfa.closure(start.data());
+	add(0, start.data());
+
+	for (const auto &position : positions)
+	{
+		add(position.second, nfa.getClosure(position.first.first));
+		StateBits::set(m_reads.data() + position.first.second * m_words, position.second);
+	}
+
+	if (m_positions > max_positions)
+	{
+		return;
+	}
+
+	// Each entry is the one with its lowest bit cleared plus that bit's follow()
+	m_tables.assign(m_words * 8 * 256 * m_words, 0);
+	for (size_t chunk = 0; chunk < m_words * 8; chunk++)
+	{
+		uint64_t *table = m_tables.data() + chunk * 256 * m_words;
+		for (size_t b = 1; b < 256; b++)
+		{
+			uint64_t *row = table + b * m_words;
+			std::copy(table + (b & (b - 1)) * m_words, table + ((b & (b - 1)) + 1) * m_words, row);
+
+			const size_t position = chunk * 8 + StateBits::lowest(b);
+			if (position < m_positions)
+			{
+				StateBits::unite(row, m_follow.data() + position * m_words, m_words);
+			}
+		}
+	}
+}
+
+
+template <size_t W>
+bool BitNFA::run(const std::string &s) const
+{
+	uint64_t active[W] = { 1 };
+	for (char c : s)
+	{
+		uint64_t next[W] = {};
+		for (size_t w = 0; w < W; w++)
+		{
+			const uint64_t word = active[w];
+			if (!word)
+			{
+				continue;
+			}
+
+			const uint64_t *table = m_tables.data() + w * 8 * 256 * W;
+			for (size_t k = 0; k < 8; k++)
+			{
+				uniteRow<W>(next, table + (k * 256 + ((word >> (k * 8)) & 0xff)) * W);
+			}
+		}
+
+		const uint64_t *reads = m_reads.data() + m_byte_classes[static_cast<uint8_t>(c)] * W;
+		uint64_t any = 0;
+		for (size_t w = 0; w < W; w++)
+		{
+			active[w] = next[w] & reads[w];
+			any |= active[w];
+		}
+
+		if (!any)
+		{
+			return false;
+		}
+	}
+
+	return StateBits::intersects(active, m_final.data(), W);
+}
+
+
+template <>
+bool BitNFA::run<0>(const std::string &s) const
+{
+	std::vector<uint64_t> active(m_words, 0), next(m_words);
+	StateBits::set(active.data(), 0);
+	for (char c : s)
+	{
+		std::fill(next.begin(), next.end(), 0);
+		StateBits::forEach(active.data(), m_words, [&](size_t position) {
+			StateBits::unite(next.data(), m_follow.data() + position * m_words, m_words);
+		});
+
+		const uint64_t *reads = m_reads.data() + m_byte_classes[static_cast<uint8_t>(c)] * m_words;
+		for (size_t w = 0; w < m_words; w++)
+		{
+			active[w] = next[w] & reads[w];
+		}
+
+		if (!StateBits::any(active.data(), m_words))
+		{
+			return false;
+		}
+	}
+
+	return StateBits::intersects(active.data(), m_final.data(), m_words);
+}
+
+
+bool BitNFA::accept(const std::string &s) const
+{
+	if (m_tables.empty())
+	{
+		return run<0>(s);
+	}
+
+	switch (m_words)
+	{
+	case 1:
+		{
+			return run<1>(s);
+		}
+	case 2:
+		{
+			return run<2>(s);
+		}
+	case 4:
+		{
+			return run<4>(s);
+		}
+	default:
+		{
+			return run<8>(s);
+		}
+	}
+}
\ No newline at end of file
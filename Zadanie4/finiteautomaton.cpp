@@ -3,20 +3,28 @@
 #include <fstream>
 #include <sstream>
 #include <iterator>
+#include <map>
 #include <vector>
 
 #include "finiteautomaton.hpp"
+#include "matcher.hpp"
+#include "statebits.hpp"
 #include "utils.hpp"
 
 
+const FiniteAutomaton::SymbolId FiniteAutomaton::epsilon;
+
+
 FiniteAutomaton::FiniteAutomaton(const std::set<std::string> &alphabet) :
-	m_alphabet{ alphabet }
+	FiniteAutomaton()
 {
-	;
+	setAlphabet(alphabet);
 }
 
 
-FiniteAutomaton::FiniteAutomaton()
+FiniteAutomaton::FiniteAutomaton() :
+	m_symbols{ "" },
+	m_symbol_ids{ { "", epsilon } }
 {
 	;
 }
@@ -71,7 +79,7 @@ FiniteAutomaton::Status FiniteAutomaton::read(const std::string &filename)
 			s.type = State::Type::FINAL;
 		}
 
-		m_states.insert(std::make_pair(label, s));
+		addState(label, s.type);
 	}
 
 	end += num_states;
@@ -82,7 +90,7 @@ FiniteAutomaton::Status FiniteAutomaton::read(const std::string &filename)
 		std::stringstream ss(lines[i]);
 		std::string symbol;
 		std::getline(ss, symbol);
-		m_alphabet.insert(symbol);
+		addSymbol(symbol);
 	}
 
 	end += num_symbols;
@@ -125,15 +133,15 @@ FiniteAutomaton::Status FiniteAutomaton::write(const std::string &filename) cons
 	out_file << new_alphabet.size() << "\n";
 
 	// Write states
-	for (const auto &p : m_states)
+	for (StateId id = 0; id < m_states.size(); id++)
 	{
-		out_file << p.first;
-		
-		if (p.second.isInitial() && p.second.isFinal())
+		out_file << m_labels[id];
+
+		if (m_states[id].isInitial() && m_states[id].isFinal())
 			out_file << " IF";
-		else if (p.second.isInitial())
+		else if (m_states[id].isInitial())
 			out_file << " I";
-		else if (p.second.isFinal())
+		else if (m_states[id].isFinal())
 			out_file << " F";
 
 		out_file << "\n";
@@ -147,17 +155,14 @@ FiniteAutomaton::Status FiniteAutomaton::write(const std::string &filename) cons
 
 	// Write state transitions
 	std::vector<std::string> transition{ 3 };
-	for (const auto &p : m_state_table)
+	for (StateId id = 0; id < m_states.size(); id++)
 	{
-		transition[0] = p.first;
-		for (const auto &t : p.second)
+		transition[0] = m_labels[id];
+		for (const Edge &e : getEdges(id))
 		{
-			transition[1] = t.first;
-			for (const std::string &to : t.second)
-			{
-				transition[2] = to;
-				out_file << Utils::join(transition, ",") << "\n";
-			}
+			transition[1] = m_symbols[e.symbol];
+			transition[2] = m_labels[e.to];
+			out_file << Utils::join(transition, ",") << "\n";
 		}
 	}
 
@@ -168,59 +173,36 @@ FiniteAutomaton::Status FiniteAutomaton::write(const std::string &filename) cons
 
 bool FiniteAutomaton::accept(const std::string &s) const
 {
-	const auto it = std::find_if(m_states.begin(), m_states.end(), [](const std::pair<std::string, State> &p) -> bool {
-		return p.second.isInitial();
-	});
+	return compile()->accept(s);
+}
 
-	if (it == m_states.end())
-	{
-		return false;
-	}
 
-	// Handle epsilon string
-	// This can be done with more (is it?) elegant logic:
-	// 1. Convert string to vector of strings
-	// 2. Push back empty string to vector
-	// 3. do while loop with an if checking for empty symbol
-	if (s.empty() && !(*it).second.isFinal())
-	{
-		return false;
-	}
+void FiniteAutomaton::accept(const std::vector<std::string> &strings, std::vector<uint64_t> &accepted) const
+{
+	accepted.resize(StateBits::words(strings.size()));
+	compile()->accept(strings.data(), strings.size(), accepted.data());
+}
 
-	std::string state = (*it).first;
 
-	size_t idx = 0;
-	while (idx < s.size())
+std::shared_ptr<const Matcher> FiniteAutomaton::compile() const
+{
+	std::shared_ptr<const Matcher> matcher = std::atomic_load(&m_matcher);
+	if (matcher)
 	{
-		if (!m_state_table.count(state))
-		{
-			// State has no transitions
-			return false;
-		}
-
-		const std::string sym(1, s[idx]);
-
-		if (!m_state_table.at(state).count(sym))
-		{
-			// There's no transition from current state to new state using this symbol
-			return false;
-		}
-
-		// It's possible to transition
-		std::string new_state = Utils::join(m_state_table.at(state).at(sym), "");
-		state = new_state;
-
-		if (idx + 1 >= s.size() && !m_states.at(state).isFinal())
-		{
-			// We moved to a new state, but there's nothing else to process &
-			// the new state is not final, so not accepting
-			return false;
-		}
+		return matcher;
+	}
 
-		idx++;
-	} 
+	// Building compacts the transitions, so only one thread may do it. The
+	// others find its Matcher once they get the lock.
+	std::lock_guard<std::mutex> lock(m_build.mutex);
+	matcher = std::atomic_load(&m_matcher);
+	if (!matcher)
+	{
+		matcher = std::make_shared<const Matcher>(*this);
+		std::atomic_store(&m_matcher, matcher);
+	}
 
-	return true;
+	return matcher;
 }
 
 
@@ -228,35 +210,43 @@ std::set<std::string> FiniteAutomaton::closure(const std::set<std::string> &stat
 {
 	std::set<std::string> empty = states;
 
+	std::vector<uint64_t> bits(StateBits::words(m_states.size()), 0);
 	for (const std::string &state : states)
 	{
-		if (!m_state_table.count(state))
+		StateId id;
+		if (findState(state, id))
 		{
-			continue;
+			StateBits::set(bits.data(), id);
 		}
+	}
 
-		if (!m_state_table.at(state).count(""))
+	closure(bits.data());
+	StateBits::forEach(bits.data(), bits.size(), [&](size_t id) {
+		if (empty.insert(m_labels[id]).second)
 		{
-			continue;
+			done.insert(m_labels[id]);
 		}
+	});
 
-		for (const std::string &x : m_state_table.at(state).at(""))
-		{
-			if (done.count(x))
-			{
-				continue;
-			}
+	return empty;
+}
 
-			done.insert(x);
 
-			for (const std::string &s : closure({ x }, done))
-			{
-				empty.insert(s);
-			}
-		}
-	}
+void FiniteAutomaton::closure(uint64_t *bits) const
+{
+	// Closures are closed already, so states this adds to words not visited yet
+	// only bring in what is there anyway
+	const size_t words = StateBits::words(m_states.size());
+	StateBits::forEach(bits, words, [this, bits, words](size_t id) {
+		StateBits::unite(bits, getClosure(static_cast<StateId>(id)), words);
+	});
+}
 
-	return empty;
+
+const uint64_t *FiniteAutomaton::getClosure(StateId id) const
+{
+	closeEpsilon();
+	return m_closures.data() + m_closure_of[id] * StateBits::words(m_states.size());
 }
 
 
@@ -264,21 +254,23 @@ std::set<std::string> FiniteAutomaton::transitions(const std::set<std::string> &
 {
 	std::set<std::string> new_states;
 
-	for (const std::string &state : from)
+	SymbolId symbol_id;
+	if (!findSymbol(symbol, symbol_id))
 	{
-		if (!m_state_table.count(state))
-		{
-			continue;
-		}
+		return new_states;
+	}
 
-		if (!m_state_table.at(state).count(symbol))
+	for (const std::string &state : from)
+	{
+		StateId id;
+		if (!findState(state, id))
 		{
 			continue;
 		}
 
-		for (const std::string &s : m_state_table.at(state).at(symbol))
+		for (const Edge &e : getEdges(id, symbol_id))
 		{
-			new_states.insert(s);
+			new_states.insert(m_labels[e.to]);
 		}
 	}
 
@@ -286,79 +278,343 @@ std::set<std::string> FiniteAutomaton::transitions(const std::set<std::string> &
 }
 
 
+FiniteAutomaton::StateId FiniteAutomaton::addState(uint8_t type)
+{
+	const StateId id = static_cast<StateId>(m_states.size());
+	m_matcher.reset();
+	m_states.push_back(State(type));
+	m_labels.push_back("q" + std::to_string(id));
+	m_state_ids.insert(std::make_pair(m_labels.back(), id));
+	return id;
+}
+
+
 bool FiniteAutomaton::addState(const std::string &label, uint8_t type, bool mod)
 {
-	if (m_states.count(label))
+	const auto it = m_state_ids.find(label);
+	if (it != m_state_ids.end())
 	{
 		if (mod)
 		{
-			m_states[label] = type;
+			m_matcher.reset();
+			m_states[it->second] = type;
 			return true;
 		}
 
 		return false;
 	}
 
-	m_states.insert(std::make_pair(label, State(type)));
+	m_matcher.reset();
+	m_state_ids.insert(std::make_pair(label, static_cast<StateId>(m_states.size())));
+	m_states.push_back(State(type));
+	m_labels.push_back(label);
 	return true;
 }
 
 
-void FiniteAutomaton::addSymbol(const std::string &symbol)
+FiniteAutomaton::SymbolId FiniteAutomaton::addSymbol(const std::string &symbol)
 {
 	m_alphabet.insert(symbol);
+
+	const auto it = m_symbol_ids.find(symbol);
+	if (it != m_symbol_ids.end())
+	{
+		return it->second;
+	}
+
+	const SymbolId id = static_cast<SymbolId>(m_symbols.size());
+	m_symbols.push_back(symbol);
+	m_symbol_ids.insert(std::make_pair(symbol, id));
+	return id;
+}
+
+
+void FiniteAutomaton::addTransition(StateId from, SymbolId symbol, StateId to)
+{
+	m_matcher.reset();
+	m_closure_of.clear();
+	m_pending.push_back(std::make_pair(from, Edge{ symbol, to }));
 }
 
 
 bool FiniteAutomaton::addTransition(const std::string &from, const std::string &symbol, const std::string &to)
 {
-	if (!m_states.count(from) || !m_states.count(to) || !m_alphabet.count(symbol))
+	StateId from_id, to_id;
+	SymbolId symbol_id;
+	if (!findState(from, from_id) || !findState(to, to_id) || !m_alphabet.count(symbol) || !findSymbol(symbol, symbol_id))
 	{
 		return false;
 	}
 
-	if (!m_state_table.count(from))
+	addTransition(from_id, symbol_id, to_id);
+	return true;
+}
+
+
+bool FiniteAutomaton::findState(const std::string &label, StateId &id) const
+{
+	const auto it = m_state_ids.find(label);
+	if (it == m_state_ids.end())
+	{
+		return false;
+	}
+
+	id = it->second;
+	return true;
+}
+
+
+bool FiniteAutomaton::findSymbol(const std::string &symbol, SymbolId &id) const
+{
+	const auto it = m_symbol_ids.find(symbol);
+	if (it == m_symbol_ids.end())
+	{
+		return false;
+	}
+
+	id = it->second;
+	return true;
+}
+
+
+void FiniteAutomaton::compact() const
+{
+	if (m_pending.empty() && m_offsets.size() == m_states.size() + 1)
+	{
+		return;
+	}
+
+	// Rows grow by however many pending transitions leave each state
+	const size_t old_states = m_offsets.empty() ? 0 : m_offsets.size() - 1;
+	std::vector<uint32_t> offsets(m_states.size() + 1, 0);
+	for (size_t s = 0; s < old_states; s++)
+	{
+		offsets[s + 1] = m_offsets[s + 1] - m_offsets[s];
+	}
+
+	for (const auto &p : m_pending)
 	{
-		std::map<std::string, std::set<std::string>> transition{
-			{ symbol, { to } }
-		};
+		offsets[p.first + 1]++;
+	}
 
-		m_state_table.insert(std::make_pair(from, transition));
+	for (size_t s = 0; s < m_states.size(); s++)
+	{
+		offsets[s + 1] += offsets[s];
 	}
-	else
+
+	std::vector<Edge> edges(offsets.back());
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t s = 0; s < old_states; s++)
 	{
-		if (!m_state_table.at(from).count(symbol))
+		for (uint32_t e = m_offsets[s]; e < m_offsets[s + 1]; e++)
 		{
-			m_state_table.at(from).insert(std::make_pair(symbol, std::set<std::string>{ to }));
+			edges[fill[s]++] = m_edges[e];
 		}
-		else
+	}
+
+	for (const auto &p : m_pending)
+	{
+		edges[fill[p.first]++] = p.second;
+	}
+
+	// Sort every row and drop duplicates, packing the rows together again
+	uint32_t out = 0;
+	for (size_t s = 0; s < m_states.size(); s++)
+	{
+		const auto first = edges.begin() + offsets[s], last = edges.begin() + offsets[s + 1];
+		std::sort(first, last);
+		const auto unique_last = std::unique(first, last);
+
+		offsets[s] = out;
+		out = static_cast<uint32_t>(std::copy(first, unique_last, edges.begin() + out) - edges.begin());
+	}
+
+	offsets[m_states.size()] = out;
+	edges.resize(out);
+
+	m_offsets = std::move(offsets);
+	m_edges = std::move(edges);
+	m_pending.clear();
+}
+
+
+FiniteAutomaton::Edges FiniteAutomaton::getEdges(StateId from) const
+{
+	compact();
+
+	const Edge *const edges = m_edges.data();
+	return Edges{ edges + m_offsets[from], edges + m_offsets[from + 1] };
+}
+
+
+FiniteAutomaton::Edges FiniteAutomaton::getEdges(StateId from, SymbolId symbol) const
+{
+	const Edges row = getEdges(from);
+	const Edge *first = std::lower_bound(row.begin(), row.end(), Edge{ symbol, 0 });
+	const Edge *last = first;
+	while (last != row.end() && last->symbol == symbol)
+	{
+		last++;
+	}
+
+	return Edges{ first, last };
+}
+
+
+size_t FiniteAutomaton::byteClasses(std::array<uint8_t, 256> &classes) const
+{
+	compact();
+
+	// What a symbol does everywhere, as the (state, target) pairs of its transitions
+	std::vector<std::vector<StateId>> signatures(m_symbols.size());
+	for (StateId id = 0; id < m_states.size(); id++)
+	{
+		for (const Edge &e : getEdges(id))
 		{
-			m_state_table.at(from).at(symbol).insert(to);
+			signatures[e.symbol].push_back(id);
+			signatures[e.symbol].push_back(e.to);
 		}
 	}
 
-	return true;
+	// Bytes without a symbol of their own behave like symbols that go nowhere
+	const std::vector<StateId> nowhere;
+	std::map<std::vector<StateId>, uint8_t> seen;
+	size_t count = 0;
+	for (size_t b = 0; b < classes.size(); b++)
+	{
+		SymbolId symbol;
+		const std::vector<StateId> &signature = findSymbol(std::string(1, static_cast<char>(b)), symbol) ? signatures[symbol] : nowhere;
+
+		const auto it = seen.insert(std::make_pair(signature, static_cast<uint8_t>(count)));
+		count += it.second;
+		classes[b] = it.first->second;
+	}
+
+	return count;
 }
 
 
-#ifdef _TESTS
-std::set<std::string> FiniteAutomaton::getStateTransitions(const std::string &st) const
+void FiniteAutomaton::closeEpsilon() const
 {
-	const auto state_transitions = m_state_table.find(st);
-	if (state_transitions == m_state_table.end())
+	if (m_closure_of.size() == m_states.size())
 	{
-		return std::set<std::string>{};
+		return;
 	}
 
-	std::set<std::string> transitions;
+	// Tarjan's algorithm with an explicit stack of (state, next edge). A component
+	// only comes out once every component it reaches is done, so its closure is
+	// its own states plus the closures its edges lead to. Each state and edge is
+	// looked at once, however the epsilon edges loop.
+	compact();
 
-	for (const auto &p : state_transitions->second)
+	const size_t count = m_states.size();
+	const size_t words = StateBits::words(count);
+	const uint32_t none = UINT32_MAX;
+
+	m_closures.clear();
+	m_closure_of.assign(count, none);
+
+	std::vector<uint32_t> index(count, none), low(count, 0);
+	std::vector<StateId> open;
+	std::vector<std::pair<StateId, Edges>> calls;
+	uint32_t next_index = 0;
+	for (StateId root = 0; root < count; root++)
 	{
-		for (const std::string &ns : p.second)
+		if (index[root] != none)
+		{
+			continue;
+		}
+
+		index[root] = low[root] = next_index++;
+		open.push_back(root);
+		calls.push_back(std::make_pair(root, getEdges(root, epsilon)));
+		while (!calls.empty())
 		{
-			transitions.insert(st + "->" + p.first + "->" + ns);
+			const StateId s = calls.back().first;
+			Edges &edges = calls.back().second;
+			if (!edges.empty())
+			{
+				// Visited states without a component yet are still open
+				const StateId to = (edges.first++)->to;
+				if (index[to] == none)
+				{
+					index[to] = low[to] = next_index++;
+					open.push_back(to);
+					calls.push_back(std::make_pair(to, getEdges(to, epsilon)));
+				}
+				else if (m_closure_of[to] == none)
+				{
+					low[s] = std::min(low[s], index[to]);
+				}
+
+				continue;
+			}
+
+			calls.pop_back();
+			if (!calls.empty())
+			{
+				low[calls.back().first] = std::min(low[calls.back().first], low[s]);
+			}
+
+			if (low[s] != index[s])
+			{
+				continue;
+			}
+
+			const uint32_t component = static_cast<uint32_t>(m_closures.size() / words);
+			m_closures.resize(m_closures.size() + words, 0);
+			uint64_t *row = m_closures.data() + component * words;
+
+			size_t first = open.size();
+			do
+			{
+				first--;
+				m_closure_of[open[first]] = component;
+				StateBits::set(row, open[first]);
+			} while (open[first] != s);
+
+			for (size_t k = first; k < open.size(); k++)
+			{
+				for (const Edge &t : getEdges(open[k], epsilon))
+				{
+					if (m_closure_of[t.to] != component)
+					{
+						StateBits::unite(row, m_closures.data() + m_closure_of[t.to] * words, words);
+					}
+				}
+			}
+
+			open.resize(first);
 		}
 	}
+}
+
+
+void FiniteAutomaton::setAlphabet(const std::set<std::string> &alphabet)
+{
+	m_alphabet.clear();
+	for (const std::string &symbol : alphabet)
+	{
+		addSymbol(symbol);
+	}
+}
+
+
+#ifdef _TESTS
+std::set<std::string> FiniteAutomaton::getStateTransitions(const std::string &st) const
+{
+	std::set<std::string> transitions;
+
+	StateId id;
+	if (!findState(st, id))
+	{
+		return transitions;
+	}
+
+	for (const Edge &e : getEdges(id))
+	{
+		transitions.insert(st + "->" + m_symbols[e.symbol] + "->" + m_labels[e.to]);
+	}
 
 	return transitions;
 }
@@ -379,32 +635,31 @@ bool DFiniteAutomaton::operator==(const DFiniteAutomaton &rhs)
 		return false;
 	}
 
-	// States that have transitions should also be the same
-	if (m_state_table.size() != rhs.getStateTable().size())
-	{
-		return false;
-	}
-
 	// We take all transition symbols and size of sets of states they transition to
 	// add them to a vector, then sort them. In theory, they should be the same for
-	// equivalent automatons.
-	std::vector<std::string> left, right;
-	for (const auto &p : m_state_table)
-	{
-		for (const auto &x : p.second)
+	// equivalent automatons. States that have transitions should also be the same.
+	auto describe = [](const FiniteAutomaton &fa, std::vector<std::string> &out) -> size_t {
+		size_t with_transitions = 0;
+		for (StateId id = 0; id < fa.getStateCount(); id++)
 		{
-			std::string a = x.first + "" + std::to_string(x.second.size());
-			left.push_back(a);
+			const Edges row = fa.getEdges(id);
+			with_transitions += !row.empty();
+
+			for (const Edge *e = row.begin(); e != row.end(); )
+			{
+				const Edges same = fa.getEdges(id, e->symbol);
+				out.push_back(fa.getSymbol(e->symbol) + "" + std::to_string(same.size()));
+				e = same.end();
+			}
 		}
-	}
 
-	for (const auto &p : rhs.getStateTable())
+		return with_transitions;
+	};
+
+	std::vector<std::string> left, right;
+	if (describe(*this, left) != describe(rhs, right))
 	{
-		for (const auto &x : p.second)
-		{
-			std::string a = x.first + "" + std::to_string(x.second.size());
-			right.push_back(a);
-		}
+		return false;
 	}
 
 	std::sort(left.begin(), left.end());
@@ -1,11 +1,14 @@
 #include <iostream>
 #include <fstream>
+#include <vector>
 
 #include "lexer.hpp"
 #include "parser.hpp"
 #include "finiteautomaton.hpp"
 #include "semanticanalysis.hpp"
 #include "fautils.hpp"
+#include "lazydfa.hpp"
+#include "bitnfa.hpp"
 
 
 extern SemanticAnalysis *sem;
@@ -29,13 +32,35 @@ std::string readRegexpFromFile(const std::string &filename)
 
 int main(int argc, char **argv)
 {
-	if (argc < 4)
+	// Options can go anywhere on the command line
+	bool minimize = false, lazy = false;
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; i++)
 	{
-		std::cerr << "Usage: " << argv[0] << " <in_regexp> <out_nfa> <out_dfa>\n";
+		const std::string arg(argv[i]);
+		if (arg == "--minimize")
+		{
+			minimize = true;
+		}
+		else if (arg == "--lazy")
+		{
+			lazy = true;
+		}
+		else
+		{
+			args.push_back(arg);
+		}
+	}
+
+	// A lazy DFA is never built as a whole, so there's no DFA to write
+	if (args.size() < (lazy ? 2 : 3))
+	{
+		std::cerr << "Usage: " << argv[0] << " [--minimize] <in_regexp> <out_nfa> <out_dfa>\n";
+		std::cerr << "       " << argv[0] << " --lazy <in_regexp> <out_nfa>\n";
 		return EXIT_FAILURE;
 	}
 
-	const std::string in_regexp_file(argv[1]), out_nfa(argv[2]), out_dfa(argv[3]);
+	const std::string in_regexp_file(args[0]), out_nfa(args[1]), out_dfa(lazy ? std::string() : args[2]);
 	const std::string in_regexp = readRegexpFromFile(in_regexp_file);
 
 	if (in_regexp.empty())
@@ -83,23 +108,48 @@ int main(int argc, char **argv)
 	std::cout << "[+] NFA from regexp written to \"" << out_nfa << "\"\n";
 
 	DFiniteAutomaton dfa;
-	if (FAUtils::nfa_to_dfa(nfa, dfa))
+
+	// Small NFAs are run as they are, bigger ones get a lazy DFA
+	std::unique_ptr<BitNFA> bit_nfa;
+	std::unique_ptr<LazyDFA> lazy_dfa;
+	if (lazy && BitNFA::fits(nfa))
 	{
-		std::cout << "[+] NFA converted to DFA\n";
+		bit_nfa.reset(new BitNFA(nfa));
+		std::cout << "[+] Matching with a bit-parallel NFA of " << bit_nfa->getPositionCount() << " positions\n";
 	}
-	else
+	else if (lazy)
 	{
-		std::cerr << "Failed to convert final NFA to DFA\n";
-		return EXIT_FAILURE;
+		lazy_dfa.reset(new LazyDFA(nfa));
+		std::cout << "[+] Matching with a lazy DFA, states are made as the input needs them\n";
 	}
-
-	if (dfa.write(out_dfa) != FiniteAutomaton::Status::OK)
+	else
 	{
-		std::cerr << "Failed to write DFA to \"" << out_dfa << "\"\n";
-		return EXIT_FAILURE;
-	}
+		if (FAUtils::nfa_to_dfa(nfa, dfa))
+		{
+			std::cout << "[+] NFA converted to DFA\n";
+		}
+		else
+		{
+			std::cerr << "Failed to convert final NFA to DFA\n";
+			return EXIT_FAILURE;
+		}
 
-	std::cout << "[+] DFA written to \"" << out_dfa << "\"\n";
+		if (minimize)
+		{
+			DFiniteAutomaton minimal;
+			FAUtils::minimize(dfa, minimal);
+			std::cout << "[+] DFA minimized from " << dfa.getStateCount() << " to " << minimal.getStateCount() << " states\n";
+			dfa = minimal;
+		}
+
+		if (dfa.write(out_dfa) != FiniteAutomaton::Status::OK)
+		{
+			std::cerr << "Failed to write DFA to \"" << out_dfa << "\"\n";
+			return EXIT_FAILURE;
+		}
+
+		std::cout << "[+] DFA written to \"" << out_dfa << "\"\n";
+	}
 
 	while (true)
 	{
@@ -108,7 +158,7 @@ int main(int argc, char **argv)
 		std::string str;
 		std::getline(std::cin, str);
 
-		if (dfa.accept(str))
+		if (bit_nfa ? bit_nfa->accept(str) : lazy ? lazy_dfa->accept(str) : dfa.accept(str))
 		{
 			std::cout << "ACCEPT\n";
 		}
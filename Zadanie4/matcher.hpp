@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "finiteautomaton.hpp"
+
+
+// A DFA compiled down to what matching needs: the byte classes, one flat table
+// of next states, a bitmap of the accepting states and where to start. Nothing
+// changes once it's built, so any number of threads can share one.
+//
+// Rows are one entry per byte class wide and states are stored as the index of
+// their row's first entry, so a step is table[state + class]. The last row is a
+// dead state that loops to itself. Nondeterministic automata just take the
+// first target of each transition.
+class Matcher
+{
+public:
+	static const size_t lanes = 16;
+
+	explicit Matcher(const FiniteAutomaton &fa);
+
+	bool accept(const std::string &s) const { return accept(s.data(), s.size()); }
+	bool accept(const char *data, size_t size) const;
+
+	// Matches many strings at once, bit i of accepted is set when strings[i] is
+	// accepted. accepted has to hold StateBits::words(count) words. One string
+	// waits on a table load per byte, so this walks `lanes` strings side by side
+	// and the loads of one lane overlap the waits of the others.
+	void accept(const std::string *strings, size_t count, uint64_t *accepted) const;
+
+	size_t getStateCount() const { return m_states; }
+	size_t getClassCount() const { return m_class_count; }
+
+private:
+	std::array<uint8_t, 256> m_byte_classes;
+	size_t m_class_count;
+	size_t m_states;
+	uint32_t m_start;
+	uint32_t m_dead;
+	std::vector<uint32_t> m_table;
+
+	// Bit s is set when state s accepts
+	std::vector<uint64_t> m_final;
+};
\ No newline at end of file
@@ -24,6 +24,7 @@ public:
 
 private:
 	bool buildElementary(const std::set<std::string> &symbol);
+	static void transfer(const NDFiniteAutomaton &from, NDFiniteAutomaton &to, uint8_t drop, std::vector<FiniteAutomaton::StateId> &dropped);
 
 	NDFiniteAutomaton m_nfa;
 };
\ No newline at end of file
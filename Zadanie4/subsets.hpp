@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "finiteautomaton.hpp"
+#include "statebits.hpp"
+
+
+// Pieces of the subset construction that nfa_to_dfa, LazyDFA and BitNFA share
+
+// Index of the byte class each symbol matches, for SubsetMoves and the like.
+// Symbols longer than one character can't be matched and get SIZE_MAX.
+inline std::vector<size_t> classSymbols(const NDFiniteAutomaton &nfa, const std::array<uint8_t, 256> &classes)
+{
+	std::vector<size_t> symbol_index(nfa.getSymbols().size(), SIZE_MAX);
+	for (size_t b = 0; b < classes.size(); b++)
+	{
+		FiniteAutomaton::SymbolId id;
+		if (nfa.findSymbol(std::string(1, static_cast<char>(b)), id))
+		{
+			symbol_index[id] = classes[b];
+		}
+	}
+
+	return symbol_index;
+}
+
+
+// DFA states found so far, each one a set of NFA states. The sets are rows of
+// one buffer, found again through an open addressing table of their ids.
+class SubsetTable
+{
+public:
+	explicit SubsetTable(size_t words) :
+		m_words{ words },
+		m_slots(64, 0)
+	{
+		;
+	}
+
+	// Id of the set, which is added if it's not there yet
+	uint32_t insert(const uint64_t *bits, bool &added)
+	{
+		return insert(bits, StateBits::hash(bits, m_words), added);
+	}
+
+	uint32_t insert(const uint64_t *bits, uint64_t hash, bool &added)
+	{
+		const size_t mask = m_slots.size() - 1;
+		for (size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+		{
+			const uint32_t id = m_slots[slot];
+			if (!id)
+			{
+				m_slots[slot] = static_cast<uint32_t>(m_hashes.size() + 1);
+				break;
+			}
+
+			if (m_hashes[id - 1] == hash && StateBits::equal(get(id - 1), bits, m_words))
+			{
+				added = false;
+				return id - 1;
+			}
+		}
+
+		m_sets.insert(m_sets.end(), bits, bits + m_words);
+		m_hashes.push_back(hash);
+		if (m_hashes.size() * 2 > m_slots.size())
+		{
+			grow();
+		}
+
+		added = true;
+		return static_cast<uint32_t>(m_hashes.size() - 1);
+	}
+
+	bool find(const uint64_t *bits, uint64_t hash, uint32_t &id) const
+	{
+		const size_t mask = m_slots.size() - 1;
+		for (size_t slot = hash & mask; m_slots[slot]; slot = (slot + 1) & mask)
+		{
+			const uint32_t candidate = m_slots[slot] - 1;
+			if (m_hashes[candidate] == hash && StateBits::equal(get(candidate), bits, m_words))
+			{
+				id = candidate;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Forgets every set, ids start from 0 again
+	void clear()
+	{
+		m_sets.clear();
+		m_hashes.clear();
+		m_slots.assign(64, 0);
+	}
+
+	// Only valid until the next insert
+	const uint64_t *get(uint32_t id) const { return m_sets.data() + id * m_words; }
+	size_t size() const { return m_hashes.size(); }
+
+private:
+	void grow()
+	{
+		m_slots.assign(m_slots.size() * 2, 0);
+
+		const size_t mask = m_slots.size() - 1;
+		for (size_t id = 0; id < m_hashes.size(); id++)
+		{
+			size_t slot = m_hashes[id] & mask;
+			while (m_slots[slot])
+			{
+				slot = (slot + 1) & mask;
+			}
+
+			m_slots[slot] = static_cast<uint32_t>(id + 1);
+		}
+	}
+
+	size_t m_words;
+	std::vector<uint64_t> m_sets;
+	std::vector<uint64_t> m_hashes;
+
+	// Ids + 1, 0 is an empty slot
+	std::vector<uint32_t> m_slots;
+};
+
+
+// Where every NFA state goes on each symbol, closure included. Closure of a
+// union is the union of closures, so successors of a subset are just the
+// union of its members' rows. moves[offsets[s]..] are (symbol, row) pairs.
+struct SubsetMoves
+{
+	size_t words;
+	size_t symbols;
+	std::vector<uint64_t> rows, initial, final;
+	std::vector<std::pair<size_t, size_t>> moves;
+	std::vector<size_t> offsets;
+
+	SubsetMoves(const NDFiniteAutomaton &nfa, const std::vector<size_t> &symbol_index, size_t symbol_count) :
+		words{ StateBits::words(nfa.getStateCount()) },
+		symbols{ symbol_count },
+		initial(words, 0),
+		final(words, 0),
+		offsets(nfa.getStateCount() + 1, 0)
+	{
+		for (FiniteAutomaton::StateId s = 0; s < nfa.getStateCount(); s++)
+		{
+			offsets[s] = moves.size();
+
+			if (nfa.getState(s).isInitial())
+			{
+				StateBits::set(initial.data(), s);
+			}
+
+			if (nfa.getState(s).isFinal())
+			{
+				StateBits::set(final.data(), s);
+			}
+
+			const FiniteAutomaton::Edges row = nfa.getEdges(s);
+			for (const FiniteAutomaton::Edge *e = row.begin(); e != row.end(); )
+			{
+				const FiniteAutomaton::Edges same = nfa.getEdges(s, e->symbol);
+				e = same.end();
+
+				const size_t index = symbol_index[same.begin()->symbol];
+				if (index == SIZE_MAX)
+				{
+					continue;
+				}
+
+				rows.resize(rows.size() + words, 0);
+				uint64_t *bits = rows.data() + rows.size() - words;
+				for (const FiniteAutomaton::Edge &t : same)
+				{
+					StateBits::unite(bits, nfa.getClosure(t.to), words);
+				}
+
+				moves.push_back(std::make_pair(index, rows.size() / words - 1));
+			}
+		}
+
+		offsets[nfa.getStateCount()] = moves.size();
+		nfa.closure(initial.data());
+	}
+
+	// next[k * words..] gets the successors on symbol k, touched[k] says if there are any
+	void step(const uint64_t *bits, uint64_t *next, uint8_t *touched) const
+	{
+		StateBits::forEach(bits, words, [&](size_t s) {
+			for (size_t m = offsets[s]; m < offsets[s + 1]; m++)
+			{
+				StateBits::unite(next + moves[m].first * words, rows.data() + moves[m].second * words, words);
+				touched[moves[m].first] = 1;
+			}
+		});
+	}
+
+	// Same for a single symbol, next is one row
+	void step(const uint64_t *bits, size_t symbol, uint64_t *next) const
+	{
+		StateBits::forEach(bits, words, [&](size_t s) {
+			for (size_t m = offsets[s]; m < offsets[s + 1]; m++)
+			{
+				if (moves[m].first == symbol)
+				{
+					StateBits::unite(next, rows.data() + moves[m].second * words, words);
+				}
+			}
+		});
+	}
+
+	uint8_t type(const uint64_t *bits) const
+	{
+		return StateBits::intersects(bits, final.data(), words) ? State::Type::FINAL : State::Type::NONE;
+	}
+};
\ No newline at end of file